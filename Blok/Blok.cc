@@ -360,7 +360,56 @@ void runTests() {
 
     printf("Speed %.2lfMsmp/sec\n", 1e-6 * N / st);
 
-    printf("\n -*- 4: Raycasts (N=%i) -*-\n", N/100);
+    printf("\n -*- 4: Random::Simplex::noise2d (N=%i,M=%i) -*-\n", N / 1000, 1000);
+
+    Random::Simplex srnd = Random::Simplex(0);
+
+    st = getTime();
+    ct = 0;
+    for (int i = 0; i < N / 1000; ++i) {
+        for (int j = 0; j < 1000; ++j) {
+
+            double r = srnd.noise2d(0.123456 * i, 0.0372983 * j);
+            tmp += r;
+
+            if (ct == N - B) printf("... ");
+            if (ct < B || N - ct <= B) printf("%.3lf ", r);
+            ct++;
+        }
+
+    }
+    printf("\n");
+    st = getTime() - st;
+
+    printf("Speed %.2lfMsmp/sec\n", 1e-6 * N / st);
+
+
+    // 3D noise is what the cave pass of `WG::DefaultWG` spends most of its time in,
+    //   so benchmark both generators on the same sample points
+    printf("\n -*- 5: Random::Perlin::noise3d vs Random::Simplex::noise3d (N=%i,M=%i) -*-\n", N / 1000, 1000);
+
+    double st_perlin = getTime();
+    for (int i = 0; i < N / 1000; ++i) {
+        for (int j = 0; j < 1000; ++j) {
+            double r = prnd.noise3d(0.123456 * i, 0.0372983 * j, 0.0219 * (i + j));
+            tmp += r;
+        }
+    }
+    st_perlin = getTime() - st_perlin;
+
+    double st_simplex = getTime();
+    for (int i = 0; i < N / 1000; ++i) {
+        for (int j = 0; j < 1000; ++j) {
+            double r = srnd.noise3d(0.123456 * i, 0.0372983 * j, 0.0219 * (i + j));
+            tmp += r;
+        }
+    }
+    st_simplex = getTime() - st_simplex;
+
+    printf("Perlin:  %.2lfMsmp/sec\n", 1e-6 * N / st_perlin);
+    printf("Simplex: %.2lfMsmp/sec (%.2lfx)\n", 1e-6 * N / st_simplex, st_perlin / st_simplex);
+
+    printf("\n -*- 6: Raycasts (N=%i) -*-\n", N/100);
 
     // construct a new server
     Server* server = new LocalServer();
@@ -404,6 +453,499 @@ void runTests() {
 
     printf("Raycasts: %i hits (%%%i) %.2lfkcasts/sec\n", hits, 100 * hits / (N / 100), (N / 100.0) / (1000.0 * st));
 
+
+    // stream in chunks in rings around the origin (like a player loading in), and for each one also look
+    //   up the heights along the borders of its 4 neighbours, like a border-aware feature would (i.e. slopes, trees)
+    int wg_N = 8;
+    printf("\n -*- 7: WG::HeightCache streaming (%ix%i chunks) -*-\n", 2 * wg_N + 1, 2 * wg_N + 1);
+
+    // run once with the cache, and once without it
+    double wg_t[2];
+    for (int pass = 0; pass < 2; ++pass) {
+        WG::DefaultWG* wg = new WG::DefaultWG(0);
+        if (pass == 1) wg->heightCache.capacity = 0;
+
+        st = getTime();
+        for (int r = 0; r <= wg_N; ++r) {
+            for (int X = -r; X <= r; ++X) {
+                for (int Z = -r; Z <= r; ++Z) {
+                    // only the outer ring
+                    if (abs(X) != r && abs(Z) != r) continue;
+
+                    Chunk* chunk = wg->getChunk({X, Z});
+
+                    // sample the bordering columns of the neighbours
+                    for (int i = 0; i < CHUNK_SIZE_X; ++i) {
+                        tmp += wg->heightCache.getHeight(CHUNK_SIZE_X * X + i, CHUNK_SIZE_Z * Z - 1);
+                        tmp += wg->heightCache.getHeight(CHUNK_SIZE_X * X + i, CHUNK_SIZE_Z * (Z + 1));
+                        tmp += wg->heightCache.getHeight(CHUNK_SIZE_X * X - 1, CHUNK_SIZE_Z * Z + i);
+                        tmp += wg->heightCache.getHeight(CHUNK_SIZE_X * (X + 1), CHUNK_SIZE_Z * Z + i);
+                    }
+
+                    delete chunk;
+                }
+            }
+        }
+        wg_t[pass] = getTime() - st;
+
+        int wg_chunks = (2 * wg_N + 1) * (2 * wg_N + 1);
+        printf("%s: %.3lfms/chunk, %.1lf%% hits\n", pass == 0 ? "Cached  " : "Uncached", 1e3 * wg_t[pass] / wg_chunks, 100.0 * wg->heightCache.getHitRate());
+
+        delete wg;
+    }
+
+    printf("Speedup: %.2lfx\n", wg_t[1] / wg_t[0]);
+
+
+    // break down generation time by stage, for each of the built in generators
+    printf("\n -*- 8: WG::Pipeline stages (%ix%i chunks) -*-\n", 2 * wg_N + 1, 2 * wg_N + 1);
+
+    for (int pass = 0; pass < 2; ++pass) {
+        WG::Pipeline* wg = pass == 0 ? (WG::Pipeline*)new WG::DefaultWG(0) : (WG::Pipeline*)new WG::FlatWG(0);
+
+        st = getTime();
+        for (int X = -wg_N; X <= wg_N; ++X) {
+            for (int Z = -wg_N; Z <= wg_N; ++Z) {
+                delete wg->getChunk({X, Z});
+            }
+        }
+        st = getTime() - st;
+
+        int wg_chunks = (2 * wg_N + 1) * (2 * wg_N + 1);
+        printf("%s: %.3lfms/chunk\n", pass == 0 ? "DefaultWG" : "FlatWG", 1e3 * st / wg_chunks);
+        for (WG::Stage* stage : wg->stages) {
+            printf("  %-10s %.3lfms/chunk (%%%.1lf)\n", stage->name.c_str(), 1e3 * stage->getTimePerChunk(), 100.0 * stage->stats.t_chunks / st);
+        }
+
+        delete wg;
+    }
+
+
+    // compare the ways of filling a chunk with the same column everywhere (which is what FlatWG does)
+    int fill_N = 1000;
+    printf("\n -*- 9: Chunk fills (N=%i) -*-\n", fill_N);
+
+    BlockData column[CHUNK_SIZE_Y];
+    for (int y = 0; y < CHUNK_SIZE_Y; ++y) {
+        column[y] = BlockData(y < 60 ? ID::STONE : y < 80 ? ID::DIRT : y < 81 ? ID::DIRT_GRASS : ID::AIR);
+    }
+
+    Chunk* fill_chunk = new Chunk();
+    double fill_t[3];
+    for (int pass = 0; pass < 3; ++pass) {
+        st = getTime();
+        for (int i = 0; i < fill_N; ++i) {
+            if (pass == 0) {
+                // block by block
+                for (int x = 0; x < CHUNK_SIZE_X; ++x) {
+                    for (int z = 0; z < CHUNK_SIZE_Z; ++z) {
+                        for (int y = 0; y < CHUNK_SIZE_Y; ++y) {
+                            fill_chunk->set(x, y, z, column[y]);
+                        }
+                    }
+                }
+            } else if (pass == 1) {
+                // runs of each layer
+                for (int x = 0; x < CHUNK_SIZE_X; ++x) {
+                    for (int z = 0; z < CHUNK_SIZE_Z; ++z) {
+                        fill_chunk->setRun(x, z, 0, 60, column[0]);
+                        fill_chunk->setRun(x, z, 60, 80, column[60]);
+                        fill_chunk->setRun(x, z, 80, 81, column[80]);
+                        fill_chunk->setRun(x, z, 81, CHUNK_SIZE_Y, column[81]);
+                    }
+                }
+            } else {
+                // column template
+                fill_chunk->fillColumns(column);
+            }
+            tmp += fill_chunk->blocks[i % CHUNK_NUM_BLOCKS].id;
+        }
+        fill_t[pass] = getTime() - st;
+
+        printf("%-15s %.2lfus/chunk (%.1lfx)\n", pass == 0 ? "set():" : pass == 1 ? "setRun():" : "fillColumns():", 1e6 * fill_t[pass] / fill_N, fill_t[0] / fill_t[pass]);
+    }
+    delete fill_chunk;
+
+
+    // compare the PRNGs, on single outputs & on filling a buffer in bulk
+    printf("\n -*- 10: Random generators (N=%i) -*-\n", N);
+
+    Random::Xoshiro256 xrnd = Random::Xoshiro256(0);
+    Random::PCG32 pcgrnd = Random::PCG32(0);
+    uint64_t tmp64 = 0;
+
+    for (int pass = 0; pass < 4; ++pass) {
+        st = getTime();
+        for (int i = 0; i < N; ++i) {
+            tmp64 += pass == 0 ? rnd.getU64() : pass == 1 ? xrnd.getU64() : pass == 2 ? pcgrnd.getU64() : (uint64_t)(1e9 * xrnd.getD());
+        }
+        st = getTime() - st;
+        printf("%-24s %.2lfMsmp/sec\n", pass == 0 ? "XorShift::getU64:" : pass == 1 ? "Xoshiro256::getU64:" : pass == 2 ? "PCG32::getU64:" : "Xoshiro256::getD:", 1e-6 * N / st);
+    }
+
+    // bulk fills, into a buffer small enough to stay in cache
+    int buf_N = 4096;
+    uint64_t* buf64 = new uint64_t[buf_N];
+    double* bufD = new double[buf_N];
+
+    Random::Xoshiro256x4 xrnd4 = Random::Xoshiro256x4(xrnd);
+    for (int pass = 0; pass < 3; ++pass) {
+        st = getTime();
+        for (int i = 0; i < N; i += buf_N) {
+            if (pass == 0) {
+                for (int j = 0; j < buf_N; ++j) buf64[j] = xrnd.getU64();
+            } else if (pass == 1) {
+                xrnd4.fill(buf64, buf_N);
+            } else {
+                xrnd4.fillD(bufD, buf_N);
+            }
+            tmp64 += buf64[i % buf_N] + (uint64_t)bufD[i % buf_N];
+        }
+        st = getTime() - st;
+        printf("%-24s %.2lfMsmp/sec\n", pass == 0 ? "Xoshiro256 (loop):" : pass == 1 ? "Xoshiro256x4::fill:" : "Xoshiro256x4::fillD:", 1e-6 * N / st);
+    }
+
+    delete[] buf64;
+    delete[] bufD;
+
+    tmp += tmp64;
+
+
+    // the cost of the biome map on the heightmap, when it is cached per region vs when every column
+    //   samples the climate
+    printf("\n -*- 11: WG::BiomeMap (%ix%i chunks) -*-\n", 2 * wg_N + 1, 2 * wg_N + 1);
+
+    for (int pass = 0; pass < 2; ++pass) {
+        WG::DefaultWG* wg = new WG::DefaultWG(0);
+        if (pass == 1) wg->biomes.capacity = 0;
+
+        for (int X = -wg_N; X <= wg_N; ++X) {
+            for (int Z = -wg_N; Z <= wg_N; ++Z) {
+                tmp += wg->heightCache.getHeight(CHUNK_SIZE_X * X, CHUNK_SIZE_Z * Z);
+            }
+        }
+
+        int wg_chunks = (2 * wg_N + 1) * (2 * wg_N + 1);
+        printf("%s: heights %.3lfms/chunk, %.1lf climate samples/chunk\n", pass == 0 ? "Regions " : "Uncached", 1e3 * wg->heightCache.stats.t_compute / wg_chunks, (double)wg->biomes.stats.n_samples / wg_chunks);
+
+        delete wg;
+    }
+
+
+    // save some chunks with each of the region storages, and then time loading them back, both from the disk
+    //   (cold page cache) and from memory (warm page cache)
+    printf("\n -*- 12: Storage load latency (%ix%i chunks) -*-\n", 2 * wg_N, 2 * wg_N);
+
+    char st_path[] = "/tmp/blok-test-XXXXXX";
+    if (mkdtemp(st_path) == NULL) {
+        blok_error("Failed to create temporary directory for storage tests");
+    } else {
+        for (int pass = 0; pass < 2; ++pass) {
+            String dir = String(st_path) + (pass == 0 ? "/mmap" : "/zlib");
+            Storage::RegionStorage* storage = pass == 0 ? new Storage::MMapStorage(dir) : new Storage::RegionStorage(dir);
+
+            WG::DefaultWG* wg = new WG::DefaultWG(0);
+            for (int X = -wg_N; X < wg_N; ++X) {
+                for (int Z = -wg_N; Z < wg_N; ++Z) {
+                    Chunk* chunk = wg->getChunk({X, Z});
+                    storage->saveChunk(chunk);
+                    delete chunk;
+                }
+            }
+            delete wg;
+
+            printf("%s: %.1lf%% of raw size\n", pass == 0 ? "MMapStorage" : "RegionStorage", 100.0 * storage->stats.n_compressed / storage->stats.n_raw);
+
+            for (int warm = 0; warm < 2; ++warm) {
+                if (!warm) storage->dropCache();
+
+                st = getTime();
+                for (int X = -wg_N; X < wg_N; ++X) {
+                    for (int Z = -wg_N; Z < wg_N; ++Z) {
+                        delete storage->loadChunk({X, Z});
+                    }
+                }
+                st = getTime() - st;
+
+                printf("  %s: %.1lfus/chunk\n", warm ? "warm" : "cold", 1e6 * st / (4 * wg_N * wg_N));
+            }
+
+            delete storage;
+
+            // clean up the region files (the chunks only cover the 4 regions around the origin)
+            for (int RX = -1; RX <= 0; ++RX) {
+                for (int RZ = -1; RZ <= 0; ++RZ) {
+                    char fname[64];
+                    snprintf(fname, sizeof(fname), "/r.%i.%i.blr", RX, RZ);
+                    remove((dir + fname).c_str());
+                }
+            }
+            rmdir(dir.c_str());
+        }
+
+        // compare how long saving stalls the caller, when writing directly vs writing behind (saving each
+        //   chunk a few times, like autosaves of chunks being edited)
+        printf("\n -*- 13: Storage::WriteBehind (%ix%i chunks, 3 saves each) -*-\n", 2 * wg_N, 2 * wg_N);
+
+        List<Chunk*> wb_chunks;
+        WG::FlatWG* wg = new WG::FlatWG(0);
+        for (int X = -wg_N; X < wg_N; ++X) {
+            for (int Z = -wg_N; Z < wg_N; ++Z) {
+                wb_chunks.push_back(wg->getChunk({X, Z}));
+            }
+        }
+        delete wg;
+
+        for (int pass = 0; pass < 2; ++pass) {
+            String dir = String(st_path) + (pass == 0 ? "/direct" : "/behind");
+            Storage::Storage* storage = new Storage::RegionStorage(dir);
+            if (pass == 1) storage = new Storage::WriteBehind(storage, Storage::WriteBehind::FSYNC_BATCH);
+
+            st = getTime();
+            for (int i = 0; i < 3; ++i) {
+                for (Chunk* chunk : wb_chunks) {
+                    chunk->set(0, CHUNK_SIZE_Y - 1, 0, BlockData(ID::DIRT, i));
+                    storage->saveChunk(chunk);
+                }
+            }
+            st = getTime() - st;
+
+            printf("%s: %.1lfus/save\n", pass == 0 ? "Direct" : "Behind", 1e6 * st / (3 * wb_chunks.size()));
+
+            if (pass == 1) {
+                Storage::WriteBehind* writer = (Storage::WriteBehind*)storage;
+                int depth = writer->getQueueDepth();
+                writer->sync();
+                printf("  queue depth %i after saving (max %i), %i written (%i coalesced) in %i batches, %.1lf chunks/sec\n", depth, writer->stats.max_depth, (int)writer->stats.n_writes, (int)writer->stats.n_coalesced, (int)writer->stats.n_batches, writer->getWriteRate());
+            }
+
+            delete storage;
+
+            for (int RX = -1; RX <= 0; ++RX) {
+                for (int RZ = -1; RZ <= 0; ++RZ) {
+                    char fname[64];
+                    snprintf(fname, sizeof(fname), "/r.%i.%i.blr", RX, RZ);
+                    remove((dir + fname).c_str());
+                }
+            }
+            rmdir(dir.c_str());
+        }
+
+        for (Chunk* chunk : wb_chunks) {
+            delete chunk;
+        }
+
+        rmdir(st_path);
+    }
+
+
+    // how well cold chunks compress in memory, and how long it takes to get them back
+    printf("\n -*- 14: Chunk compression (%ix%i chunks) -*-\n", 2 * wg_N, 2 * wg_N);
+
+    List<Chunk*> cc_chunks;
+    WG::DefaultWG* cc_wg = new WG::DefaultWG(0);
+    for (int X = -wg_N; X < wg_N; ++X) {
+        for (int Z = -wg_N; Z < wg_N; ++Z) {
+            cc_chunks.push_back(cc_wg->getChunk({X, Z}));
+        }
+    }
+    delete cc_wg;
+
+    size_t cc_raw = sizeof(BlockData) * CHUNK_NUM_BLOCKS * cc_chunks.size(), cc_packed = 0;
+    st = getTime();
+    for (Chunk* chunk : cc_chunks) {
+        cc_packed += chunk->compress();
+    }
+    double cc_t = getTime() - st;
+
+    st = getTime();
+    for (Chunk* chunk : cc_chunks) {
+        chunk->decompress();
+        tmp += chunk->blocks[0].id;
+    }
+    st = getTime() - st;
+
+    printf("Compressed: %.1lf%% of raw size (%.1lfkb/chunk)\n", 100.0 * cc_packed / cc_raw, cc_packed / (1024.0 * cc_chunks.size()));
+    printf("compress():   %.1lfus/chunk\n", 1e6 * cc_t / cc_chunks.size());
+    printf("decompress(): %.1lfus/chunk\n", 1e6 * st / cc_chunks.size());
+
+    for (Chunk* chunk : cc_chunks) {
+        delete chunk;
+    }
+
+
+    // how small each codec makes generated chunks, and how fast (in MB of raw blocks per second)
+    printf("\n -*- 15: Storage::Codec (%ix%i chunks) -*-\n", 2 * wg_N, 2 * wg_N);
+
+    List<Storage::Codec*> codecs = { new Storage::RawCodec(), new Storage::ColumnRLECodec(), new Storage::PaletteCodec(), new Storage::PaletteZlibCodec() };
+    size_t cd_bound = 0;
+    for (Storage::Codec* codec : codecs) {
+        cd_bound = std::max(cd_bound, codec->getBound());
+    }
+
+    for (int pass = 0; pass < 2; ++pass) {
+        List<Chunk*> cd_chunks;
+        WG::WG* wg = pass == 0 ? (WG::WG*)new WG::DefaultWG(0) : (WG::WG*)new WG::FlatWG(0);
+        for (int X = -wg_N; X < wg_N; ++X) {
+            for (int Z = -wg_N; Z < wg_N; ++Z) {
+                cd_chunks.push_back(wg->getChunk({X, Z}));
+            }
+        }
+        delete wg;
+
+        printf("%s:\n", pass == 0 ? "DefaultWG" : "FlatWG");
+
+        // every chunk is encoded into its own part of one buffer, so decoding reads them all back
+        List<uint8_t> cd_buf(cd_bound * cd_chunks.size());
+        List<size_t> cd_sizes(cd_chunks.size());
+        Chunk* cd_out = new Chunk();
+        double cd_mb = sizeof(BlockData) * CHUNK_NUM_BLOCKS * cd_chunks.size() / (1024.0 * 1024.0);
+
+        for (Storage::Codec* codec : codecs) {
+            size_t cd_total = 0;
+            st = getTime();
+            for (size_t i = 0; i < cd_chunks.size(); ++i) {
+                cd_sizes[i] = codec->encode(cd_chunks[i]->blocks, &cd_buf[cd_bound * i]);
+                cd_total += cd_sizes[i];
+            }
+            double cd_te = getTime() - st;
+
+            bool ok = true;
+            st = getTime();
+            for (size_t i = 0; i < cd_chunks.size(); ++i) {
+                ok = codec->decode(&cd_buf[cd_bound * i], cd_sizes[i], cd_out->blocks) && ok;
+                tmp += cd_out->blocks[i % CHUNK_NUM_BLOCKS].id;
+            }
+            double cd_td = getTime() - st;
+
+            // make sure they all came back the same
+            for (size_t i = 0; i < cd_chunks.size() && ok; ++i) {
+                codec->decode(&cd_buf[cd_bound * i], cd_sizes[i], cd_out->blocks);
+                ok = memcmp(cd_out->blocks, cd_chunks[i]->blocks, sizeof(BlockData) * CHUNK_NUM_BLOCKS) == 0;
+            }
+
+            printf("  %-14s %6.2lf%% of raw size, encode %8.1lfMB/s, decode %8.1lfMB/s%s\n", (codec->name + ":").c_str(), 100.0 * cd_total / (sizeof(BlockData) * CHUNK_NUM_BLOCKS * cd_chunks.size()), cd_mb / cd_te, cd_mb / cd_td, ok ? "" : " (MISMATCH)");
+        }
+
+        delete cd_out;
+        for (Chunk* chunk : cd_chunks) {
+            delete chunk;
+        }
+    }
+
+    for (Storage::Codec* codec : codecs) {
+        delete codec;
+    }
+
+
+    // the size of the meshes of generated terrain, for each mesher (only the inner chunks are meshed, so
+    //   they all have neighbours)
+    printf("\n -*- 16: Render::ChunkMesh (%ix%i chunks) -*-\n", 2 * wg_N - 2, 2 * wg_N - 2);
+
+    {
+        Map<ChunkID, Chunk*> cm_chunks;
+        WG::DefaultWG cm_wg(0);
+        for (int X = -wg_N; X < wg_N; ++X) {
+            for (int Z = -wg_N; Z < wg_N; ++Z) {
+                cm_chunks[{X, Z}] = cm_wg.getChunk({X, Z});
+            }
+        }
+
+        for (auto& entry : cm_chunks) {
+            auto find = [&](ChunkID id) { auto it = cm_chunks.find(id); return it == cm_chunks.end() ? NULL : it->second; };
+            entry.second->rcache.cL = find(entry.first + ChunkID(-1, 0));
+            entry.second->rcache.cR = find(entry.first + ChunkID(1, 0));
+            entry.second->rcache.cB = find(entry.first + ChunkID(0, -1));
+            entry.second->rcache.cT = find(entry.first + ChunkID(0, 1));
+        }
+
+        List<Render::ChunkMeshVertex> cm_vertices[Render::ChunkMesh::NUM_SECTIONS];
+        const char* cm_names[] = { "faces:", "greedy:", "binary:" };
+
+        // first on the terrain as it is generated, then with the bottom of it turned into dense caves (about
+        //   half solid, in blobs a few blocks across), where there are far more faces, spread all over
+        for (int cm_caves = 0; cm_caves < 2; ++cm_caves) {
+            if (cm_caves) {
+                printf("  (dense caves)\n");
+                Random::Simplex cm_noise(1);
+                for (auto& entry : cm_chunks) {
+                    vec3i wpos = entry.second->getWorldPos();
+                    for (int x = 0; x < CHUNK_SIZE_X; ++x) {
+                        for (int z = 0; z < CHUNK_SIZE_Z; ++z) {
+                            for (int y = 1; y < 128; ++y) {
+                                double smp = cm_noise.noise3d(0.15 * (wpos.x + x), 0.15 * y, 0.15 * (wpos.z + z));
+                                entry.second->set(x, y, z, BlockData(smp < 0.5 ? ID::STONE : ID::AIR));
+                            }
+                        }
+                    }
+                }
+            }
+
+            for (Render::ChunkMesh::Mesher mesher : { Render::ChunkMesh::MESHER_FACES, Render::ChunkMesh::MESHER_GREEDY, Render::ChunkMesh::MESHER_BINARY }) {
+                size_t cm_tris = 0, cm_n = 0;
+                st = getTime();
+                for (auto& entry : cm_chunks) {
+                    if (entry.first.X == -wg_N || entry.first.X == wg_N - 1 || entry.first.Z == -wg_N || entry.first.Z == wg_N - 1) continue;
+                    Render::ChunkMesh::build(entry.second, mesher, cm_vertices);
+                    for (auto& sec : cm_vertices) cm_tris += sec.size() / 2;
+                    cm_n++;
+                }
+                st = getTime() - st;
+
+                // rebuilding just what an edit on the surface (in the middle of the chunk) touches
+                double st_edit = getTime();
+                for (auto& entry : cm_chunks) {
+                    if (entry.first.X == -wg_N || entry.first.X == wg_N - 1 || entry.first.Z == -wg_N || entry.first.Z == wg_N - 1) continue;
+                    int y = CHUNK_SIZE_Y - 1;
+                    while (y > 0 && entry.second->get(CHUNK_SIZE_X / 2, y, CHUNK_SIZE_Z / 2).id == ID::AIR) y--;
+                    Render::ChunkMesh::build(entry.second, mesher, cm_vertices, Render::ChunkMesh::getSections(y - 1, y + 1));
+                }
+                st_edit = getTime() - st_edit;
+
+                printf("  %-8s %8.1lf tris/chunk, %6.3lfms/chunk, %6.3lfms/edit\n", cm_names[mesher], (double)cm_tris / cm_n, 1e3 * st / cm_n, 1e3 * st_edit / cm_n);
+            }
+        }
+
+        // the same, on the workers, which only costs the main thread the snapshots (and the results
+        //   should be exactly what building directly gives)
+        Render::ChunkMeshWorkers* cm_workers = new Render::ChunkMeshWorkers();
+        int cm_n = 0;
+        st = getTime();
+        for (auto& entry : cm_chunks) {
+            if (entry.first.X == -wg_N || entry.first.X == wg_N - 1 || entry.first.Z == -wg_N || entry.first.Z == wg_N - 1) continue;
+            cm_workers->submit(entry.second, Render::ChunkMesh::MESHER_GREEDY);
+            cm_n++;
+        }
+
+        List<Render::ChunkMeshWorkers::Job*> cm_jobs;
+        while ((int)cm_jobs.size() < cm_n) {
+            Render::ChunkMeshWorkers::Job* job = cm_workers->poll();
+            if (job != NULL) cm_jobs.push_back(job);
+            else std::this_thread::yield();
+        }
+        st = getTime() - st;
+
+        bool cm_same = true;
+        for (Render::ChunkMeshWorkers::Job* job : cm_jobs) {
+            Render::ChunkMesh::build(job->chunk, job->mesher, cm_vertices);
+            for (int sec = 0; sec < Render::ChunkMesh::NUM_SECTIONS; ++sec) {
+                cm_same = cm_same && cm_vertices[sec].size() == job->vertices[sec].size();
+                for (size_t i = 0; i < cm_vertices[sec].size() && cm_same; ++i) {
+                    const Render::ChunkMeshVertex &a = cm_vertices[sec][i], &b = job->vertices[sec][i];
+                    cm_same = a.packed == b.packed && a.blockID == b.blockID;
+                }
+            }
+            delete job;
+        }
+
+        printf("  workers: %6.3lfms/chunk on the main thread, %6.3lfms/chunk building, %6.3lfms for all (%s)\n", 1e3 * cm_workers->stats.t_snapshot / cm_n, 1e3 * cm_workers->stats.t_build / cm_n, 1e3 * st, cm_same ? "same" : "MISMATCH");
+        delete cm_workers;
+
+        for (auto& entry : cm_chunks) {
+            delete entry.second;
+        }
+    }
+
     delete server;
     
 
@@ -419,16 +961,52 @@ int main(int argc, char** argv) {
     // our option
     int opt;
 
-    // try and initialize blok
-    if (!initAll()) return -1;
+    // whether to run the tests
+    bool doTests = false;
+
+    // the format new worlds are saved in (existing ones are always opened in their own), or WORLD_NONE
+    //   if it wasn't given
+    Storage::WorldFormat worldFormat = Storage::WORLD_NONE;
+
+    // the directory the world is stored in (or NULL to not save it)
+    const char* worldDir = NULL;
+
+    // the radius to pregenerate (or -1 to run the game normally)
+    int pregenRadius = -1;
+
+    // the center to pregenerate around, and whether it should be a disc
+    ChunkID pregenCenter = ChunkID(0, 0);
+    bool pregenDisc = false;
+
+    // the archive to export the world to, or import it from (or NULL to run the game normally)
+    const char* exportFile = NULL;
+    const char* importFile = NULL;
+
+    // how often (in minutes) to back up the world (or <= 0 to not), and the backup to restore (or NULL)
+    double backupInterval = 0.0;
+    const char* restoreName = NULL;
 
     // parse arguments 
-    while ((opt = getopt(argc, argv, "Tvh")) != -1) {
+    while ((opt = getopt(argc, argv, "TvhDdw:S:P:C:E:I:b:R:")) != -1) {
         if (opt == 'h') {
             // print help
-            printf("Usage: %s [-h]\n\n", argv[0]);
+            printf("Usage: %s [-h] [-w DIR [-d | -S FORMAT]] [-P R [-C X,Z] [-D]] [-E FILE | -I FILE] [-b MIN | -R NAME]\n\n", argv[0]);
             printf("  -h           Prints this help/usage message\n");
             printf("  -T           Run some sanity checks\n");
+            printf("  -w DIR       Load & save the world in directory DIR\n");
+            printf("  -d           Only save the blocks that differ from the generated world (which must\n");
+            printf("                 always be loaded the same way). Existing worlds keep their own format\n");
+            printf("  -S FORMAT    Save new worlds in FORMAT: 'region' (default), 'mmap' (uncompressed, and mapped\n");
+            printf("                 into memory), 'delta' (same as '-d'), or 'dir' (a file per chunk)\n");
+            printf("  -P R         Pregenerate all chunks within R chunks (without a window), saving them to the\n");
+            printf("                 world directory ('world' if not given), and exit\n");
+            printf("  -C X,Z       Center chunk to pregenerate around (default: 0,0)\n");
+            printf("  -D           Pregenerate a disc instead of a square\n");
+            printf("  -E FILE      Export the world directory ('world' if not given) to the archive FILE ('-'\n");
+            printf("                 for stdout), and exit\n");
+            printf("  -I FILE      Import the archive FILE ('-' for stdin) into the (empty) world directory, and exit\n");
+            printf("  -b MIN       Back up the world every MIN minutes (into 'DIR/backups'), keeping the last 24\n");
+            printf("  -R NAME      Restore the backup NAME of the world into the (empty) directory 'DIR.NAME', and exit\n");
             printf("\nBlok v%i.%i.%i %s\n", BUILD_MAJOR, BUILD_MINOR, BUILD_PATCH, BUILD_DEV ? "(dev)" : "");
             printf("Cade Brown <brown.cade@gmail.com>\n");
             return 0;
@@ -437,8 +1015,47 @@ int main(int argc, char** argv) {
             setLogLevel((LogLevel)((int)getLogLevel()-1));
         } else if (opt == 'T') {
             // run a test
-            runTests();
-            return 0;
+            doTests = true;
+        } else if (opt == 'w') {
+            worldDir = optarg;
+        } else if (opt == 'd') {
+            worldFormat = Storage::WORLD_DELTA;
+        } else if (opt == 'S') {
+            if (strcmp(optarg, "region") == 0) {
+                worldFormat = Storage::WORLD_REGION;
+            } else if (strcmp(optarg, "mmap") == 0) {
+                worldFormat = Storage::WORLD_MMAP;
+            } else if (strcmp(optarg, "delta") == 0) {
+                worldFormat = Storage::WORLD_DELTA;
+            } else if (strcmp(optarg, "dir") == 0) {
+                worldFormat = Storage::WORLD_DIR;
+            } else {
+                fprintf(stderr, "Invalid format '%s' for '-S', expected 'region', 'mmap', 'delta', or 'dir'\n", optarg);
+                return -2;
+            }
+        } else if (opt == 'P') {
+            if (sscanf(optarg, "%i", &pregenRadius) != 1 || pregenRadius < 0) {
+                fprintf(stderr, "Invalid radius '%s' for '-P', expected a non-negative integer\n", optarg);
+                return -2;
+            }
+        } else if (opt == 'C') {
+            if (sscanf(optarg, "%i,%i", &pregenCenter.X, &pregenCenter.Z) != 2) {
+                fprintf(stderr, "Invalid center '%s' for '-C', expected 'X,Z'\n", optarg);
+                return -2;
+            }
+        } else if (opt == 'D') {
+            pregenDisc = true;
+        } else if (opt == 'E') {
+            exportFile = optarg;
+        } else if (opt == 'I') {
+            importFile = optarg;
+        } else if (opt == 'b') {
+            if (sscanf(optarg, "%lf", &backupInterval) != 1 || backupInterval <= 0) {
+                fprintf(stderr, "Invalid interval '%s' for '-b', expected a positive number of minutes\n", optarg);
+                return -2;
+            }
+        } else if (opt == 'R') {
+            restoreName = optarg;
         } else if (opt == '?') {
             fprintf(stderr, "Unknown option '-%c', run with '-h' to see help message\n", optopt);
             return -1;
@@ -457,8 +1074,69 @@ int main(int argc, char** argv) {
         optind++;
     }
 
+    if (exportFile != NULL || importFile != NULL) {
+        // moving worlds around is headless too
+        String dir = worldDir != NULL ? worldDir : "world";
+        bool ok = exportFile != NULL ? Storage::exportWorld(dir, exportFile) : Storage::importWorld(importFile, dir);
+        return ok ? 0 : -4;
+    }
+
+    if (restoreName != NULL) {
+        // restore into a new directory, rather than over the world, so nothing is lost if it was the wrong one
+        // The copy is in the same format as the world, unless told otherwise
+        String dir = worldDir != NULL ? worldDir : "world";
+        String dest = dir + "." + restoreName;
+        WG::WG* gen = new WG::DefaultWG(0);
+        Storage::WorldFormat srcFormat = Storage::getWorldFormat(dir);
+        if (worldFormat == Storage::WORLD_NONE) worldFormat = srcFormat != Storage::WORLD_NONE ? srcFormat : Storage::WORLD_REGION;
+        Storage::Snapshots* snapshots = new Storage::Snapshots(Storage::openWorld(dir, gen, srcFormat != Storage::WORLD_NONE ? srcFormat : worldFormat), dir + "/backups");
+        Storage::Storage* storage = Storage::openWorld(dest, gen, worldFormat);
+        bool ok = snapshots->restore(restoreName, storage);
+        List<String> names = snapshots->list();
+        if (!ok && std::find(names.begin(), names.end(), String(restoreName)) == names.end()) {
+            // it was probably mistyped
+            fprintf(stderr, "Backups of '%s':%s\n", dir.c_str(), names.size() == 0 ? " (none)" : "");
+            for (const String& name : names) fprintf(stderr, "  %s\n", name.c_str());
+        }
+        delete storage;
+        delete snapshots;
+        delete gen;
+        return ok ? 0 : -4;
+    }
+
+    if (worldFormat == Storage::WORLD_NONE) worldFormat = Storage::WORLD_REGION;
+
+    if (pregenRadius >= 0) {
+        // pregenerating is headless, so don't initialize any graphics/audio
+        WG::WG* gen = new WG::DefaultWG(0);
+        LocalServer* server = new LocalServer(Storage::openWorld(worldDir != NULL ? worldDir : "world", gen, worldFormat), gen);
+        server->pregenerate(pregenCenter, pregenRadius, pregenDisc);
+        delete server;
+        return 0;
+    }
+
+    // try and initialize blok
+    if (!initAll()) return -1;
+
+    if (doTests) {
+        runTests();
+        return 0;
+    }
+
     // create a local server
-    LocalServer* server = new LocalServer();
+    // save in the background, so the game never waits on the disk, and journal edits, so they
+    //   aren't lost if it crashes before their chunks are saved
+    WG::WG* worldGen = new WG::DefaultWG(0);
+    Storage::Storage* storage = NULL;
+    Storage::Journal* journal = NULL;
+    if (worldDir != NULL) {
+        storage = Storage::openWorld(worldDir, worldGen, worldFormat);
+        if (backupInterval > 0) storage = new Storage::Snapshots(storage, String(worldDir) + "/backups");
+        storage = new Storage::WriteBehind(storage);
+        journal = new Storage::Journal(String(worldDir) + "/journal.blj");
+    }
+    LocalServer* server = new LocalServer(storage, worldGen, journal);
+    server->snapshotInterval = 60.0 * backupInterval;
 
     Client* client = new Client(server, 1280, 800);
 
@@ -481,10 +1159,10 @@ int main(int argc, char** argv) {
     /*Audio::Engine* eng = new Audio::Engine();*/
     //eng->curBufPlays.push_back(Audio::BufferPlay(buf));
 
+    // position it first, so it is stored in the right chunk
     Entity* ent = new ItemEntity((UUID)"ABC");
-    server->addEntity(ent);
-
     ent->setPos(vec3(16, 100, 16));
+    server->addEntity(ent);
 
     while (client->frame()) {
         
@@ -526,6 +1204,17 @@ int main(int argc, char** argv) {
             client->setFullscreen(!client->getFullscreen());
         }
 
+        // switch between meshers, rebuilding every chunk being rendered
+        if (client->input.keys[GLFW_KEY_G] && !client->input.lastKeys[GLFW_KEY_G]) {
+            Render::Renderer* renderer = client->gfx.renderer;
+            renderer->chunkMesher = (Render::ChunkMesh::Mesher)((renderer->chunkMesher + 1) % 3);
+            for (auto& entry : renderer->chunkMeshes) {
+                renderer->chunkMeshRequests[entry.first] |= Render::ChunkMesh::ALL_SECTIONS;
+            }
+            const char* names[] = { "per-face", "greedy", "binary" };
+            blok_info("Using the %s chunk mesher", names[renderer->chunkMesher]);
+        }
+
 
         //client->renderer->pos += vec3(0.1, 0.0, 0.0);
         client->yaw += dt * 0.3f * client->input.mouseDelta.x;
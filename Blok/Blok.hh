@@ -27,6 +27,7 @@
 #include <string>
 #include <map>
 #include <set>
+#include <algorithm>
 
 /* GLM (matrix & vector library) */
 #include <Blok/glm/glm.hpp>
@@ -217,6 +218,11 @@ namespace Blok {
 
     };
 
+    // floor division (for b > 0), so negative coordinates map to the correct chunk, region, tile, etc
+    static inline int floorDiv(int a, int b) {
+        return (a >= 0 ? a : a - b + 1) / b;
+    }
+
     // ChunkID - type defining the Chunk's macro coordinates world space
     // The actual world XZ is given by CHUNK_SIZE_X * XZ.X and CHUNK_SIZE_Z * XZ.Z,
     //   basically this is its position on the grid of chunks
@@ -228,7 +234,7 @@ namespace Blok {
         //   of a block
         // AKA: get the ChunkID that a given block is located in
         static ChunkID fromPos(vec3i pos) {
-            return ChunkID(glm::floor(pos.x/16.0), floor(pos.z/16.0));
+            return ChunkID(floorDiv(pos.x, CHUNK_SIZE_X), floorDiv(pos.z, CHUNK_SIZE_Z));
         }
 
         // create a chunk ID from X and Z coordinates
@@ -311,9 +317,22 @@ namespace Blok {
         // }
         BlockData* blocks;
 
-        // the map of entities in a given chunk
+        // the map of entities in a given chunk, which are owned (and freed) by the chunk, and are saved
+        //   along with its blocks (see 'encodeEntities()')
         Map<UUID, Entity*> entities;
 
+        // true if any block (or entity) has changed since the chunk was last saved (or loaded), which is
+        //   set by every method that modifies blocks, and reset by whatever saves it
+        bool modified;
+
+        // the blocks, run length encoded, while the chunk is compressed (see 'compress()'). While it is,
+        //   'blocks' is NULL, so the chunk must be decompressed before any blocks are read or written
+        List<uint8_t> packed;
+
+        // the last time (see 'getTime()') the server handed out the chunk, which is used to decide
+        //   when it has gone cold and can be compressed
+        double lastUsed;
+
         // rcache - the render cache, meant to be mainly managed by the rendering engine
         //   to improve efficiency
         // all 'cur' values mean current as of this frame, and
@@ -343,6 +362,9 @@ namespace Blok {
             // allocate the array of data, which should set them all to empty air
             this->blocks = new BlockData[CHUNK_NUM_BLOCKS];
 
+            this->modified = false;
+            this->lastUsed = 0.0;
+
             // initialize the render cache
             // 0=not calculated yet
             rcache.curHash = rcache.lastHash = 0;
@@ -362,6 +384,9 @@ namespace Blok {
             // free our allocated array
             if (this->blocks != NULL) delete[] this->blocks;
 
+            // and the entities we own
+            clearEntities();
+
             // remove our neighbor's references
             if (rcache.cR != NULL) rcache.cR->rcache.cL = NULL;
             if (rcache.cT != NULL) rcache.cT->rcache.cB = NULL;
@@ -439,22 +464,81 @@ namespace Blok {
         void set(int x=0, int y=0, int z=0, BlockData val=BlockData()) {
             const int idx = getIndex(x, y, z);
             blocks[idx] = val;
+            markDirty(vec3i(x, y, z), vec3i(x, y, z));
+        }
+
+        // set the block data at a given local coordinate to a given value
+        void set(vec3i xyz, BlockData val=BlockData()) {
+            set(xyz.x, xyz.y, xyz.z, val);
+        }
+
+        // set a run of blocks in a single column, from y0 (inclusive) to y1 (exclusive), to a given value
+        // This is much faster than calling 'set()' on each, since the column is contiguous in 'blocks',
+        //   and the dirty box is only expanded once
+        // NOTE: the run is clipped to the chunk, so y1 may be past the top
+        void setRun(int x, int z, int y0, int y1, BlockData val) {
+            if (y0 < 0) y0 = 0;
+            if (y1 > CHUNK_SIZE_Y) y1 = CHUNK_SIZE_Y;
+            if (y0 >= y1) return;
+
+            BlockData* col = &blocks[getIndex(x, 0, z)];
+            std::fill(col + y0, col + y1, val);
+            markDirty(vec3i(x, y0, z), vec3i(x, y1 - 1, z));
+        }
+
+        // set every column of the chunk to a copy of 'column', which should have CHUNK_SIZE_Y entries,
+        //   from the bottom up (i.e. a column template)
+        // The first column is copied, then the filled region is doubled each time, so it ends up as a
+        //   handful of large memcpy's rather than 65k individual sets
+        void fillColumns(const BlockData* column) {
+            const int colSize = CHUNK_SIZE_Y, total = CHUNK_NUM_BLOCKS;
+            memcpy(blocks, column, sizeof(BlockData) * colSize);
+            for (int done = colSize; done < total; done *= 2) {
+                memcpy(blocks + done, blocks, sizeof(BlockData) * (done < total - done ? done : total - done));
+            }
+            markDirty(vec3i(0, 0, 0), vec3i(CHUNK_SIZE_X - 1, CHUNK_SIZE_Y - 1, CHUNK_SIZE_Z - 1));
+        }
+
+        // expand the dirty box to include the box from 'a' to 'b' (both inclusive), and mark the
+        //   chunk as modified
+        void markDirty(vec3i a, vec3i b) {
+            modified = true;
             if (rcache.isDirty) {
-                // expand dirtyMin/Max
-                rcache.dirtyMin = glm::min(rcache.dirtyMin, vec3i(x, y, z));
-                rcache.dirtyMax = glm::max(rcache.dirtyMax, vec3i(x, y, z));
+                rcache.dirtyMin = glm::min(rcache.dirtyMin, a);
+                rcache.dirtyMax = glm::max(rcache.dirtyMax, b);
             } else {
                 // start the dirty box
                 rcache.isDirty = true;
-                rcache.dirtyMin = rcache.dirtyMax = vec3i(x, y, z);
+                rcache.dirtyMin = a;
+                rcache.dirtyMax = b;
             }
         }
 
-        // set the block data at a given local coordinate to a given value
-        void set(vec3i xyz, BlockData val=BlockData()) {
-            set(xyz.x, xyz.y, xyz.z, val);
+
+        // return whether the blocks are compressed (i.e. only in 'packed')
+        bool isCompressed() const {
+            return blocks == NULL;
         }
 
+        // compress the blocks into 'packed' and free 'blocks', returning the number of bytes they take now
+        // Blocks are stored with `Storage::ColumnRLECodec`, since columns are mostly long runs of stone & air
+        // See the file `storage/Codec.cc` for the implementation of these methods
+        size_t compress();
+
+        // decompress 'packed' back into 'blocks', and free it (this does nothing if it is not compressed)
+        void decompress();
+
+        // append the binary form of 'entities' to 'out' (nothing is appended if there are none to save)
+        // See the file `Entity.cc` for the format, and the implementation of these methods
+        void encodeEntities(List<uint8_t>& out);
+
+        // decode entities written by 'encodeEntities()' from 'size' bytes, adding them to 'entities',
+        //   and returning whether the data was valid
+        bool decodeEntities(const uint8_t* data, size_t size);
+
+        // delete all the entities in the chunk
+        void clearEntities();
+
 
         // return the world coordinates of the (0, 0, 0) local position 
         vec3i getWorldPos(vec3i xyz=vec3i(0, 0, 0)) {
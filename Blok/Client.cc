@@ -201,11 +201,13 @@ bool Client::frame() {
         }
     }
 
-    // now, render entities
+    // now, render entities (which are added & removed as their chunks load)
+    server->L_chunks.lock();
     for (auto& kvp : server->loadedEntities) {
         Render::RenderData rd = kvp.second->getRender();
         gfx.renderer->renderData(rd);
     }
+    server->L_chunks.unlock();
 
     // capture information about what we are looking at
     RayHit hit;
@@ -232,17 +234,9 @@ bool Client::frame() {
         if (input.mouseButtons[GLFW_MOUSE_BUTTON_RIGHT] && !input.lastMouseButtons[GLFW_MOUSE_BUTTON_RIGHT]) {
             // place block
 
-            // TODO: call a server->setBlock() method
-
             // compute one block off
             vec3i targetPos = vec3i(glm::floor(vec3(hit.blockPos) + hit.normal));
-            if (targetPos.y >= 0 && targetPos.y < CHUNK_SIZE_Y) {
-                // set it
-                Chunk* cur = server->getChunk(ChunkID::fromPos(targetPos), false);
-                vec3i localPos = targetPos - cur->getWorldPos();
-
-                cur->set(localPos.x, localPos.y, localPos.z, {ID::STONE});
-
+            if (server->setBlock(targetPos, {ID::STONE})) {
                 // play sound
                 Audio::Buffer* bk = Audio::Buffer::loadConst("assets/audio/sfx/PlaceBlock.ogg");
                 aEngine->play(bk);
@@ -252,14 +246,11 @@ bool Client::frame() {
 
         } else if (input.mouseButtons[GLFW_MOUSE_BUTTON_LEFT] && !input.lastMouseButtons[GLFW_MOUSE_BUTTON_LEFT]) {
             // delete block
-            Chunk* cur = server->getChunk(ChunkID::fromPos(hit.blockPos), false);
-            vec3i localPos = hit.blockPos - cur->getWorldPos();
-
-            cur->set(localPos.x, localPos.y, localPos.z, {ID::AIR});
-
-            // play sound
-            Audio::Buffer* bk = Audio::Buffer::loadConst("assets/audio/sfx/BreakBlock.ogg");
-            aEngine->play(bk);
+            if (server->setBlock(hit.blockPos, {ID::AIR})) {
+                // play sound
+                Audio::Buffer* bk = Audio::Buffer::loadConst("assets/audio/sfx/BreakBlock.ogg");
+                aEngine->play(bk);
+            }
 
         }
 
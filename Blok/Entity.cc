@@ -0,0 +1,130 @@
+/* Entity.cc - binary serialization of entities, which are saved per chunk alongside the blocks
+ *
+ * The entities of a chunk are stored as:
+ *   - a version byte (ENTITY_VERSION)
+ *   - the number of entities (uint32_t)
+ *   - for each entity:
+ *     - its type (uint8_t, see `Entity::Type`)
+ *     - the length of its UUID (uint8_t)
+ *     - the size of its data (uint16_t)
+ *     - the UUID, then the data written by `Entity::write()`
+ *
+ * Every record carries its size, so entities of unknown types (i.e. from a newer version) are
+ *   skipped rather than making the whole chunk unreadable
+ *
+ */
+
+#include <Blok/Entity.hh>
+
+namespace Blok {
+
+// the current version of the entity format
+static const uint8_t ENTITY_VERSION = 1;
+
+// the size of the header of each entity record
+static const int RECORD_HEADER = 4;
+
+// create an entity of a given type
+Entity* Entity::create(Type type, const UUID& uuid) {
+    switch (type) {
+        case TYPE_ITEM: return new ItemEntity(uuid);
+        default: return NULL;
+    }
+}
+
+// append the saved entities
+void Chunk::encodeEntities(List<uint8_t>& out) {
+    // size everything up first, so 'out' is only grown once
+    size_t size = 1 + 4;
+    uint32_t count = 0;
+    for (auto& entry : entities) {
+        Entity* ent = entry.second;
+        if (ent->getType() == Entity::TYPE_NONE) continue;
+        if (ent->uuid.size() > 0xFF || ent->getDataSize() > 0xFFFF) {
+            blok_warn("Entity '%s' is too large to save", ent->uuid.c_str());
+            continue;
+        }
+        size += RECORD_HEADER + ent->uuid.size() + ent->getDataSize();
+        count++;
+    }
+
+    if (count == 0) return;
+
+    size_t pos = out.size();
+    out.resize(pos + size);
+    uint8_t* ptr = &out[pos];
+
+    *ptr++ = ENTITY_VERSION;
+    memcpy(ptr, &count, 4);
+    ptr += 4;
+
+    for (auto& entry : entities) {
+        Entity* ent = entry.second;
+        if (ent->getType() == Entity::TYPE_NONE || ent->uuid.size() > 0xFF || ent->getDataSize() > 0xFFFF) continue;
+
+        uint16_t dataSize = ent->getDataSize();
+        ptr[0] = ent->getType();
+        ptr[1] = ent->uuid.size();
+        memcpy(ptr + 2, &dataSize, 2);
+        ptr += RECORD_HEADER;
+
+        memcpy(ptr, ent->uuid.data(), ent->uuid.size());
+        ptr += ent->uuid.size();
+
+        ent->write(ptr);
+        ptr += dataSize;
+    }
+}
+
+// decode saved entities
+bool Chunk::decodeEntities(const uint8_t* data, size_t size) {
+    if (size < 1 + 4 || data[0] != ENTITY_VERSION) return false;
+
+    uint32_t count;
+    memcpy(&count, data + 1, 4);
+
+    const uint8_t* ptr = data + 1 + 4, * end = data + size;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (end - ptr < RECORD_HEADER) return false;
+
+        Entity::Type type = (Entity::Type)ptr[0];
+        int uuidSize = ptr[1];
+        uint16_t dataSize;
+        memcpy(&dataSize, ptr + 2, 2);
+        ptr += RECORD_HEADER;
+
+        if (end - ptr < uuidSize + dataSize) return false;
+
+        UUID uuid((const char*)ptr, uuidSize);
+        ptr += uuidSize;
+
+        Entity* ent = Entity::create(type, uuid);
+        if (ent == NULL) {
+            blok_warn("Skipping entity '%s' of unknown type %i in chunk %i,%i", uuid.c_str(), (int)type, XZ.X, XZ.Z);
+        } else if (!ent->read(ptr, dataSize)) {
+            delete ent;
+            return false;
+        } else {
+            // they were written in order, so each one goes at the end of the map (replacing any
+            //   entity already there with the same UUID)
+            auto it = entities.emplace_hint(entities.end(), std::move(uuid), ent);
+            if (it->second != ent) {
+                delete it->second;
+                it->second = ent;
+            }
+        }
+        ptr += dataSize;
+    }
+
+    return ptr == end;
+}
+
+// delete all entities
+void Chunk::clearEntities() {
+    for (auto& entry : entities) {
+        delete entry.second;
+    }
+    entities.clear();
+}
+
+}
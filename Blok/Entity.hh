@@ -18,6 +18,18 @@ namespace Blok {
 
         public:
 
+        // Type - the kind of an entity, which is saved along with it, so that the right subclass can
+        //   be created when it is loaded. These values are stored in files, so they must never change
+        enum Type : uint8_t {
+
+            // an entity that is never saved
+            TYPE_NONE = 0,
+
+            // an 'ItemEntity'
+            TYPE_ITEM = 1,
+
+        };
+
         // the unique identifier
         UUID uuid;
 
@@ -41,6 +53,32 @@ namespace Blok {
             this->uuid = uuid;
         }
 
+        virtual ~Entity() {}
+
+        // Return the kind of entity this is, which is TYPE_NONE for entities that should not be saved
+        virtual Type getType() {
+            return TYPE_NONE;
+        }
+
+        // Return the number of bytes that 'write()' writes
+        virtual int getDataSize() {
+            return 0;
+        }
+
+        // Write the state of the entity (everything except its type & UUID) into 'data', which has
+        //   room for 'getDataSize()' bytes
+        virtual void write(uint8_t* /*data*/) {}
+
+        // Read the state of the entity from 'size' bytes written by 'write()', returning whether
+        //   they were valid
+        virtual bool read(const uint8_t* /*data*/, int size) {
+            return size == 0;
+        }
+
+        // Create an entity of a given type, which should then be filled in with 'read()', or return
+        //   NULL if the type is unknown
+        static Entity* create(Type type, const UUID& uuid);
+
     };
 
 
@@ -67,8 +105,32 @@ namespace Blok {
             return Render::RenderData(Render::Mesh::loadConst("assets/obj/Suzanne.obj"), glm::translate(pos));
         }
 
+        // Return the kind of entity this is
+        Type getType() {
+            return TYPE_ITEM;
+        }
+
+        // the position, followed by the item ID
+        int getDataSize() {
+            return sizeof(float) * 3 + 1;
+        }
+
+        void write(uint8_t* data) {
+            memcpy(data, &pos[0], sizeof(float) * 3);
+            data[sizeof(float) * 3] = id;
+        }
+
+        bool read(const uint8_t* data, int size) {
+            if (size != getDataSize()) return false;
+            memcpy(&pos[0], data, sizeof(float) * 3);
+            id = (ID)data[sizeof(float) * 3];
+            return true;
+        }
+
         ItemEntity(UUID uuid) {
             this->uuid = uuid;
+            this->pos = vec3(0, 0, 0);
+            this->id = AIR;
         }
 
     };
@@ -69,18 +69,277 @@ class XorShift {
 };
 
 
-// Perlin - a Perlin noise (https://en.wikipedia.org/wiki/Perlin_noise) generator
-// Generates a value in `outputSpace` (default 0 to 1)
-class Perlin {
+// splitmix64 - used to expand a single seed into the state of the larger generators, as
+//   recommended by the xoshiro authors (it never turns a seed into an all-zero state)
+static inline uint64_t splitmix64(uint64_t& x) {
+    uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// rotate 'x' left by 'k' bits
+static inline uint64_t rotl64(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+// Xoshiro256 - xoshiro256** (http://prng.di.unimi.it/) PRNG, which has 256 bits of state, full
+//   64 bit outputs, and a period of 2^256-1
+// Use 'jump()' to split it into independent streams (i.e. one per thread), since each jump skips
+//   2^128 outputs ahead, and 'long_jump()' (2^192) to split those further
+class Xoshiro256 {
     public:
 
-    // the size of the table for a Perlin noise generation algorithm
-    static const int tableSize = 256;
+    // state variables
+    uint64_t s[4];
 
-    // a list of values to be used in the internal algorithm
-    List<uint32_t> perms;
+    // generate a U64 variable, equally likely for all values
+    uint64_t getU64() {
+        uint64_t res = rotl64(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+
+        s[2] ^= t;
+        s[3] = rotl64(s[3], 45);
+
+        return res;
+    }
+
+    // generate a U32 variable, equally likely for all values
+    uint32_t getU32() {
+        // the upper bits are the best quality
+        return getU64() >> 32;
+    }
+
+    // generate a floating point variable in [0, 1), with the full 24 bits of mantissa
+    float getF() {
+        return (getU64() >> 40) * (1.0f / (1ULL << 24));
+    }
+
+    // generate a floating point variable in [0, 1), with the full 53 bits of mantissa
+    double getD() {
+        return (getU64() >> 11) * (1.0 / (1ULL << 53));
+    }
+
+    // advance the generator by 2^128 outputs
+    void jump() {
+        static const uint64_t JUMP[4] = { 0x180EC6D33CFD0ABAULL, 0xD5A61266F0C9392CULL, 0xA9582618E03FC9AAULL, 0x39ABDC4529B1661CULL };
+        applyJump(JUMP);
+    }
+
+    // advance the generator by 2^192 outputs
+    void long_jump() {
+        static const uint64_t JUMP[4] = { 0x76E15D3EFEFDCBBFULL, 0xC5004E441C522FB3ULL, 0x77710069854EE241ULL, 0x39109BB02ACBE635ULL };
+        applyJump(JUMP);
+    }
+
+    // construct a generator, given an initial seed
+    Xoshiro256(uint64_t seed=0) {
+        for (int i = 0; i < 4; ++i) {
+            s[i] = splitmix64(seed);
+        }
+    }
+
+    private:
+
+    // apply a jump polynomial, by adding the states that correspond to its set bits
+    void applyJump(const uint64_t poly[4]) {
+        uint64_t t[4] = { 0, 0, 0, 0 };
+        for (int i = 0; i < 4; ++i) {
+            for (int b = 0; b < 64; ++b) {
+                if (poly[i] & (1ULL << b)) {
+                    t[0] ^= s[0];
+                    t[1] ^= s[1];
+                    t[2] ^= s[2];
+                    t[3] ^= s[3];
+                }
+                getU64();
+            }
+        }
+
+        s[0] = t[0];
+        s[1] = t[1];
+        s[2] = t[2];
+        s[3] = t[3];
+    }
+
+};
+
+// Xoshiro256x4 - 4 interleaved xoshiro256** generators (each one a 'jump()' after the last), for filling
+//   buffers with random numbers in bulk
+// The state is stored lane-wise (i.e. 's[i][lane]'), so every step is the same operation on 4
+//   independent values, which the compiler turns into SIMD instructions
+// Outputs are interleaved, i.e. out[4*i+lane], so lane 0 is the same stream as the generator it was
+//   constructed from
+class Xoshiro256x4 {
+    public:
+
+    // number of lanes
+    static const int LANES = 4;
+
+    // state variables, per lane
+    uint64_t s[4][LANES];
+
+    // fill 'out' with 'n' U64 variables
+    void fill(uint64_t* out, int n) {
+        int i = 0;
+        for (; i + LANES <= n; i += LANES) {
+            step(out + i);
+        }
+
+        // handle the tail, throwing away the extra outputs
+        if (i < n) {
+            uint64_t tmp[LANES];
+            step(tmp);
+            for (int j = 0; j < LANES && i < n; ++i, ++j) {
+                out[i] = tmp[j];
+            }
+        }
+    }
+
+    // fill 'out' with 'n' floating point variables in [0, 1), with the full 53 bits of mantissa
+    void fillD(double* out, int n) {
+        uint64_t tmp[LANES];
+        for (int i = 0; i < n; i += LANES) {
+            step(tmp);
+            for (int j = 0; j < LANES && i + j < n; ++j) {
+                out[i + j] = (tmp[j] >> 11) * (1.0 / (1ULL << 53));
+            }
+        }
+    }
+
+    // fill 'out' with 'n' floating point variables in [0, 1), with the full 24 bits of mantissa
+    void fillF(float* out, int n) {
+        uint64_t tmp[LANES];
+        for (int i = 0; i < n; i += LANES) {
+            step(tmp);
+            for (int j = 0; j < LANES && i + j < n; ++j) {
+                out[i + j] = (tmp[j] >> 40) * (1.0f / (1ULL << 24));
+            }
+        }
+    }
+
+    // construct from a single generator, which is left unchanged
+    Xoshiro256x4(const Xoshiro256& gen=Xoshiro256()) {
+        Xoshiro256 cur = gen;
+        for (int lane = 0; lane < LANES; ++lane) {
+            for (int i = 0; i < 4; ++i) {
+                s[i][lane] = cur.s[i];
+            }
+            cur.jump();
+        }
+    }
+
+    private:
+
+    // generate one output per lane into 'out'
+    void step(uint64_t out[LANES]) {
+        for (int l = 0; l < LANES; ++l) {
+            out[l] = rotl64(s[1][l] * 5, 7) * 9;
+        }
+        for (int l = 0; l < LANES; ++l) {
+            uint64_t t = s[1][l] << 17;
 
-    // the scale of the perlin noise, i.e. the input coordinates
+            s[2][l] ^= s[0][l];
+            s[3][l] ^= s[1][l];
+            s[1][l] ^= s[2][l];
+            s[0][l] ^= s[3][l];
+
+            s[2][l] ^= t;
+            s[3][l] = rotl64(s[3][l], 45);
+        }
+    }
+
+};
+
+// PCG32 - permuted congruential generator (https://www.pcg-random.org/), PCG-XSH-RR variant
+// It has only 64 bits of state (plus a stream selector), and can be advanced by any amount in
+//   O(log n) steps, which 'jump()' (2^32 outputs) and 'long_jump()' (2^48 outputs) use
+class PCG32 {
+    public:
+
+    // the LCG multiplier
+    static const uint64_t MULT = 6364136223846793005ULL;
+
+    // state variable, and the increment (which selects the stream, and must be odd)
+    uint64_t state, inc;
+
+    // generate a U32 variable, equally likely for all values
+    uint32_t getU32() {
+        uint64_t old = state;
+        state = old * MULT + inc;
+
+        // output function: xorshift high, then random rotation
+        uint32_t xorshifted = ((old >> 18) ^ old) >> 27;
+        uint32_t rot = old >> 59;
+        return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+    }
+
+    // generate a U64 variable, equally likely for all values
+    uint64_t getU64() {
+        uint64_t res = (uint64_t)getU32() << 32;
+        return res | getU32();
+    }
+
+    // generate a floating point variable in [0, 1), with the full 24 bits of mantissa
+    float getF() {
+        return (getU32() >> 8) * (1.0f / (1ULL << 24));
+    }
+
+    // generate a floating point variable in [0, 1), with the full 53 bits of mantissa
+    double getD() {
+        return (getU64() >> 11) * (1.0 / (1ULL << 53));
+    }
+
+    // advance the generator by 'delta' outputs (which may 'wrap around' the period of 2^64)
+    void advance(uint64_t delta) {
+        // compute the combined multiplier & increment of 'delta' LCG steps by squaring
+        uint64_t cur_mult = MULT, cur_plus = inc;
+        uint64_t acc_mult = 1, acc_plus = 0;
+        while (delta > 0) {
+            if (delta & 1) {
+                acc_mult *= cur_mult;
+                acc_plus = acc_plus * cur_mult + cur_plus;
+            }
+            cur_plus = (cur_mult + 1) * cur_plus;
+            cur_mult *= cur_mult;
+            delta >>= 1;
+        }
+        state = acc_mult * state + acc_plus;
+    }
+
+    // advance the generator by 2^32 outputs
+    void jump() {
+        advance(1ULL << 32);
+    }
+
+    // advance the generator by 2^48 outputs
+    void long_jump() {
+        advance(1ULL << 48);
+    }
+
+    // construct a generator, given an initial seed, and which stream to use
+    PCG32(uint64_t seed=0, uint64_t stream=0) {
+        state = 0;
+        inc = (stream << 1) | 1;
+        getU32();
+        state += seed;
+        getU32();
+    }
+
+};
+
+// Noise - abstract base class for gradient noise generators (i.e. Perlin, Simplex)
+// Every generator shares the same `scale`/`clipSpace`/`outputSpace` mapping, so that
+//   layers of different types can be mixed freely inside a `PerlinMux`
+class Noise {
+    public:
+
+    // the scale of the noise, i.e. the input coordinates
     //   are multiplied by this
     vec3 scale;
 
@@ -92,26 +351,22 @@ class Perlin {
     // default is (0, 1) which does nothing
     vec2 outputSpace;
 
-    // construct a perlin generator from a given seed
-    Perlin(uint32_t seed=0, vec3 scale={1.0, 1.0, 1.0}, vec2 clipSpace={0.0, 1.0}, vec2 outputSpace={0.0, 1.0}) {
-        // set member vars
+    // construct the shared parameters of a noise generator
+    Noise(vec3 scale={1.0, 1.0, 1.0}, vec2 clipSpace={0.0, 1.0}, vec2 outputSpace={0.0, 1.0}) {
         this->scale = scale;
         this->clipSpace = clipSpace;
         this->outputSpace = outputSpace;
+    }
 
-        // generate random integers from an XorShift generator
-        XorShift permgen(seed);
-
-        perms = {};
-        
-        // populate it with random numbers in [0, 256)
-        for (int i = 0; i < tableSize; ++i) {
-            perms.push_back(permgen.getU32() % tableSize);
-        }
+    virtual ~Noise() {
+        // do nothing by default, so that C++ is okay with virtual destructors on abstract classes
     }
 
+    // return a newly allocated copy of the generator (the caller should delete it)
+    virtual Noise* clone() const = 0;
+
     // apply clipping & scaling to a value
-    double toOutput(double res) {
+    double toOutput(double res) const {
 
         //res = glm::clamp(res, clipMin, clipMax);
         if (res < clipSpace[0]) res = clipSpace[0];
@@ -124,6 +379,48 @@ class Perlin {
         return res;
     }
 
+    // generate noise from 1 spatial coordinate
+    virtual double noise1d(double x) = 0;
+
+    // generate noise from 2 spatial coordinates
+    virtual double noise2d(double x, double y=0.0) = 0;
+
+    // generate noise from 3 spatial coordinates
+    virtual double noise3d(double x, double y=0.0, double z=0.0) = 0;
+
+};
+
+
+// Perlin - a Perlin noise (https://en.wikipedia.org/wiki/Perlin_noise) generator
+// Generates a value in `outputSpace` (default 0 to 1)
+class Perlin : public Noise {
+    public:
+
+    // the size of the table for a Perlin noise generation algorithm
+    static const int tableSize = 256;
+
+    // a list of values to be used in the internal algorithm
+    List<uint32_t> perms;
+
+    // construct a perlin generator from a given seed
+    Perlin(uint32_t seed=0, vec3 scale={1.0, 1.0, 1.0}, vec2 clipSpace={0.0, 1.0}, vec2 outputSpace={0.0, 1.0}) : Noise(scale, clipSpace, outputSpace) {
+
+        // generate random integers from an XorShift generator
+        XorShift permgen(seed);
+
+        perms = {};
+        
+        // populate it with random numbers in [0, 256)
+        for (int i = 0; i < tableSize; ++i) {
+            perms.push_back(permgen.getU32() % tableSize);
+        }
+    }
+
+    // return a copy of this generator
+    Noise* clone() const {
+        return new Perlin(*this);
+    }
+
     // internal utility method to fade a double
     double fade(double t) { 
         return t * t * t * (t * (t * 6 - 15) + 10);
@@ -266,23 +563,268 @@ class Perlin {
 };
 
 
-// PerlinMux : a mix/muxer of multiple layers of perlin noise,
-//   additively
+// Simplex - a simplex-family gradient noise (https://en.wikipedia.org/wiki/Simplex_noise) generator
+// Rather than blending the 2^N corners of a hypercube like `Perlin`, the input space is skewed
+//   onto a grid of simplices, so only N+1 corners are summed (i.e. 4 instead of 8 for 3D)
+// Generates a value in `outputSpace` (default 0 to 1), so it is a drop-in replacement for
+//   `Perlin` on any layer
+class Simplex : public Noise {
+    public:
+
+    // the size of the permutation table
+    static const int tableSize = 256;
+
+    // a shuffled permutation of [0, 256), stored twice so that the indices never need wrapping
+    uint8_t perms[2 * tableSize];
+
+    // construct a simplex generator from a given seed
+    Simplex(uint32_t seed=0, vec3 scale={1.0, 1.0, 1.0}, vec2 clipSpace={0.0, 1.0}, vec2 outputSpace={0.0, 1.0}) : Noise(scale, clipSpace, outputSpace) {
+
+        // generate the shuffle from an XorShift generator
+        XorShift permgen(seed);
+
+        for (int i = 0; i < tableSize; ++i) {
+            perms[i] = i;
+        }
+
+        // Fisher-Yates shuffle, so every entry appears exactly once
+        for (int i = tableSize - 1; i > 0; --i) {
+            int j = permgen.getU32() % (i + 1);
+            uint8_t tmp = perms[i];
+            perms[i] = perms[j];
+            perms[j] = tmp;
+        }
+
+        // duplicate it
+        for (int i = 0; i < tableSize; ++i) {
+            perms[tableSize + i] = perms[i];
+        }
+    }
+
+    // return a copy of this generator
+    Noise* clone() const {
+        return new Simplex(*this);
+    }
+
+    // floor a value to an integer, which is much faster than calling `floor()` and casting
+    static int fastFloor(double x) {
+        int xi = (int)x;
+        return xi - (x < xi);
+    }
+
+    // gradient for 1D noise, from the lower 4 bits of the hash
+    static double grad(int hash, double x) {
+        int h = hash & 15;
+        // gradient is 1.0, 2.0, ..., 8.0, randomly negated
+        double g = 1.0 + (h & 7);
+        return (h & 8) ? -g * x : g * x;
+    }
+
+    // gradient for 2D noise, picks one of 8 directions
+    static double grad(int hash, double x, double y) {
+        int h = hash & 7;
+        double u = h < 4 ? x : y, v = h < 4 ? y : x;
+        return ((h & 1) ? -u : u) + ((h & 2) ? -2.0 * v : 2.0 * v);
+    }
+
+    // gradient for 3D noise, picks one of the 12 cube edge directions (the same set `Perlin` uses)
+    // these are looked up from a table rather than computed with branches, padded to 16 entries
+    //   so the lower 4 bits of the hash can index it directly
+    static double grad(int hash, double x, double y, double z) {
+        static const signed char grads[16][3] = {
+            { 1, 1, 0}, {-1, 1, 0}, { 1,-1, 0}, {-1,-1, 0},
+            { 1, 0, 1}, {-1, 0, 1}, { 1, 0,-1}, {-1, 0,-1},
+            { 0, 1, 1}, { 0,-1, 1}, { 0, 1,-1}, { 0,-1,-1},
+            { 1, 1, 0}, {-1, 1, 0}, { 0,-1, 1}, { 0,-1,-1},
+        };
+        const signed char* g = grads[hash & 15];
+        return g[0] * x + g[1] * y + g[2] * z;
+    }
+
+    // generate noise from 1 spatial coordinate
+    double noise1d(double x) {
+
+        // first, scale the coordinate
+        x *= scale.x;
+
+        // the 2 corners of the 1D 'simplex' (i.e. a line segment)
+        int i0 = fastFloor(x);
+        double x0 = x - i0, x1 = x0 - 1.0;
+        i0 &= 0xFF;
+
+        // sum the radially falling-off contributions of both corners
+        double t0 = 1.0 - x0 * x0, t1 = 1.0 - x1 * x1;
+        t0 *= t0;
+        t1 *= t1;
+        double res = t0 * t0 * grad(perms[i0], x0) + t1 * t1 * grad(perms[i0 + 1], x1);
+
+        // scale to [-1, 1], then to [0, 1]
+        res = (0.395 * res + 1.0) / 2.0;
+
+        return toOutput(res);
+    }
+
+    // generate noise from 2 spatial coordinates
+    double noise2d(double x, double y=0.0) {
+        // skewing & unskewing factors for 2D
+        static const double F2 = 0.366025403784438646763723170752936183; // (sqrt(3) - 1) / 2
+        static const double G2 = 0.211324865405187117745425609748803448; // (3 - sqrt(3)) / 6
+
+        // first, scale the coordinates
+        x *= scale.x;
+        y *= scale.y;
+
+        // skew the input space to find which simplex cell we are in
+        double s = (x + y) * F2;
+        int i = fastFloor(x + s), j = fastFloor(y + s);
+
+        // unskew back, to get the distances from the cell origin
+        double t = (i + j) * G2;
+        double x0 = x - (i - t), y0 = y - (j - t);
+
+        // determine which of the 2 triangles we are in
+        int i1 = x0 > y0 ? 1 : 0, j1 = 1 - i1;
+
+        // offsets for the middle & last corners
+        double x1 = x0 - i1 + G2, y1 = y0 - j1 + G2;
+        double x2 = x0 - 1.0 + 2.0 * G2, y2 = y0 - 1.0 + 2.0 * G2;
+
+        int ii = i & 0xFF, jj = j & 0xFF;
+
+        // sum the contributions from the 3 corners
+        double res = 0.0, tc;
+
+        tc = glm::max(0.5 - x0 * x0 - y0 * y0, 0.0);
+        tc *= tc;
+        res += tc * tc * grad(perms[ii + perms[jj]], x0, y0);
+
+        tc = glm::max(0.5 - x1 * x1 - y1 * y1, 0.0);
+        tc *= tc;
+        res += tc * tc * grad(perms[ii + i1 + perms[jj + j1]], x1, y1);
+
+        tc = glm::max(0.5 - x2 * x2 - y2 * y2, 0.0);
+        tc *= tc;
+        res += tc * tc * grad(perms[ii + 1 + perms[jj + 1]], x2, y2);
+
+        // scale to [-1, 1], then to [0, 1]
+        res = (40.0 * res + 1.0) / 2.0;
+
+        return toOutput(res);
+    }
+
+    // generate noise from 3 spatial coordinates
+    double noise3d(double x, double y=0.0, double z=0.0) {
+        // skewing & unskewing factors for 3D
+        static const double F3 = 1.0 / 3.0;
+        static const double G3 = 1.0 / 6.0;
+
+        // first, scale the coordinates
+        x *= scale.x;
+        y *= scale.y;
+        z *= scale.z;
+
+        // skew the input space to find which simplex cell we are in
+        double s = (x + y + z) * F3;
+        int i = fastFloor(x + s), j = fastFloor(y + s), k = fastFloor(z + s);
+
+        // unskew back, to get the distances from the cell origin
+        double t = (i + j + k) * G3;
+        double x0 = x - (i - t), y0 = y - (j - t), z0 = z - (k - t);
+
+        // determine which of the 6 tetrahedra we are in, given by the offsets of
+        //   the second (i1, j1, k1) and third (i2, j2, k2) corners
+        // the second corner steps along the largest axis, and the third along all but the smallest,
+        //   which we compute branch-free, since the comparisons are essentially random
+        int xy = x0 >= y0, yz = y0 >= z0, xz = x0 >= z0;
+        int i1 = xy & xz, j1 = yz & (xy ^ 1), k1 = (xz | yz) ^ 1;
+        int i2 = xy | xz, j2 = (xy ^ 1) | yz, k2 = (xz & yz) ^ 1;
+
+        // offsets for the remaining 3 corners
+        double x1 = x0 - i1 + G3, y1 = y0 - j1 + G3, z1 = z0 - k1 + G3;
+        double x2 = x0 - i2 + 2.0 * G3, y2 = y0 - j2 + 2.0 * G3, z2 = z0 - k2 + 2.0 * G3;
+        double x3 = x0 - 1.0 + 3.0 * G3, y3 = y0 - 1.0 + 3.0 * G3, z3 = z0 - 1.0 + 3.0 * G3;
+
+        int ii = i & 0xFF, jj = j & 0xFF, kk = k & 0xFF;
+
+        // sum the contributions from the 4 corners
+        double res = 0.0, tc;
+
+        // (clamping the falloff to 0 instead of branching on it keeps the loop free of
+        //   mispredictions, since about half of the corners are out of range)
+        tc = glm::max(0.6 - x0 * x0 - y0 * y0 - z0 * z0, 0.0);
+        tc *= tc;
+        res += tc * tc * grad(perms[ii + perms[jj + perms[kk]]], x0, y0, z0);
+
+        tc = glm::max(0.6 - x1 * x1 - y1 * y1 - z1 * z1, 0.0);
+        tc *= tc;
+        res += tc * tc * grad(perms[ii + i1 + perms[jj + j1 + perms[kk + k1]]], x1, y1, z1);
+
+        tc = glm::max(0.6 - x2 * x2 - y2 * y2 - z2 * z2, 0.0);
+        tc *= tc;
+        res += tc * tc * grad(perms[ii + i2 + perms[jj + j2 + perms[kk + k2]]], x2, y2, z2);
+
+        tc = glm::max(0.6 - x3 * x3 - y3 * y3 - z3 * z3, 0.0);
+        tc *= tc;
+        res += tc * tc * grad(perms[ii + 1 + perms[jj + 1 + perms[kk + 1]]], x3, y3, z3);
+
+        // scale to [-1, 1], then to [0, 1]
+        res = (32.0 * res + 1.0) / 2.0;
+
+        return toOutput(res);
+    }
+
+};
+
+
+// PerlinMux : a mix/muxer of multiple layers of gradient noise,
+//   additively. Layers can be any `Noise` generator (i.e. `Perlin` or `Simplex`),
+//   and each layer may be a different type
 class PerlinMux {
     public:
 
     // a list of layers to be added to the generator
-    List<Perlin> layers;
+    // NOTE: these are owned by the muxer, and are freed when it is
+    List<Noise*> layers;
 
     // construct an (empty) perlin layered generator
     PerlinMux() {
         layers = {};
     }
 
+    // construct a copy of another muxer, copying all of its layers
+    PerlinMux(const PerlinMux& other) {
+        for (const Noise* lyr : other.layers) {
+            layers.push_back(lyr->clone());
+        }
+    }
+
+    // replace all layers with copies of another muxer's
+    PerlinMux& operator=(const PerlinMux& other) {
+        if (this != &other) {
+            clear();
+            for (const Noise* lyr : other.layers) {
+                layers.push_back(lyr->clone());
+            }
+        }
+        return *this;
+    }
+
+    // free all the layers
+    ~PerlinMux() {
+        clear();
+    }
+
+    // remove (and free) all layers
+    void clear() {
+        for (Noise* lyr : layers) {
+            delete lyr;
+        }
+        layers.clear();
+    }
 
-    // add a layer to the internal layers array
-    void addLayer(const Perlin& lyr) {
-        layers.push_back(lyr);
+    // add a copy of a layer to the internal layers array
+    void addLayer(const Noise& lyr) {
+        layers.push_back(lyr.clone());
     }
 
     // generate 1D noise
@@ -291,8 +833,8 @@ class PerlinMux {
         double val = 0.0;
 
         // loop through all layers
-        for (Perlin& lyr : layers) {
-            val += lyr.noise1d(x);
+        for (Noise* lyr : layers) {
+            val += lyr->noise1d(x);
         }
 
         return val;
@@ -304,8 +846,8 @@ class PerlinMux {
         double val = 0.0;
 
         // loop through all layers
-        for (Perlin& lyr : layers) {
-            val += lyr.noise2d(x, y);
+        for (Noise* lyr : layers) {
+            val += lyr->noise2d(x, y);
         }
 
         return val;
@@ -317,8 +859,8 @@ class PerlinMux {
         double val = 0.0;
 
         // loop through all layers
-        for (Perlin& lyr : layers) {
-            val += lyr.noise3d(x, y, z);
+        for (Noise* lyr : layers) {
+            val += lyr->noise3d(x, y, z);
         }
 
         return val;
@@ -156,6 +156,24 @@ void Renderer::renderFrame() {
         }
     }
 
+    // and forget about any meshes requested or being built for them (any jobs that finish are thrown away)
+    auto cmpit = chunkMeshPending.begin();
+    while (cmpit != chunkMeshPending.end()) {
+        if (std::find(torender.begin(), torender.end(), cmpit->first) == torender.end()) {
+            chunkMeshPending.erase(cmpit++);
+        } else {
+            cmpit++;
+        }
+    }
+    auto cmrit = chunkMeshRequests.begin();
+    while (cmrit != chunkMeshRequests.end()) {
+        if (std::find(torender.begin(), torender.end(), cmrit->first) == torender.end()) {
+            chunkMeshRequests.erase(cmrit++);
+        } else {
+            cmrit++;
+        }
+    }
+
 
     // first, make sure all hashes are up to date
     // NOTE: we seperate this into a loop before the main recalculation, so that
@@ -201,34 +219,46 @@ void Renderer::renderFrame() {
         oid = cid + ChunkID(0, -1);
         cB = queue.chunks.find(oid) == queue.chunks.end() ? NULL : queue.chunks[oid];
 
-        // check if the hash has stayed the same, and if so, try and skip the chunk update
-        // TODO: maybe add a specific range of values that have been modified. For example,
-        //   if an interior block is modified that won't affect neighboring chunks, don't update
-        //   or recalculate the neighbors
-        // This makes the queuing code more complex, but it shouldn't be too bad
-        if (chunk->rcache.curHash != 0 && chunk->rcache.curHash == chunk->rcache.lastHash) {
-
-            if (chunkMeshes.find(chunk) != chunkMeshes.end()) {
-            
-                // if the chunk's hash didn't change, make sure none of the neighbors have changed
-                if (cL == chunk->rcache.cL && cT == chunk->rcache.cT && cR == chunk->rcache.cR && cB == chunk->rcache.cB) {
-                    
-                    // make sure the neighors either don't exist (and so couldn't have changed), or the hash is the same
-                    // if nothing has changed, we can skip this iteration of the for loop, because we don't need to recalculate the VBO
-                    // TODO: just check if the dirtyMin/Max includes near the edge of the chunk
-                    //   if just interior blocks of the neighbors have changed, we don't need to recalculate our geometry
-                    if (!cL || cL->rcache.curHash == cL->rcache.lastHash)
-                    if (!cT || cT->rcache.curHash == cT->rcache.lastHash)
-                    if (!cR || cR->rcache.curHash == cR->rcache.lastHash)
-                    if (!cB || cB->rcache.curHash == cB->rcache.lastHash) {
-                        // skip ahead
-                        continue;
-                    }
-                }
+        // work out which sections of the mesh need to be rebuilt
+        // if there is no mesh yet, or the neighbors are different chunks, then all of them do. Otherwise,
+        //   only those around the dirty box of the chunk (if its hash has changed), and those around the
+        //   dirty box of any neighbor that has changed right next to this chunk, since the faces on the edge
+        //   (and their ambient occlusion) only look 1 block into the neighbors
+        // NOTE: each box is grown by a block up & down, as faces look into the blocks above & below them too
+        uint32_t sectionMask = 0;
+        bool sameLinks = cL == chunk->rcache.cL && cT == chunk->rcache.cT && cR == chunk->rcache.cR && cB == chunk->rcache.cB;
+        if (chunk->rcache.curHash == 0 || !sameLinks) {
+            sectionMask = ChunkMesh::ALL_SECTIONS;
+        } else if (chunkMeshes.find(chunk) == chunkMeshes.end()) {
+            // unless it is already being built from scratch
+            auto pit = chunkMeshPending.find(chunk);
+            bool isBuilding = pit != chunkMeshPending.end() && chunk->rcache.curHash == chunk->rcache.lastHash;
+            for (int i = 0; i < ChunkMesh::NUM_SECTIONS && isBuilding; ++i) isBuilding = pit->second[i] != 0;
+            if (!isBuilding) sectionMask = ChunkMesh::ALL_SECTIONS;
+        } else {
+            if (chunk->rcache.curHash != chunk->rcache.lastHash) {
+                sectionMask |= ChunkMesh::getSections(chunk->rcache.dirtyMin.y - 1, chunk->rcache.dirtyMax.y + 1);
+            }
+
+            // the neighbors, and whether their dirty box touches this chunk
+            Chunk* nbs[4] = { cL, cT, cR, cB };
+            for (int i = 0; i < 4; ++i) {
+                Chunk* nb = nbs[i];
+                if (nb == NULL || nb->rcache.curHash == nb->rcache.lastHash) continue;
+
+                bool touches;
+                if (i == 0) touches = nb->rcache.dirtyMax.x >= CHUNK_SIZE_X - 1;
+                else if (i == 1) touches = nb->rcache.dirtyMin.z <= 0;
+                else if (i == 2) touches = nb->rcache.dirtyMin.x <= 0;
+                else touches = nb->rcache.dirtyMax.z >= CHUNK_SIZE_Z - 1;
 
+                if (touches) sectionMask |= ChunkMesh::getSections(nb->rcache.dirtyMin.y - 1, nb->rcache.dirtyMax.y + 1);
             }
         }
 
+        // if nothing has changed, we can skip this iteration of the for loop, because we don't need to recalculate the VBO
+        if (sectionMask == 0) continue;
+
         // else, update the 2D linked list structure, and recalculate the chunk geometry
 
         // update neighbor references
@@ -239,8 +269,8 @@ void Renderer::renderFrame() {
 
         // the hash should already be up-to-date at this point
 
-        // otherwise, we need to recalculate it
-        chunkMeshRequests.insert(chunk);
+        // otherwise, we need to recalculate it (along with anything that was requested already)
+        chunkMeshRequests[chunk] |= sectionMask;
         
     }
 
@@ -249,32 +279,97 @@ void Renderer::renderFrame() {
     // take one off 
     int ct = 0;
     // spend up to 5ms per frame updating them
-    while (chunkMeshRequests.size() > 0 && getTime() - stime_cu < 0.005) {
-        auto cmit = chunkMeshRequests.begin();
+
+    // first, upload the meshes the workers have finished
+    ChunkMeshWorkers::Job* job;
+    while (getTime() - stime_cu < 0.005 && (job = chunkMeshWorkers->poll()) != NULL) {
+        Chunk* chunk = job->chunk;
+
+        // only the latest job for each section of a chunk that is still being rendered is used (the chunk
+        //   may even have been freed since it was submitted)
+        auto pit = chunkMeshPending.find(chunk);
+        auto qit = queue.chunks.find(job->id);
+        if (pit == chunkMeshPending.end()) {
+            delete job;
+            continue;
+        }
+        if (qit == queue.chunks.end() || qit->second != chunk) {
+            // nothing is being built for those sections any more, so the chunk is meshed from scratch if
+            //   it comes back
+            bool isPending = false;
+            for (uint64_t& seq : pit->second) {
+                if (seq == job->seq) seq = 0;
+                isPending = isPending || seq != 0;
+            }
+            if (!isPending) chunkMeshPending.erase(pit);
+
+            delete job;
+            continue;
+        }
 
         ChunkMesh* newcm = NULL;
-        if (chunkMeshes.find(*cmit) != chunkMeshes.end()) {
+        bool isNew = false;
+        if (chunkMeshes.find(chunk) != chunkMeshes.end()) {
             // first try and reuse
-            newcm = chunkMeshes[*cmit];
+            newcm = chunkMeshes[chunk];
 
+        } else if (job->sections != ChunkMesh::ALL_SECTIONS) {
+            // a new mesh needs every section (there will be a job for all of them coming)
+            newcm = NULL;
         } else if (chunkMeshPool.size() == 0) {
             //blok_trace("new ChunkMesh");
             newcm = new ChunkMesh();
-            chunkMeshes[*cmit] = newcm;
+            chunkMeshes[chunk] = newcm;
+            isNew = true;
         } else {
             newcm = chunkMeshPool.back();
             chunkMeshPool.pop_back();
-            chunkMeshes[*cmit] = newcm;
+            chunkMeshes[chunk] = newcm;
+            isNew = true;
         }
 
-        // calculate the update
-        newcm->update(*cmit);
-        stats.n_chunk_recalcs++;
+        // take the geometry of each section, and send it to OpenGL
+        // a new mesh takes all of them (even if some are out of date, as their newer jobs will replace them)
+        bool isUsed = false;
+        for (int i = 0; i < ChunkMesh::NUM_SECTIONS; ++i) {
+            if (!(job->sections & (1u << i))) continue;
+            bool isLatest = pit->second[i] == job->seq;
+            if (isLatest) pit->second[i] = 0;
+
+            if (newcm != NULL && (isLatest || isNew)) {
+                std::swap(newcm->sections[i].vertices, job->vertices[i]);
+                newcm->upload(i);
+                isUsed = true;
+            }
+        }
+        if (newcm != NULL) newcm->origin = vec3i(CHUNK_SIZE_X * job->id.X, 0, CHUNK_SIZE_Z * job->id.Z);
+        if (isUsed) stats.n_chunk_recalcs++;
 
-        chunkMeshRequests.erase(cmit);
+        // nothing is being built for the chunk any more
+        bool isPending = false;
+        for (uint64_t seq : pit->second) isPending = isPending || seq != 0;
+        if (!isPending) chunkMeshPending.erase(pit);
+
+        delete job;
         ct++;
     }
 
+    // then, hand the requested chunks to the workers (the snapshot is taken here, so the chunks can
+    //   keep changing while they are built)
+    while (chunkMeshRequests.size() > 0 && getTime() - stime_cu < 0.005) {
+        auto cmit = chunkMeshRequests.begin();
+
+        uint64_t seq = chunkMeshWorkers->submit(cmit->first, chunkMesher, cmit->second);
+
+        // a new entry is all 0's, for nothing being built
+        std::array<uint64_t, ChunkMesh::NUM_SECTIONS>& pending = chunkMeshPending[cmit->first];
+        for (int i = 0; i < ChunkMesh::NUM_SECTIONS; ++i) {
+            if (cmit->second & (1u << i)) pending[i] = seq;
+        }
+
+        chunkMeshRequests.erase(cmit);
+    }
+
 
     // now, reset the Chunk variables, mark them as rendered
     //   and update their last render hash to their current, for next time
@@ -356,13 +451,21 @@ void Renderer::renderFrame() {
             // we've got a mesh ready to render
             ChunkMesh* cm = chunkMeshes[chunk];
 
-            // bind the chunk mesh (which also binds all the other properties with it)
-            glBindVertexArray(cm->glVAO);
-            glDrawElements(GL_TRIANGLES, cm->faces.size() * 3, GL_UNSIGNED_INT, 0);
+            // the vertices are relative to the chunk
+            shaders["GEOM_ChunkMesh"]->setVec3("gChunkPos", vec3(cm->origin));
+
+            // draw each section that has anything in it
+            for (int i = 0; i < ChunkMesh::NUM_SECTIONS; ++i) {
+                int ntris = cm->getNumTris(i);
+                if (ntris == 0) continue;
 
-     
-            // add the number of triangles we requested to render
-            stats.n_tris += cm->faces.size();
+                // bind the section (which also binds all the other properties with it)
+                glBindVertexArray(cm->sections[i].glVAO);
+                glDrawElements(GL_TRIANGLES, ntris * 3, GL_UNSIGNED_INT, 0);
+
+                // add the number of triangles we requested to render
+                stats.n_tris += ntris;
+            }
         }
 
     } 
@@ -16,7 +16,10 @@
 /* std libraries */
 #include <algorithm>
 #include <thread>
+#include <deque>
 #include <mutex>
+#include <condition_variable>
+#include <array>
 
 /* additional graphics library from GLM */
 #include <Blok/glm/gtx/transform.hpp>
@@ -288,35 +291,51 @@ namespace Blok::Render {
 
     };
 
-    // the vertex data for a chunk mesh
-    // We can store things like ambient occlusion here, block ID, etc to help with rendering
+    // the vertex data for a chunk mesh, packed into 8 bytes (which 'GEOM_ChunkMesh.vert' unpacks)
+    // Only what can't be worked out from the face is stored: the normal, the tile of the block texture and
+    //   the texture coordinates (which go along the face, in blocks) all come from the face & position
     struct ChunkMeshVertex {
-        // position of the vertex in model space (x, y, z)
-        vec3 pos;
 
-        // the texture coordinates (u, v)
-        vec2 uv;
+        // Face - the direction the face a vertex is on points in
+        // NOTE: these must match the tables in 'GEOM_ChunkMesh.vert'
+        enum Face {
+            FACE_TOP = 0,
+            FACE_BOTTOM,
 
-        // the Tangent direction
-        vec3 T;
-        // the Bitangent direction
-        vec3 B;
-        // the Normal direction
-        vec3 N;
+            // +X and -X
+            FACE_RIGHT,
+            FACE_LEFT,
 
-        // the block ID at this vertex
-        float blockID;
+            // +Z and -Z
+            FACE_FORWARD,
+            FACE_BACK,
+        };
+
+        // the position within the chunk (x in bits 0-4, y in bits 5-13, z in bits 14-18), the face (bits
+        //   19-21), and the ambient occlusion level, as the number of solid blocks around the corner (bits 22-23)
+        uint32_t packed;
 
-        // ambient occlusion
-        float ao;
+        // the block ID (the other bits are unused)
+        uint32_t blockID;
 
-        // ambient occlusion?
-        ChunkMeshVertex(vec3 pos, vec2 uv, vec3 N, int blockID, float ao) {
-            this->pos = pos;
-            this->uv = uv;
-            this->N = N;
+        ChunkMeshVertex(vec3i pos, Face face, int ao, int blockID) {
+            this->packed = pos.x | (pos.y << 5) | (pos.z << 14) | (face << 19) | (ao << 22);
             this->blockID = blockID;
-            this->ao = ao;
+        }
+
+        // unpack the position within the chunk
+        vec3i getPos() const {
+            return vec3i(packed & 0x1F, (packed >> 5) & 0x1FF, (packed >> 14) & 0x1F);
+        }
+
+        // unpack the face
+        Face getFace() const {
+            return (Face)((packed >> 19) & 0x7);
+        }
+
+        // unpack the ambient occlusion level
+        int getAO() const {
+            return (packed >> 22) & 0x3;
         }
 
     };
@@ -327,19 +346,130 @@ namespace Blok::Render {
     class ChunkMesh {
         public:
 
-        // OpenGL handles to the Vertex Array Object, Vertex Buffer Object, and EBO
-        // for rendering, you only care about VAO, and then drawing triangles from it,
-        // which should have the data from 'vertices' and 'faces' in it
-        uint glVAO, glVBO, glEBO;
+        // Mesher - the ways the geometry of a chunk can be built
+        enum Mesher {
 
-        // list of verteices, in no particular order. They are indexed by 'faces' list
-        List<ChunkMeshVertex> vertices;
+            // a quad for every visible face of every block
+            MESHER_FACES = 0,
 
-        // list of all the faces, as triplets referring to indices in the 'vertices' list
-        List<Face> faces;
+            // visible faces in the same plane, with the same block ID and the same (even) ambient occlusion,
+            //   are merged into larger quads, whose texture tiles once per block
+            MESHER_GREEDY = 1,
+
+            // the same faces as MESHER_FACES, but found for whole columns at once, with bitmasks
+            MESHER_BINARY = 2,
+
+        };
+
+        // the triangles of a quad, as indices of its 4 vertices (see `ChunkMesh::build()`)
+        static const int QUAD_INDICES[6];
+
+        // the index buffer shared by every chunk mesh, which has 'QUAD_INDICES' for each of the first
+        //   'numQuadEBO' quads (see 'reserveQuads()')
+        static uint glQuadEBO;
+        static int numQuadEBO;
+
+        // the mesh is split into sections of 'SECTION_SIZE' blocks high, which are built and uploaded on
+        //   their own, so changing a block only rebuilds the sections around it
+        static const int SECTION_SIZE = 16, NUM_SECTIONS = CHUNK_SIZE_Y / SECTION_SIZE;
+
+        // a mask with the bit for every section set (bit 'i' is the section from y=SECTION_SIZE*i)
+        static const uint32_t ALL_SECTIONS = (1u << NUM_SECTIONS) - 1;
+
+        // Section - a part of the mesh, with its own buffers
+        struct Section {
+
+            // OpenGL handles to the Vertex Array Object, and Vertex Buffer Object
+            // for rendering, you only care about VAO, and then drawing triangles from it
+            // (which are indexed through 'glQuadEBO')
+            // NOTE: these are 0 until the section has had something in it
+            uint glVAO, glVBO;
+
+            // list of vertices, as quads (every 4 vertices are a face)
+            // NOTE: these are only kept until they are uploaded, after which they are on the GPU
+            List<ChunkMeshVertex> vertices;
+
+            // the number of quads uploaded to OpenGL
+            int numQuads;
+
+        };
+
+        Section sections[NUM_SECTIONS];
+
+        // the world position of the chunk, which the vertices are relative to
+        vec3i origin;
+
+        // recalculate the given sections of the mesh with a given mesher, and upload them to OpenGL
+        void update(Chunk* chunk, Mesher mesher=MESHER_GREEDY, uint32_t sectionMask=ALL_SECTIONS);
+
+        // upload the vertices of a section to OpenGL (i.e. after they were built by a 'ChunkMeshWorkers')
+        void upload(int section);
+
+        // return the number of triangles in a section
+        int getNumTris(int section) const {
+            return 2 * sections[section].numQuads;
+        }
+
+        // return the number of triangles in the whole mesh
+        int getNumTris() const {
+            int res = 0;
+            for (int i = 0; i < NUM_SECTIONS; ++i) res += getNumTris(i);
+            return res;
+        }
+
+        // return the mask of the sections that contain any blocks from y0 to y1 (both inclusive, and
+        //   clipped to the chunk)
+        static uint32_t getSections(int y0, int y1) {
+            y0 = std::max(y0, 0) / SECTION_SIZE;
+            y1 = std::min(y1, CHUNK_SIZE_Y - 1) / SECTION_SIZE;
+            if (y0 > y1) return 0;
+            return ((2u << y1) - 1) & ~((1u << y0) - 1);
+        }
+
+        // Padded - the block IDs of a chunk, with a border of 1 block all around it from its neighbours
+        //   (and air above & below the world), which is everything the meshers look at
+        // The blocks are in the same order as the chunk (so Y is contiguous). The columns of neighbours that
+        //   aren't there are air, and marked as missing, since they hide the faces next to them
+        // NOTE: only the rows that the sections it was filled for look at are copied
+        struct Padded {
+
+            static const int SIZE_X = CHUNK_SIZE_X + 2, SIZE_Y = CHUNK_SIZE_Y + 2, SIZE_Z = CHUNK_SIZE_Z + 2;
+            static const int NUM_BLOCKS = SIZE_X * SIZE_Y * SIZE_Z;
 
-        // recalculate the mesh, do not update OpenGL though
-        void update(Chunk* chunk);
+            // the offset between neighbouring blocks, along each axis
+            static const int DY = 1, DZ = SIZE_Y, DX = SIZE_Z * SIZE_Y;
+
+            // the ID of every block
+            ID ids[NUM_BLOCKS];
+
+            // whether the chunk each column is in is there, at [x + 1][z + 1]
+            bool present[SIZE_X][SIZE_Z];
+
+            // 1 above the highest block of the chunk itself that isn't air, since nothing above it has faces
+            int top;
+
+            // return the index of a local position (from -1 to the size, along each axis)
+            static int getIndex(int x, int y, int z) {
+                return (x + 1) * DX + (z + 1) * DZ + (y + 1) * DY;
+            }
+
+            // copy the blocks of a chunk, and those of its neighbours (found through 'rcache') that touch it,
+            //   for building the sections in 'sectionMask'
+            void fill(Chunk* chunk, uint32_t sectionMask=ALL_SECTIONS);
+
+        };
+
+        // build the geometry of the sections of a chunk in 'sectionMask' into 'sections' (an array of
+        //   'NUM_SECTIONS' lists, of which only those in the mask are cleared and rebuilt), without touching
+        //   OpenGL (so it can be used for benchmarks). The vertices are relative to the chunk, and each face
+        //   is 4 of them, in the order that 'QUAD_INDICES' winds clockwise
+        static void build(Chunk* chunk, Mesher mesher, List<ChunkMeshVertex>* sections, uint32_t sectionMask=ALL_SECTIONS);
+
+        // build the geometry from a padded copy of the chunk (which doesn't need the chunk, or its neighbours)
+        static void build(const Padded& pad, Mesher mesher, List<ChunkMeshVertex>* sections, uint32_t sectionMask=ALL_SECTIONS);
+
+        // make sure 'glQuadEBO' has indices for at least 'numQuads' quads
+        static void reserveQuads(int numQuads);
 
         // construct a new chunk mesh, with nothing in it.
         // call `update(chunk)` to cause a recalculation
@@ -350,6 +480,97 @@ namespace Blok::Render {
 
     };
 
+    // ChunkMeshWorkers - builds the geometry of chunk meshes on background threads
+    // Chunks are only safe to read on the main thread, so 'submit()' takes a snapshot of the chunk and the
+    //   blocks of its neighbours that touch it. The workers build from that, and the main thread takes the
+    //   finished jobs with 'poll()' and uploads them (since OpenGL can only be used from there)
+    // See the file `render/ChunkMeshWorkers.cc` for the implementation
+    class ChunkMeshWorkers {
+        public:
+
+        // Job - a single chunk to be meshed
+        struct Job {
+
+            // the chunk that is being meshed, and where it was
+            // NOTE: this is never read by the workers (it may even be freed before the job is done), it
+            //   is only used to find where the result goes
+            Chunk* chunk;
+            ChunkID id;
+
+            // the order the job was submitted in (a newer job for the same chunk replaces the result)
+            uint64_t seq;
+
+            // the mesher to use
+            ChunkMesh::Mesher mesher;
+
+            // the copy of the chunk's blocks, with the blocks of its neighbours that touch it (which is
+            //   freed once it has been built)
+            ChunkMesh::Padded* pad;
+
+            // the sections to build (see 'ChunkMesh::SECTION_SIZE'), and the resulting geometry of each of
+            //   them (see 'ChunkMesh::build()')
+            uint32_t sections;
+            List<ChunkMeshVertex> vertices[ChunkMesh::NUM_SECTIONS];
+
+            // the time (in seconds) the worker spent building it
+            double t_build;
+
+        };
+
+        // statistics about the meshing
+        struct {
+
+            // the number of jobs submitted, and built
+            uint64_t n_submitted, n_built;
+
+            // the total time spent taking snapshots (on the main thread), and building (on the workers)
+            double t_snapshot, t_build;
+
+        } stats;
+
+        // start a number of worker threads (or <= 0 to use all but one of the cores)
+        ChunkMeshWorkers(int numThreads=0);
+
+        // stop the workers, and free any jobs that are left
+        ~ChunkMeshWorkers();
+
+        // snapshot a chunk, and queue the sections of it in 'sectionMask' to be meshed, returning the job's 'seq'
+        // NOTE: call this from the thread that owns the chunks
+        uint64_t submit(Chunk* chunk, ChunkMesh::Mesher mesher, uint32_t sectionMask=ChunkMesh::ALL_SECTIONS);
+
+        // take a finished job (which the caller must free), or return NULL if there are none
+        Job* poll();
+
+        // return the number of jobs that have been submitted, but not taken by 'poll()'
+        int numPending();
+
+        private:
+
+        // guards the queues, and the statistics
+        std::mutex L_jobs;
+
+        // signaled when there is a job queued (or the workers should stop)
+        std::condition_variable C_queued;
+
+        // the jobs waiting for a worker, and those that are done
+        std::deque<Job*> queued, done;
+
+        // the number of jobs that are being built
+        int numBuilding;
+
+        // the next job's 'seq'
+        uint64_t nextSeq;
+
+        // whether the workers should keep running
+        bool running;
+
+        List<std::thread> T_workers;
+
+        // the main loop of a worker
+        void T_worker_run();
+
+    };
+
 
     /* RENDERING PROGRAMS/CONSTRUCTS */
 
@@ -481,12 +702,21 @@ namespace Blok::Render {
         // array of freely allocated ChunkMeshes
         List<ChunkMesh*> chunkMeshPool;
 
-        // chunk mesh requests
-        Set<Chunk*> chunkMeshRequests;
+        // chunk mesh requests, and the sections of each that need to be rebuilt
+        Map<Chunk*, uint32_t> chunkMeshRequests;
         
         // chunk mesh objects
         Map<Chunk*, ChunkMesh*> chunkMeshes;
 
+        // the workers building chunk meshes, and the latest job (its 'seq') for each section of each chunk
+        //   that is being built (or 0 if it isn't), so older results that finish later are thrown away
+        ChunkMeshWorkers* chunkMeshWorkers;
+        Map<Chunk*, std::array<uint64_t, ChunkMesh::NUM_SECTIONS> > chunkMeshPending;
+
+        // the mesher chunks are built with (after changing it, request all the sections of the chunks in
+        //   'chunkMeshes' to rebuild them)
+        ChunkMesh::Mesher chunkMesher;
+
 
         // the default background color
         vec3 clearColor;
@@ -584,6 +814,11 @@ namespace Blok::Render {
             // add a nice default color
             clearColor = vec3(0.1f, 0.1f, 0.1f);
 
+            // merge faces, since it is far fewer triangles
+            chunkMesher = ChunkMesh::MESHER_GREEDY;
+
+            chunkMeshWorkers = new ChunkMeshWorkers();
+
             // construct our geometry pass
             targets["GEOM"] = new Target(width, height, 5);
             
@@ -637,6 +872,9 @@ namespace Blok::Render {
                 delete keyval.second;
             }
 
+            // stop building meshes, before anything they would go into is freed
+            delete chunkMeshWorkers;
+
             // free our kept pools
             for (auto cmesh : chunkMeshPool) {
                 delete cmesh;
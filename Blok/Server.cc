@@ -8,8 +8,30 @@
 
 #include <Blok/Client.hh>
 
+#include <atomic>
+
 namespace Blok {
 
+// get a chunk, decompressing it if needed
+Chunk* LocalServer::getChunk(ChunkID id, bool request) {
+    L_chunks.lock();
+
+    auto it = loadedChunks.find(id);
+    Chunk* ret = NULL;
+    if (it == loadedChunks.end()) {
+        if (request && chunkRequests.find(id) == chunkRequests.end() && chunkRequestsInProgress.find(id) == chunkRequestsInProgress.end()) {
+            chunkRequests.insert(id);
+        }
+    } else {
+        ret = it->second;
+        decompress(ret);
+        ret->lastUsed = getTime();
+    }
+
+    L_chunks.unlock();
+    return ret;
+}
+
 // raycast() should seek through all possible chunks, checking intersection along 'ray',
 //   up to 'maxDist'. If it ends up hitting a solid block, return true and set all the 'to*'
 //   arguments to the data about the hit
@@ -158,6 +180,129 @@ bool LocalServer::raycastBlock(Ray ray, float maxDist, RayHit& hitInfo) {
     return false;
 }
 
+// set a block, and log it
+bool LocalServer::setBlock(vec3i pos, BlockData val) {
+    if (pos.y < 0 || pos.y >= CHUNK_SIZE_Y) return false;
+
+    L_chunks.lock();
+    auto it = loadedChunks.find(ChunkID::fromPos(pos));
+    if (it == loadedChunks.end()) {
+        L_chunks.unlock();
+        return false;
+    }
+
+    Chunk* chunk = it->second;
+    decompress(chunk);
+    chunk->lastUsed = getTime();
+
+    vec3i local = pos - chunk->getWorldPos();
+    chunk->set(local.x, local.y, local.z, val);
+
+    // log it while still locked, so the journal has the same order as the chunks
+    if (journal != NULL) journal->append(pos, val);
+    L_chunks.unlock();
+
+    return true;
+}
+
+// add an entity
+void LocalServer::addEntity(Entity* ent) {
+    L_chunks.lock();
+
+    // replace any entity with the same UUID
+    auto old = loadedEntities.find(ent->uuid);
+    if (old != loadedEntities.end() && old->second != ent) {
+        auto oldChunk = entityChunks.find(ent->uuid);
+        if (oldChunk != entityChunks.end()) {
+            auto it = loadedChunks.find(oldChunk->second);
+            if (it != loadedChunks.end()) {
+                it->second->entities.erase(ent->uuid);
+                it->second->modified = true;
+            }
+            entityChunks.erase(oldChunk);
+        }
+        delete old->second;
+    }
+    loadedEntities[ent->uuid] = ent;
+
+    // store it in its chunk, if that is loaded (otherwise, it is stored when its chunk is next saved)
+    ChunkID id = ChunkID::fromPos(vec3i(glm::floor(ent->getPos())));
+    auto it = loadedChunks.find(id);
+    if (it != loadedChunks.end() && entityChunks.find(ent->uuid) == entityChunks.end()) {
+        it->second->entities[ent->uuid] = ent;
+        it->second->modified = true;
+        entityChunks[ent->uuid] = id;
+    }
+
+    L_chunks.unlock();
+}
+
+// add the entities of a loaded chunk
+void LocalServer::registerEntities(Chunk* chunk) {
+    for (auto it = chunk->entities.begin(); it != chunk->entities.end(); ) {
+        auto cur = loadedEntities.find(it->first);
+        if (cur != loadedEntities.end() && cur->second != it->second) {
+            // the one that is already loaded is newer, so it wins
+            delete it->second;
+            it = chunk->entities.erase(it);
+            chunk->modified = true;
+            continue;
+        }
+        loadedEntities[it->first] = it->second;
+        entityChunks[it->first] = chunk->XZ;
+        ++it;
+    }
+}
+
+// move entities into the chunks they are in
+void LocalServer::rehomeEntities() {
+    for (auto& entry : loadedEntities) {
+        Entity* ent = entry.second;
+        ChunkID id = ChunkID::fromPos(vec3i(glm::floor(ent->getPos())));
+
+        auto cur = entityChunks.find(entry.first);
+        if (cur != entityChunks.end() && cur->second == id) continue;
+
+        // it can only move into a loaded chunk, otherwise it stays where it was
+        auto to = loadedChunks.find(id);
+        if (to == loadedChunks.end()) continue;
+
+        if (cur != entityChunks.end()) {
+            auto from = loadedChunks.find(cur->second);
+            if (from != loadedChunks.end()) {
+                from->second->entities.erase(entry.first);
+                from->second->modified = true;
+            }
+            cur->second = id;
+        } else {
+            entityChunks[entry.first] = id;
+        }
+
+        to->second->entities[entry.first] = ent;
+        to->second->modified = true;
+    }
+}
+
+
+// do the periodic work of the chunk loader
+void LocalServer::runPeriodic() {
+    // check a few times per 'compressAfter', so chunks are not left uncompressed for much longer than it
+    if (compressAfter > 0 && getTime() >= nextColdTime) {
+        nextColdTime = getTime() + std::max(compressAfter / 4, 1.0);
+        compressCold();
+    }
+
+    // save modified chunks every so often
+    if (storage != NULL && autosaveInterval > 0 && getTime() >= nextSaveTime) {
+        nextSaveTime = getTime() + autosaveInterval;
+        saveModified();
+    }
+
+    // fold the journal into the chunks every so often
+    if (journal != NULL && journal->needsCompaction()) {
+        compactJournal();
+    }
+}
 
 // this is the target that should be ran all the time, by the T_chunkLoad thread,
 //   which attempts to service the chunk loader
@@ -169,11 +314,17 @@ void LocalServer::T_chunkLoad_run() {
         // run every 100 ms
         tim.tv_nsec = 25 * 1000000;
 
-        // wait until there was something
-        while (chunkRequests.size() == 0) {
+        // wait until there was something, doing the periodic work in the meantime (so chunks edited
+        //   while nothing is being loaded still get saved)
+        while (running) {
+            runPeriodic();
+            if (chunkRequests.size() > 0) break;
             nanosleep(&tim, NULL);
         }
 
+        // we've been told to stop
+        if (!running) break;
+
 
         L_chunks.lock();
 
@@ -193,20 +344,410 @@ void LocalServer::T_chunkLoad_run() {
 
         Map<ChunkID, Chunk*> gen;
 
+        double stime = getTime();
         for (auto cid : chunkRequestsInProgress) {
-            gen[cid] = worldGen->getChunk(cid);
+            // load it if it was saved, otherwise generate it
+            Chunk* chunk = storage != NULL ? storage->loadChunk(cid) : NULL;
+            gen[cid] = chunk != NULL ? chunk : worldGen->getChunk(cid);
+        }
+        stime = getTime() - stime;
+
+        // record statistics
+        stats.n_chunks += gen.size();
+        stats.t_chunks += stime;
+
+        // report how generation is doing every so often
+        if (stats.n_chunks > 0 && getTime() > nextReportTime) {
+            nextReportTime = getTime() + 5.0;
+            WG::HeightCache* hc = worldGen->getHeightCache();
+            if (hc != NULL) {
+                blok_debug("generated %i chunks (%.3lfms/chunk), heightmap cache: %.1lf%% hits, %.1lf%% of time in tiles", stats.n_chunks, 1e3 * stats.t_chunks / stats.n_chunks, 100.0 * hc->getHitRate(), stats.t_chunks > 0 ? 100.0 * hc->stats.t_compute / stats.t_chunks : 0.0);
+            } else {
+                blok_debug("generated %i chunks (%.3lfms/chunk)", stats.n_chunks, 1e3 * stats.t_chunks / stats.n_chunks);
+            }
+
+            if (stats.n_compressed > 0) {
+                blok_debug("  compression: %i compressed (%.1lf%% of raw size, %.3lfms/chunk), %i decompressed (%.3lfms/chunk)", stats.n_compressed, 100.0 * stats.n_packed / stats.n_raw, 1e3 * stats.t_compress / stats.n_compressed, stats.n_decompressed, stats.n_decompressed > 0 ? 1e3 * stats.t_decompress / stats.n_decompressed : 0.0);
+            }
+
+            WG::EditQueue* queue = worldGen->getEditQueue();
+            if (queue != NULL && queue->stats.n_pushed > 0) {
+                blok_debug("  edits: %i chunks waiting, %i/%i applied, %i dropped", queue->size(), (int)queue->stats.n_applied, (int)queue->stats.n_pushed, (int)queue->stats.n_dropped);
+            }
+
+            if (journal != NULL && journal->stats.n_batches > 0) {
+                blok_debug("  journal: %i edits in %i batches (%.3lfms/batch), %i compactions", (int)journal->stats.n_edits, (int)journal->stats.n_batches, 1e3 * journal->stats.t_commits / journal->stats.n_batches, (int)journal->stats.n_compactions);
+            }
+
+            Storage::WriteBehind* writer = dynamic_cast<Storage::WriteBehind*>(storage);
+            if (writer != NULL && writer->stats.n_saves > 0) {
+                blok_debug("  saving: %i chunks queued (max %i), %i written (%i coalesced), %.1lf chunks/sec", writer->getQueueDepth(), writer->stats.max_depth, (int)writer->stats.n_writes, (int)writer->stats.n_coalesced, writer->getWriteRate());
+            }
+
+            // break it down by stage, if possible
+            WG::Pipeline* pipeline = dynamic_cast<WG::Pipeline*>(worldGen);
+            if (pipeline != NULL) {
+                for (WG::Stage* stage : pipeline->stages) {
+                    blok_debug("  stage '%s': %.3lfms/chunk", stage->name.c_str(), 1e3 * stage->getTimePerChunk());
+                }
+            }
         }
 
         // store them back
 
         L_chunks.lock();
+        double now = getTime();
         for (auto elem : gen) {
+            elem.second->lastUsed = now;
             loadedChunks[elem.first] = elem.second;
+            registerEntities(elem.second);
         }
         chunkRequestsInProgress.clear();
         L_chunks.unlock();
 
+        // the new chunks may have decorations that cross into chunks which were already loaded (or
+        //   were loaded from storage, so never had their edits applied)
+        applyPendingEdits();
+
+    }
+}
+
+// apply queued edits to the chunks they are for
+void LocalServer::applyPendingEdits(bool toStorage) {
+    WG::EditQueue* queue = worldGen->getEditQueue();
+    if (queue == NULL || queue->size() == 0) return;
+
+    for (ChunkID id : queue->getPending()) {
+        L_chunks.lock();
+        auto it = loadedChunks.find(id);
+        if (it != loadedChunks.end()) {
+            decompress(it->second);
+            queue->apply(it->second);
+            L_chunks.unlock();
+            continue;
+        }
+        L_chunks.unlock();
+
+        if (toStorage && storage != NULL && storage->hasChunk(id)) {
+            // apply it to the saved copy
+            Chunk* chunk = storage->loadChunk(id);
+            if (chunk != NULL) {
+                if (queue->apply(chunk) > 0) storage->saveChunk(chunk);
+                delete chunk;
+            }
+        }
     }
 }
 
+// replay the journal into storage
+void LocalServer::replayJournal() {
+    List<Storage::Journal::Edit> edits = journal->replay();
+
+    if (edits.size() > 0) {
+        double stime = getTime();
+
+        // apply them in order, loading (or generating) each chunk once
+        Map<ChunkID, Chunk*> chunks;
+        for (const Storage::Journal::Edit& edit : edits) {
+            vec3i pos = vec3i(edit.x, edit.y, edit.z);
+            ChunkID id = ChunkID::fromPos(pos);
+
+            Chunk* chunk;
+            auto it = chunks.find(id);
+            if (it != chunks.end()) {
+                chunk = it->second;
+            } else {
+                chunk = storage->loadChunk(id);
+                if (chunk == NULL) chunk = worldGen->getChunk(id);
+                chunks[id] = chunk;
+            }
+
+            vec3i local = pos - chunk->getWorldPos();
+            chunk->set(local.x, local.y, local.z, BlockData((ID)edit.id, edit.meta));
+        }
+
+        for (auto& entry : chunks) {
+            storage->saveChunk(entry.second);
+            delete entry.second;
+        }
+
+        // they must be durable before the journal is thrown away
+        if (!storage->sync()) {
+            blok_error("Failed to save the chunks replayed from the journal, keeping it");
+            return;
+        }
+
+        blok_info("Replayed %i edits to %i chunks from the journal in %.2lfs", (int)edits.size(), (int)chunks.size(), getTime() - stime);
+    }
+
+    journal->reset();
+}
+
+// compact the journal
+void LocalServer::compactJournal() {
+    Set<ChunkID> ids = journal->rotate();
+
+    // chunks that have been unloaded since were already saved when they were unloaded
+    int ct = 0, n_failed = 0;
+    L_chunks.lock();
+    for (ChunkID id : ids) {
+        auto it = loadedChunks.find(id);
+        if (it == loadedChunks.end() || !it->second->modified) continue;
+
+        decompress(it->second);
+        it->second->modified = false;
+        if (storage->saveChunk(it->second)) {
+            ct++;
+        } else {
+            it->second->modified = true;
+            n_failed++;
+        }
+    }
+    L_chunks.unlock();
+
+    if (n_failed > 0) {
+        // keep the old journal, so those edits are replayed next time
+        blok_error("Failed to save %i chunks while compacting the journal", n_failed);
+        return;
+    }
+
+    if (!storage->sync()) {
+        // some writes (maybe of chunks unloaded since) failed, so keep the old journal too
+        blok_error("Failed to sync storage while compacting the journal");
+        return;
+    }
+    journal->finishCompaction();
+
+    blok_debug("Compacted the journal into %i chunks (%i edited)", ct, (int)ids.size());
+}
+
+
+// pregenerate an area of chunks to storage
+int LocalServer::pregenerate(ChunkID center, int radius, bool disc, int numThreads) {
+    if (storage == NULL) {
+        blok_error("Cannot pregenerate without a storage to save to");
+        return 0;
+    }
+
+    if (numThreads <= 0) numThreads = std::thread::hardware_concurrency();
+    if (numThreads <= 0) numThreads = 1;
+
+    // collect all the chunks in the area
+    List<ChunkID> todo;
+    for (int X = -radius; X <= radius; ++X) {
+        for (int Z = -radius; Z <= radius; ++Z) {
+            if (disc && X * X + Z * Z > radius * radius) continue;
+            todo.push_back(center + ChunkID(X, Z));
+        }
+    }
+
+    // generate from the center outwards, so that the area around spawn is done first
+    std::sort(todo.begin(), todo.end(), [center](ChunkID A, ChunkID B) {
+        ChunkID dA = A - center, dB = B - center;
+        return dA.X * dA.X + dA.Z * dA.Z < dB.X * dB.X + dB.Z * dB.Z;
+    });
+
+    int N = todo.size();
+    blok_info("Pregenerating %i chunks (%s of radius %i around %i,%i) with %i threads", N, disc ? "disc" : "square", radius, center.X, center.Z, numThreads);
+
+    // the next index in 'todo' to work on, how many have been finished, and how many were generated (i.e. not skipped)
+    std::atomic<int> next(0), done(0), generated(0);
+
+    auto worker = [&]() {
+        int i;
+        while ((i = next++) < N) {
+            ChunkID cid = todo[i];
+            if (!storage->hasChunk(cid)) {
+                Chunk* chunk = worldGen->getChunk(cid);
+                storage->saveChunk(chunk);
+                delete chunk;
+                generated++;
+            }
+            done++;
+        }
+    };
+
+    double stime = getTime();
+
+    List<std::thread> threads;
+    for (int i = 0; i < numThreads; ++i) {
+        threads.push_back(std::thread(worker));
+    }
+
+    // print progress until they are done
+    struct timespec tim;
+    tim.tv_sec = 0;
+    tim.tv_nsec = 250 * 1000000;
+
+    while (done < N) {
+        nanosleep(&tim, NULL);
+        double dt = getTime() - stime;
+        fprintf(stderr, "\r[%3i%%] %i/%i chunks, %.1lf chunks/sec   ", (int)(100.0 * done / N), (int)done, N, generated / dt);
+        fflush(stderr);
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // decorations may have crossed into chunks that were already saved (or were generated in
+    //   an earlier run)
+    applyPendingEdits(true);
+
+    // make sure it is all on disk
+    storage->sync();
+
+    stime = getTime() - stime;
+    fprintf(stderr, "\n");
+    blok_info("Pregenerated %i chunks (%i already existed) in %.2lfs (%.1lf chunks/sec)", (int)generated, N - generated, stime, generated / stime);
+
+    return generated;
+}
+
+// save all modified chunks
+int LocalServer::saveModified() {
+    if (storage == NULL) return 0;
+
+    int res = 0;
+
+    L_chunks.lock();
+
+    // entities that have moved are saved with the chunk they are in now
+    rehomeEntities();
+
+    for (auto& entry : loadedChunks) {
+        Chunk* chunk = entry.second;
+        if (!chunk->modified) continue;
+
+        decompress(chunk);
+
+        // reset it before saving, so any changes made while it is being saved mark it again
+        chunk->modified = false;
+        if (storage->saveChunk(chunk)) {
+            res++;
+        } else {
+            chunk->modified = true;
+        }
+    }
+    L_chunks.unlock();
+
+    return res;
+}
+
+// unload a single chunk
+void LocalServer::unloadChunk(ChunkID id, bool durable) {
+    L_chunks.lock();
+    auto it = loadedChunks.find(id);
+    if (it == loadedChunks.end()) {
+        L_chunks.unlock();
+        return;
+    }
+    Chunk* chunk = it->second;
+    loadedChunks.erase(it);
+    if (storage != NULL && chunk->modified) decompress(chunk);
+
+    // its entities go with it
+    for (auto& entry : chunk->entities) {
+        loadedEntities.erase(entry.first);
+        entityChunks.erase(entry.first);
+    }
+    L_chunks.unlock();
+
+    if (storage == NULL || !chunk->modified) {
+        delete chunk;
+        return;
+    }
+
+    Storage::WriteBehind* writer = dynamic_cast<Storage::WriteBehind*>(storage);
+    if (writer != NULL) {
+        // hand it straight to the writer, rather than copying it
+        writer->saveAndFree(chunk);
+        if (durable) writer->wait(id);
+    } else {
+        storage->saveChunk(chunk);
+        delete chunk;
+        if (durable) storage->sync();
+    }
+}
+
+// take a snapshot
+String LocalServer::snapshot() {
+    if (snapshots == NULL) return "";
+
+    // everything edited so far should be in it
+    saveModified();
+    storage->sync();
+
+    String res = snapshots->take();
+    if (res.size() > 0) snapshots->prune(snapshotKeep);
+    return res;
+}
+
+// take snapshots every so often
+void LocalServer::T_snapshot_run() {
+    struct timespec tim;
+    tim.tv_sec = 0;
+    tim.tv_nsec = 100 * 1000000;
+
+    // 'snapshotInterval' is checked each time, so it can be changed while running
+    double lastSnapshotTime = getTime();
+    while (running) {
+        nanosleep(&tim, NULL);
+        if (snapshotInterval > 0 && getTime() - lastSnapshotTime >= snapshotInterval) {
+            snapshot();
+            lastSnapshotTime = getTime();
+        }
+    }
+}
+
+// compress the chunks that have gone cold
+int LocalServer::compressCold() {
+    if (compressAfter <= 0) return 0;
+
+    // find them first, and then compress them one at a time, so the main thread is never kept
+    //   waiting on more than a single chunk
+    double cutoff = getTime() - compressAfter;
+    List<ChunkID> cold;
+    L_chunks.lock();
+    for (auto& entry : loadedChunks) {
+        Chunk* chunk = entry.second;
+        if (!chunk->isCompressed() && chunk->lastUsed < cutoff && (storage == NULL || !chunk->modified)) {
+            cold.push_back(entry.first);
+        }
+    }
+    L_chunks.unlock();
+
+    int res = 0;
+    for (ChunkID id : cold) {
+        L_chunks.lock();
+        auto it = loadedChunks.find(id);
+        // make sure it wasn't used (or unloaded) in the meantime
+        if (it != loadedChunks.end() && !it->second->isCompressed() && it->second->lastUsed < cutoff) {
+            double stime = getTime();
+            size_t size = it->second->compress();
+            stats.t_compress += getTime() - stime;
+
+            stats.n_compressed++;
+            stats.n_raw += sizeof(BlockData) * CHUNK_NUM_BLOCKS;
+            stats.n_packed += size;
+            res++;
+        }
+        L_chunks.unlock();
+    }
+
+    if (res > 0) blok_trace("Compressed %i cold chunks", res);
+
+    return res;
+}
+
+// decompress a chunk, keeping track of how long it took
+void LocalServer::decompress(Chunk* chunk) {
+    if (!chunk->isCompressed()) return;
+
+    double stime = getTime();
+    chunk->decompress();
+    stats.t_decompress += getTime() - stime;
+    stats.n_decompressed++;
+}
+
 };
@@ -23,12 +23,16 @@
 // we use the WG protocol for generating worlds
 #include <Blok/WG.hh>
 
+// we use the storage protocol for persisting worlds
+#include <Blok/Storage.hh>
+
 // include entity protocol
 #include <Blok/Entity.hh>
 
 // for MP processing
 #include <mutex> 
 #include <thread>
+#include <atomic>
 #include <time.h>
 #include <chrono> 
 
@@ -42,6 +46,10 @@ namespace Blok {
     class Server {
         public:
 
+        virtual ~Server() {
+            // do nothing by default, so that deleting any server through a 'Server*' runs its destructor
+        }
+
         // this mutex controls access to all chunk request variables.
         // But, use the `getChunk()` method to perform locking
         std::mutex L_chunks;
@@ -62,6 +70,7 @@ namespace Blok {
         Map<ChunkID, Chunk*> loadedChunks;
 
         // A map between the unique id's and the entity
+        // NOTE: lock `L_chunks` while using this, since entities are added & removed as their chunks load
         Map<UUID, Entity*> loadedEntities;
 
         // If the chunk is currently loaded, just return a pointer to that chunk, which can be modified (see Blok.hh)
@@ -99,12 +108,25 @@ namespace Blok {
             return ret;
         }
 
+        // set a block (in world coordinates), returning whether it was set (i.e. whether its chunk is loaded)
+        virtual bool setBlock(vec3i pos, BlockData val) {
+            if (pos.y < 0 || pos.y >= CHUNK_SIZE_Y) return false;
+
+            Chunk* chunk = getChunk(ChunkID::fromPos(pos), false);
+            if (chunk == NULL) return false;
+
+            vec3i local = pos - chunk->getWorldPos();
+            chunk->set(local.x, local.y, local.z, val);
+            return true;
+        }
+
         // attempt to cast a ray (in world space), up to 'dist', returning whether or not it hit something
         // In the case that it did hit something, also set `hitInfo` to the relevant data about the collision
         // See `Blok.hh`, specifically around `struct RayHit` for more information
         virtual bool raycastBlock(Ray ray, float dist, RayHit& hitInfo) = 0;
 
-        void addEntity(Entity* ent) {
+        // add an entity to the world, which the server takes ownership of
+        virtual void addEntity(Entity* ent) {
             loadedEntities[ent->uuid] = ent;
         }
 
@@ -127,45 +149,206 @@ namespace Blok {
             // the total time spent generating chunks
             double t_chunks;
 
+            // the number of times a cold chunk was compressed, and decompressed again when it was needed
+            int n_compressed, n_decompressed;
+
+            // the number of bytes the compressed chunks took before and after compression
+            uint64_t n_raw, n_packed;
+
+            // the total time spent compressing & decompressing chunks
+            double t_compress, t_decompress;
+
         } stats;
 
         // the world generator that is currently being used to generate chunks
         WG::WG* worldGen;
 
+        // where the world is persisted. Chunks are loaded from here before falling back to
+        //   'worldGen'. If NULL, nothing is persisted
+        Storage::Storage* storage;
+
         // thread to run the chunk loading
         std::thread T_chunkLoad;
 
-        // construct a new local server.
-        // For now, just create a default world generator
-        LocalServer() {
-            worldGen = new WG::DefaultWG(0);
+        // whether the background threads should keep running
+        std::atomic<bool> running;
+
+        // when the chunk loader next reports how generation is doing, looks for cold chunks to compress,
+        //   and saves modified chunks
+        double nextReportTime, nextColdTime, nextSaveTime;
+
+        // how often (in seconds) modified chunks are saved to 'storage' (or <= 0 to only save them
+        //   when they are unloaded)
+        double autosaveInterval;
+
+        // how long (in seconds) a loaded chunk can go without being used (see 'getChunk()') before it is
+        //   compressed in memory (or <= 0 to never compress chunks)
+        double compressAfter;
+
+        // where block edits are logged as they happen, so they survive a crash before the chunks are
+        //   saved. If NULL (or there is no 'storage'), edits are only saved with their chunks
+        Storage::Journal* journal;
+
+        // where backups of the world are taken, which is found in 'storage' (either it, or what it writes
+        //   behind to). If NULL, no backups are taken
+        Storage::Snapshots* snapshots;
+
+        // how often (in seconds) a snapshot is taken (or <= 0 to only take them when asked)
+        double snapshotInterval;
+
+        // the number of snapshots that are kept (older ones are pruned after each new one)
+        int snapshotKeep;
+
+        // thread to take snapshots, so they never hold up chunk loading
+        std::thread T_snapshot;
+
+        // the chunk that each entity in 'loadedEntities' is stored in (i.e. in its 'entities'). Entities
+        //   are moved to the chunk they are in when modified chunks are saved. Those that are not in
+        //   here (because their chunk was not loaded when they were added) are not saved
+        // NOTE: lock `L_chunks` while using this
+        Map<UUID, ChunkID> entityChunks;
+
+        // construct a new local server, which takes ownership of 'storage' (which may be NULL),
+        //   'worldGen', and 'journal' (which may be NULL). If 'worldGen' is NULL, just create a
+        //   default world generator
+        // If there is a journal, any edits in it are replayed (and saved) before returning
+        LocalServer(Storage::Storage* storage=NULL, WG::WG* worldGen=NULL, Storage::Journal* journal=NULL) {
+            this->worldGen = worldGen != NULL ? worldGen : new WG::DefaultWG(0);
             //worldGen = new WG::FlatWG(0);
 
-            // start the thread to load chunks & handle requests
-            T_chunkLoad = std::thread(&LocalServer::T_chunkLoad_run, this);
+            this->storage = storage;
+            this->journal = journal;
+
+            // a journal is useless without anything to compact it into
+            if (this->journal != NULL && storage == NULL) {
+                blok_warn("Ignoring the journal, since there is no storage");
+                delete this->journal;
+                this->journal = NULL;
+            }
 
             // initialize statistics to nothing
             stats.n_chunks = 0;
             stats.t_chunks = 0.0;
+            stats.n_compressed = stats.n_decompressed = 0;
+            stats.n_raw = stats.n_packed = 0;
+            stats.t_compress = stats.t_decompress = 0.0;
+            nextReportTime = 0.0;
+
+            // save every so often
+            autosaveInterval = 10.0;
+
+            // compress chunks nobody has looked at for a while
+            compressAfter = 30.0;
+
+            // back up hourly, for a day
+            snapshotInterval = 3600.0;
+            snapshotKeep = 24;
+
+            nextColdTime = getTime() + compressAfter;
+            nextSaveTime = getTime() + autosaveInterval;
+
+            snapshots = dynamic_cast<Storage::Snapshots*>(storage);
+            Storage::WriteBehind* writer = dynamic_cast<Storage::WriteBehind*>(storage);
+            if (writer != NULL) snapshots = dynamic_cast<Storage::Snapshots*>(writer->inner);
+
+            // recover the edits from last time
+            if (this->journal != NULL) replayJournal();
+
+            // start the thread to load chunks & handle requests
+            running = true;
+            T_chunkLoad = std::thread(&LocalServer::T_chunkLoad_run, this);
+            if (snapshots != NULL) T_snapshot = std::thread(&LocalServer::T_snapshot_run, this);
         }
 
         // destroy server & its resources
         ~LocalServer() {
-            // remove our generator
-            delete worldGen;
+            // stop the loading thread before freeing anything it uses
+            running = false;
+            T_chunkLoad.join();
+            if (T_snapshot.joinable()) T_snapshot.join();
+
+            // finish any decorations that are still waiting on their chunks
+            applyPendingEdits(true);
 
-            // delete all loaded chunks
-            for (auto& entry : loadedChunks) {
+            // make sure entities are saved where they are now
+            L_chunks.lock();
+            rehomeEntities();
+            L_chunks.unlock();
+
+            // save & delete all loaded chunks
+            while (loadedChunks.size() > 0) {
+                unloadChunk(loadedChunks.begin()->first);
+            }
+
+            // the only entities left are those that were never in a chunk
+            for (auto& entry : loadedEntities) {
                 delete entry.second;
             }
+            loadedEntities.clear();
+
+            // flush & close storage
+            bool saved = true;
+            if (storage != NULL) {
+                saved = storage->sync();
+                delete storage;
+            }
+
+            // everything is saved, so the journal isn't needed any more (unless it isn't, and then it is
+            //   replayed next time)
+            if (journal != NULL) {
+                if (saved) journal->reset();
+                else blok_warn("Not everything was saved, keeping the journal");
+                delete journal;
+            }
+
+            // remove our generator (last, since storage may use it)
+            delete worldGen;
 
         }
 
+        // get a chunk (see 'Server::getChunk()'), decompressing it first if it had gone cold
+        Chunk* getChunk(ChunkID id, bool request=true);
+
         // raycast() should seek through all possible chunks, checking intersection along 'ray',
         //   up to 'maxDist'. If it ends up hitting a solid block, return true and set all the 'to*'
         //   arguments to the data about the hit
         bool raycastBlock(Ray ray, float dist, RayHit& hitInfo);
 
+        // set a block, and log it in 'journal'
+        bool setBlock(vec3i pos, BlockData val);
+
+        // add an entity, storing it in the chunk it is in (if that is loaded), so it is saved with it
+        // If there is already an entity with the same UUID, it is replaced (and freed)
+        void addEntity(Entity* ent);
+
+        // generate all chunks within 'radius' (in chunks) of 'center' and save them to 'storage', using
+        //   'numThreads' threads (or all cores, if <= 0). Chunks that are already saved are skipped, so it
+        //   can be resumed. If 'disc' is true, the area is a disc rather than a square
+        // Progress is printed as it goes, and the number of chunks that were generated is returned
+        // NOTE: the chunks are not loaded into the server
+        int pregenerate(ChunkID center, int radius, bool disc=false, int numThreads=0);
+
+        // save all modified chunks to 'storage'. If 'storage' writes behind, this only queues them, and
+        //   returns without waiting on any I/O
+        // Returns the number of chunks that were saved
+        int saveModified();
+
+        // unload a chunk, saving it first if it was modified. If 'durable' is true, this waits until it has
+        //   been written (but not for any other chunks that are waiting to be written)
+        // NOTE: the chunk is freed, so the caller must make sure nothing still references it
+        void unloadChunk(ChunkID id, bool durable=false);
+
+        // save all modified chunks, make sure they are written, and take a snapshot of the world (pruning
+        //   old ones), returning its name (or an empty string if it failed, or there are no 'snapshots')
+        String snapshot();
+
+        // compress all the loaded chunks that have not been used for 'compressAfter' seconds, returning how
+        //   many were compressed. Modified chunks are left until they have been saved (if there is a 'storage'),
+        //   so saving never has to decompress them
+        // NOTE: pointers returned by 'getChunk()' must not be held onto for that long, since the blocks
+        //   of a compressed chunk are freed
+        int compressCold();
+
         private:
         /* internal methods */
 
@@ -173,6 +356,34 @@ namespace Blok {
         //   which attempts to service the chunk loader
         void T_chunkLoad_run();
 
+        // do whatever 'T_chunkLoad' does every so often that is due (i.e. compressing cold chunks,
+        //   autosaving, and compacting the journal), whether or not any chunks are being requested
+        void runPeriodic();
+
+        // the target of 'T_snapshot', which takes a snapshot every 'snapshotInterval' seconds
+        void T_snapshot_run();
+
+        // decompress a chunk, if it is compressed, with 'L_chunks' held
+        void decompress(Chunk* chunk);
+
+        // add the entities of a chunk that was just loaded to 'loadedEntities', with 'L_chunks' held
+        void registerEntities(Chunk* chunk);
+
+        // move each entity into the chunk it is in now (if it is loaded), with 'L_chunks' held
+        void rehomeEntities();
+
+        // apply edits that the world generator has queued for other chunks (i.e. decorations that
+        //   crossed a border) to any of those chunks that are loaded, and if 'toStorage' is true, to
+        //   those that are only in 'storage'
+        void applyPendingEdits(bool toStorage=false);
+
+        // apply all the edits in 'journal' to the chunks in 'storage' (generating any that are not
+        //   saved), sync them, and reset it
+        void replayJournal();
+
+        // save the chunks edited since the last compaction of 'journal', and remove their edits from it
+        void compactJournal();
+
     };
 
 }
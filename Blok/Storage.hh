@@ -0,0 +1,897 @@
+/* Storage.hh - definition of the chunk storage protocol, i.e. how worlds are persisted
+ *
+ * The storage protocol is quite simple:
+ *   - loadChunk() returns a new chunk (i.e. newly allocated) read from storage, or NULL if it
+ *       was never saved (in which case, it should be generated instead)
+ *   - saveChunk() writes a chunk to storage, replacing any earlier copy
+ *   - listChunks() returns the IDs of every saved chunk (which may need to read a lot, so it is meant
+ *       for whole-world operations like backups)
+ *
+ * All methods should be safe to call from multiple threads at once, since chunks may be loaded by
+ *   the server's loading thread while others are being saved or pregenerated
+ *
+ */
+
+#pragma once
+
+#ifndef BLOK_STORAGE_HH__
+#define BLOK_STORAGE_HH__
+
+// general Blok library
+#include <Blok/Blok.hh>
+
+// deltas are stored against generated chunks
+#include <Blok/WG.hh>
+
+// for the thread-safe file caches
+#include <mutex>
+#include <list>
+
+// for the background writer
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+
+// for chunk hashes
+#include <array>
+
+namespace Blok::Storage {
+
+    // Storage - abstract class describing a place chunks can be saved to and loaded from
+    class Storage {
+        public:
+
+        virtual ~Storage() {
+            // do nothing by default, so that C++ is okay with virtual destructors on abstract classes
+        }
+
+        // return whether a chunk has been saved
+        virtual bool hasChunk(ChunkID id) = 0;
+
+        // load a chunk, returning a newly allocated chunk, or NULL if it has not been saved
+        // NOTE: the caller is responsible for deleting the returned chunk
+        virtual Chunk* loadChunk(ChunkID id) = 0;
+
+        // save a chunk, replacing any previous version of it, and returning whether it was successful
+        virtual bool saveChunk(Chunk* chunk) = 0;
+
+        // return the IDs of all the chunks that have been saved
+        virtual List<ChunkID> listChunks() = 0;
+
+        // make sure everything that has been saved is durable (i.e. written to disk), returning whether
+        //   it is (if not, the errors have been logged)
+        virtual bool sync() {
+            // do nothing by default
+            return true;
+        }
+
+    };
+
+
+    // DirStorage - stores each chunk as a separate file (`c.X.Z.blk`) inside a directory,
+    //   which is simple, but means lots of small files for large worlds
+    // See the file `storage/Dir.cc` for the implementation
+    class DirStorage : public Storage {
+        public:
+
+        // the directory the chunk files are kept in
+        String path;
+
+        // construct a storage in a given directory, creating it if it doesn't exist
+        DirStorage(const String& path);
+
+        // return whether a chunk has been saved
+        bool hasChunk(ChunkID id);
+
+        // load a chunk from its file
+        Chunk* loadChunk(ChunkID id);
+
+        // save a chunk to its file
+        bool saveChunk(Chunk* chunk);
+
+        // list the chunk files in the directory
+        List<ChunkID> listChunks();
+
+        // sync the directory (each chunk file is synced as it is saved)
+        bool sync();
+
+        private:
+
+        // get the file name for a given chunk
+        String getFileName(ChunkID id);
+
+    };
+
+
+    // RegionStorage - stores chunks in region files (`r.RX.RZ.blr`) of REGION_SIZE*REGION_SIZE chunks each,
+    //   so large worlds need few files, and each chunk is compressed with zlib
+    // Each region file starts with a header, which holds a table of where each chunk is (in SECTOR_SIZE
+    //   sectors) and how large it is. Chunks are always written to free sectors before the table is updated,
+    //   so a crash while saving leaves the old copy of the chunk
+    // A small number of region files are kept open (least recently used are closed first), so loading
+    //   a chunk is normally a single read, with no opens or seeks
+    // See the file `storage/Region.cc` for the implementation
+    class RegionStorage : public Storage {
+        public:
+
+        // the number of chunks (along X and Z) in each region
+        static const int REGION_SIZE = 32;
+
+        // the size (in bytes) of the sectors that chunks are stored in
+        static const int SECTOR_SIZE = 4096;
+
+        // the bit of a chunk's size (in the table) which is set if its entities are stored after the
+        //   encoded blocks, followed by the size of the entity data (as a uint32_t)
+        static const uint32_t ENTITY_FLAG = 0x80000000;
+
+        // the directory the region files are kept in
+        String path;
+
+        // the maximum number of region files that are kept open
+        int capacity;
+
+        // the zlib compression level used when saving (0 through 9)
+        int level;
+
+        // the format of the chunk data in the files, which is written in the header of each file, so that
+        //   files from a different kind of region storage are never misread (see `WorldFormat`)
+        uint32_t format;
+
+        // statistics about the storage, which are updated atomically with the storage itself
+        struct {
+
+            // the number of chunks loaded & saved
+            uint64_t n_loads, n_saves;
+
+            // the number of bytes of chunk data before and after compression (for saved chunks)
+            uint64_t n_raw, n_compressed;
+
+            // the number of times a region file had to be opened
+            uint64_t n_opens;
+
+        } stats;
+
+        // construct a storage in a given directory (creating it if it doesn't exist), keeping up to
+        //   'capacity' region files open at once
+        RegionStorage(const String& path, int capacity=16);
+
+        // close all region files
+        ~RegionStorage();
+
+        // return whether a chunk has been saved
+        bool hasChunk(ChunkID id);
+
+        // load a chunk from its region
+        Chunk* loadChunk(ChunkID id);
+
+        // save a chunk to its region
+        bool saveChunk(Chunk* chunk);
+
+        // list the chunks in the tables of every region file in the directory
+        List<ChunkID> listChunks();
+
+        // flush all open region files to disk (files are also flushed when they are closed)
+        bool sync();
+
+        // close all open region files, and ask the OS to drop them from its page cache, so the next loads
+        //   come from the disk (this is mainly for benchmarking)
+        void dropCache();
+
+        protected:
+
+        // Region - a single open region file
+        struct Region {
+
+            // the region coordinates (i.e. chunk coordinates divided by REGION_SIZE)
+            int RX, RZ;
+
+            // the file descriptor of the open file
+            int fd;
+
+            // the table of chunks, indexed by REGION_SIZE * local X + local Z, giving the first sector
+            //   (0 if the chunk has not been saved) and the size in bytes, possibly with ENTITY_FLAG set
+            // NOTE: a chunk that was saved with no data (see 'encode()') has a size of 0, and EMPTY_SECTOR
+            uint32_t table[REGION_SIZE * REGION_SIZE][2];
+
+            // which sectors of the file are in use (by the header or a chunk)
+            List<bool> used;
+
+            // the file mapped into memory (see `MMapStorage`), or NULL if it is not mapped
+            uint8_t* map;
+
+            // the number of threads currently using the region (it is only closed when this is 0)
+            int users;
+
+            // this mutex controls access to the file, 'table' and 'used'
+            std::mutex L_region;
+
+        };
+
+        // this mutex controls access to the open regions and statistics
+        std::mutex L_regions;
+
+        // encode a chunk into the data that is stored in the file, returning whether it was successful
+        // By default, this is the zlib compressed 'blocks' array
+        // If 'out' is left empty, the chunk is saved without using any sectors (so it still counts as
+        //   saved), and it is decoded from no data at all
+        virtual bool encode(Chunk* chunk, List<uint8_t>& out);
+
+        // decode the data stored in the file into 'chunk', returning whether it was successful
+        virtual bool decode(const uint8_t* data, uint32_t size, Chunk* chunk);
+
+        // decode a whole stored chunk, whose 'size' is from the table (so it may have ENTITY_FLAG set),
+        //   into its blocks (with 'decode()') and entities
+        // Only the blocks have to be valid: if the entities are corrupt, a warning is given and the
+        //   chunk is left without any
+        bool decodeStored(const uint8_t* data, uint32_t size, Chunk* chunk);
+
+        // the open regions, with the most recently used at the front
+        std::list<Region*> lru;
+
+        // lookup from region coordinates to their place in 'lru'
+        Map<Pair<int, int>, std::list<Region*>::iterator> regions;
+
+        // get the file name for a given region
+        String getFileName(int RX, int RZ);
+
+        // return the open region containing a chunk (opening it if needed), which must be released with
+        //   'release()'. If the file doesn't exist, it is created if 'create' is true, otherwise NULL
+        //   is returned
+        Region* acquire(ChunkID id, bool create);
+
+        // stop using a region
+        void release(Region* region);
+
+        // close a region file
+        void close(Region* region);
+
+        // release anything a derived storage attached to a region (i.e. its mapping), before the file is
+        //   closed or dropped from the page cache
+        // NOTE: this isn't called for the regions still open when `RegionStorage` is destroyed, so derived
+        //   storages should release them in their own destructor
+        virtual void unmap(Region* /*region*/) {
+            // nothing is attached by default
+        }
+
+        // return the index of a chunk within its region's table
+        static int getTableIndex(ChunkID id);
+
+    };
+
+
+    // MMapStorage - a region storage that keeps chunks uncompressed, and maps the files into memory, so
+    //   loading a chunk decodes it straight from the page cache into `Chunk::blocks`, without any reads
+    //   into intermediate buffers
+    // Each 16 block high section of a chunk is stored as either a single block (if it is all the same,
+    //   which is common for air and stone), a palette and packed 1/2/4/8 bit indices, or the raw blocks,
+    //   whichever is smallest. So, files are larger than `RegionStorage`'s, but loading never inflates
+    // See the file `storage/MMap.cc` for the implementation
+    class MMapStorage : public RegionStorage {
+        public:
+
+        // the number of bytes of address space reserved for each mapped file. Files can grow up to this
+        //   without being remapped
+        static const size_t MAP_SIZE = 1ULL << 30;
+
+        // construct a storage in a given directory (creating it if it doesn't exist), keeping up to
+        //   'capacity' region files open (and mapped) at once
+        MMapStorage(const String& path, int capacity=16);
+
+        // unmap all region files
+        ~MMapStorage();
+
+        // load a chunk from the mapped region
+        Chunk* loadChunk(ChunkID id);
+
+        protected:
+
+        // unmap a region file, if it is mapped
+        void unmap(Region* region);
+
+        // encode a chunk into palette sections
+        bool encode(Chunk* chunk, List<uint8_t>& out);
+
+        // decode palette sections into a chunk
+        bool decode(const uint8_t* data, uint32_t size, Chunk* chunk);
+
+    };
+
+
+    // DeltaStorage - a region storage that only stores the blocks which differ from what the world
+    //   generator gives for the chunk (i.e. the edits made to it), so chunks that have never been edited
+    //   take no space at all (other than their table entry), and are just generated again when they are
+    //   loaded. Since they are still saved, they are never passed back through 'WG::getChunk()', so their
+    //   features aren't spilled into their neighbours a second time
+    // Each chunk is stored as the generator's version tag (see `WG::getVersionTag()`), and runs of changed
+    //   blocks. If the tag doesn't match when loading, the chunk is rejected (rather than the edits being
+    //   applied to different terrain)
+    // NOTE: the chunk is compared against 'WG::getBaseChunk()', so saving & loading cost a generation
+    // See the file `storage/Delta.cc` for the implementation
+    class DeltaStorage : public RegionStorage {
+        public:
+
+        // the generator that chunks are compared against (which is not owned by the storage)
+        WG::WG* gen;
+
+        // construct a storage in a given directory (creating it if it doesn't exist), for chunks
+        //   from a given generator
+        DeltaStorage(const String& path, WG::WG* gen, int capacity=16);
+
+        protected:
+
+        // encode the differences between a chunk and the generated one
+        bool encode(Chunk* chunk, List<uint8_t>& out);
+
+        // generate the chunk, and apply the differences
+        bool decode(const uint8_t* data, uint32_t size, Chunk* chunk);
+
+    };
+
+
+    // WriteBehind - wraps another storage, so that saving a chunk only takes a snapshot of it, and a
+    //   background thread writes the snapshots to the inner storage
+    // If a chunk is saved again before its snapshot is written, the new snapshot replaces the old one (so
+    //   it is only written once). Loads see the latest snapshot, even if it hasn't been written yet
+    // See the file `storage/WriteBehind.cc` for the implementation
+    class WriteBehind : public Storage {
+        public:
+
+        // FsyncPolicy - when the inner storage is synced to disk
+        enum FsyncPolicy {
+
+            // only when 'sync()' is called
+            FSYNC_NONE = 0,
+
+            // after every batch of writes
+            FSYNC_BATCH,
+
+            // after a batch, if it has been at least 'fsyncInterval' seconds since the last one
+            FSYNC_INTERVAL,
+
+        };
+
+        // the storage that chunks are actually written to
+        // NOTE: this is owned by the write-behind, and is freed when it is
+        Storage* inner;
+
+        // the current fsync policy
+        FsyncPolicy fsyncPolicy;
+
+        // the minimum time (in seconds) between syncs, for FSYNC_INTERVAL
+        double fsyncInterval;
+
+        // the maximum number of chunks written per batch
+        int maxBatch;
+
+        // statistics about the writer, which are updated atomically with the queue
+        struct {
+
+            // the number of snapshots taken (i.e. calls to 'saveChunk()')
+            uint64_t n_saves;
+
+            // the number of snapshots that replaced one which had not been written yet
+            uint64_t n_coalesced;
+
+            // the number of chunks written to 'inner', and how many batches they were written in
+            uint64_t n_writes, n_batches;
+
+            // the number of times 'inner' was synced
+            uint64_t n_syncs;
+
+            // the largest the queue has been
+            int max_depth;
+
+            // the total time spent writing & syncing (in seconds)
+            double t_writes;
+
+        } stats;
+
+        // construct a write-behind for a storage (which it takes ownership of), and start the writer thread
+        WriteBehind(Storage* inner, FsyncPolicy fsyncPolicy=FSYNC_INTERVAL, double fsyncInterval=5.0);
+
+        // write everything that is queued, stop the writer thread, and free 'inner'
+        ~WriteBehind();
+
+        // return whether a chunk has been saved (or is queued to be)
+        bool hasChunk(ChunkID id);
+
+        // load a chunk, from the queue if it has a snapshot waiting
+        Chunk* loadChunk(ChunkID id);
+
+        // queue a snapshot of a chunk to be written, and mark it as not modified
+        // NOTE: this never waits on I/O, so it always returns true (errors are logged by the writer, and
+        //   reported by the next 'sync()')
+        bool saveChunk(Chunk* chunk);
+
+        // queue a chunk to be written, taking ownership of it rather than copying it (i.e. when it is
+        //   being unloaded)
+        void saveAndFree(Chunk* chunk);
+
+        // list the chunks in 'inner', and those queued to be written
+        List<ChunkID> listChunks();
+
+        // retry the writes that failed, wait until everything queued so far is written, and then sync
+        //   'inner', returning whether every write (and the sync) succeeded
+        bool sync();
+
+        // wait until a single chunk has no write queued or in progress (other chunks may still be queued)
+        void wait(ChunkID id);
+
+        // return the number of chunks waiting to be written (including the batch being written)
+        int getQueueDepth();
+
+        // return the average number of chunks written per second spent writing
+        double getWriteRate();
+
+        private:
+
+        // this mutex controls access to the queue and statistics
+        std::mutex L_queue;
+
+        // signaled when chunks are queued, or the writer should stop
+        std::condition_variable C_queued;
+
+        // signaled when the writer finishes a batch
+        std::condition_variable C_written;
+
+        // the snapshots waiting to be written
+        Map<ChunkID, Chunk*> queued;
+
+        // the snapshots in the batch currently being written
+        Map<ChunkID, Chunk*> writing;
+
+        // the snapshots whose writes failed, which are kept (and loaded from) until they are written by
+        //   the next 'sync()', or replaced by a newer snapshot
+        Map<ChunkID, Chunk*> failed;
+
+        // whether the writer thread should keep running
+        bool running;
+
+        // the time of the last sync of 'inner'
+        double lastSync;
+
+        // the writer thread
+        std::thread T_writer;
+
+        // queue a snapshot, with 'L_queue' held
+        void enqueue(Chunk* snapshot);
+
+        // the target of 'T_writer'
+        void T_writer_run();
+
+    };
+
+
+    // Journal - an append-only log of block edits, so edits are durable long before the chunks they
+    //   are in are saved
+    // Edits are buffered by 'append()', and a background thread writes them as a single batch (with a
+    //   CRC32 of its contents) and syncs the file every 'commitInterval' seconds (i.e. a group commit),
+    //   so a crash loses at most that much. On startup, 'replay()' returns all the committed edits, which
+    //   should be applied and saved to the storage before calling 'reset()'
+    // Every so often (see 'needsCompaction()'), the journal should be compacted by:
+    //   1. calling 'rotate()', which moves the current journal aside and starts a new one
+    //   2. saving all the chunks it returns, and syncing the storage
+    //   3. calling 'finishCompaction()', which removes the old journal
+    // If there is a crash in between, the old journal is still replayed on the next startup
+    // See the file `storage/Journal.cc` for the implementation
+    class Journal {
+        public:
+
+        // Edit - a single block edit, in world coordinates, as it is written to the file
+        struct Edit {
+
+            // the world X and Z coordinates of the block
+            int32_t x, z;
+
+            // the Y coordinate of the block
+            uint16_t y;
+
+            // the block it was set to
+            uint8_t id, meta;
+
+        };
+
+        // the file the journal is written to (the old journal, during compaction, is this with '.old' added)
+        String path;
+
+        // how often (in seconds) buffered edits are committed
+        double commitInterval;
+
+        // compact once the journal is this large (in bytes)...
+        size_t compactSize;
+
+        // ...or has had edits in it for this long (in seconds)
+        double compactInterval;
+
+        // statistics about the journal, which are updated with the file locked
+        struct {
+
+            // the number of edits committed, and how many batches they were committed in
+            uint64_t n_edits, n_batches;
+
+            // the number of bytes written
+            uint64_t n_bytes;
+
+            // the number of compactions that were started
+            uint64_t n_compactions;
+
+            // the total time spent writing & syncing batches (in seconds)
+            double t_commits;
+
+        } stats;
+
+        // open a journal (creating it if it doesn't exist), and start the commit thread
+        // NOTE: nothing is truncated, so any existing edits can still be replayed
+        Journal(const String& path, double commitInterval=0.05);
+
+        // commit anything buffered, stop the commit thread, and close the file
+        ~Journal();
+
+        // record that a block was set (this only buffers it; it is durable after the next commit)
+        void append(vec3i pos, BlockData val);
+
+        // write & sync everything buffered so far, right now
+        void commit();
+
+        // read all the edits that were committed (the old journal's first), in the order they were made
+        // Reading stops at the first batch that is torn or corrupt, since nothing after it was committed
+        List<Edit> replay();
+
+        // remove all edits (i.e. once everything replayed has been saved)
+        void reset();
+
+        // return whether the journal is due to be compacted
+        bool needsCompaction();
+
+        // commit everything, move the journal aside, and return the chunks edited since the last
+        //   compaction. Those chunks should then be saved and synced, and 'finishCompaction()' called
+        // If the last compaction never finished, the journal is added to the end of the old one, and the
+        //   chunks edited in both are returned
+        Set<ChunkID> rotate();
+
+        // remove the old journal, once the chunks 'rotate()' returned are durable
+        void finishCompaction();
+
+        private:
+
+        // this mutex controls access to the buffered edits
+        std::mutex L_pending;
+
+        // this mutex controls access to the file, statistics, and affected chunks, and is always
+        //   taken before 'L_pending'
+        std::mutex L_file;
+
+        // the edits that have not been committed
+        List<Edit> pending;
+
+        // the chunks that have been edited since the last compaction
+        Set<ChunkID> affected;
+
+        // the file descriptor of the journal (or -1 if it couldn't be opened)
+        int fd;
+
+        // the current size of the journal (in bytes)
+        size_t size;
+
+        // the time the first edit since the last compaction was committed (or < 0 if there are none)
+        double firstEditTime;
+
+        // the earliest time to try compacting again, after 'rotate()' couldn't move the journal
+        double retryTime;
+
+        // whether the last 'rotate()' moved the journal aside
+        bool rotated;
+
+        // whether the commit thread should keep running (which it checks without any lock held)
+        std::atomic<bool> running;
+
+        // the commit thread
+        std::thread T_commit;
+
+        // open 'path' for appending, with 'L_file' held
+        void open();
+
+        // write & sync everything buffered, with 'L_file' held
+        void commitLocked();
+
+        // read the committed edits from a single file into 'res', returning the size of the valid part of it
+        size_t replayFile(const String& fname, List<Edit>& res);
+
+        // add the journal to the end of the old one (whose valid part is 'oldSize' bytes), and empty it,
+        //   with 'L_file' held
+        bool appendOld(const String& old, size_t oldSize);
+
+        // the target of 'T_commit'
+        void T_commit_run();
+
+    };
+
+
+    // Snapshots - wraps another storage, and takes point-in-time copies of everything in it (i.e. backups),
+    //   which share the data of chunks that haven't changed between them
+    // Each chunk is kept once, as a blob named after the SHA-256 of its blocks (`blobs/XX/HASH`), and a
+    //   snapshot (`snapshots/NAME.bls`) is just a table of chunk IDs and their hashes. So, taking a snapshot
+    //   only writes the chunks that were saved since the last one (and only if no blob has the same blocks
+    //   already), along with the table
+    // The first snapshot after starting reads & hashes every saved chunk, since chunks may have been saved
+    //   while this wasn't tracking them. Still, only blobs that don't exist yet are written
+    // See the file `storage/Snapshot.cc` for the implementation
+    class Snapshots : public Storage {
+        public:
+
+        // Hash - the SHA-256 of a chunk's blocks
+        using Hash = std::array<uint8_t, 32>;
+
+        // the storage that chunks are actually saved to
+        // NOTE: this is owned by the snapshots, and is freed when it is
+        Storage* inner;
+
+        // the directory the blobs and snapshot tables are kept in
+        String path;
+
+        // statistics about the snapshots, which are updated with 'L_take' held
+        struct {
+
+            // the number of snapshots taken
+            uint64_t n_snapshots;
+
+            // the number of chunks read (and hashed) while taking them
+            uint64_t n_chunks;
+
+            // the number of new blobs written, and their size (in bytes, compressed)
+            uint64_t n_blobs, n_bytes;
+
+            // the total time spent taking snapshots (in seconds)
+            double t_snapshots;
+
+        } stats;
+
+        // construct snapshots of a storage (which it takes ownership of), kept in the directory 'path'
+        //   (creating it if it doesn't exist)
+        Snapshots(Storage* inner, const String& path);
+
+        // free 'inner'
+        ~Snapshots();
+
+        // return whether a chunk has been saved in 'inner'
+        bool hasChunk(ChunkID id);
+
+        // load a chunk from 'inner'
+        Chunk* loadChunk(ChunkID id);
+
+        // save a chunk to 'inner', and remember that it has changed since the last snapshot
+        bool saveChunk(Chunk* chunk);
+
+        // list the chunks in 'inner'
+        List<ChunkID> listChunks();
+
+        // sync 'inner'
+        bool sync();
+
+        // take a snapshot of everything in 'inner', returning its name (the UTC time it was taken, like
+        //   '20201231-235959'), or an empty string if it failed
+        // NOTE: only what has been saved (and synced, if 'inner' writes behind) is included, so the server
+        //   should save its modified chunks first
+        String take();
+
+        // return the names of all the snapshots, oldest first
+        List<String> list();
+
+        // save every chunk of a snapshot to 'dest' and sync it, returning whether it was successful
+        // Unless 'overwrite' is true, nothing is restored if 'dest' has any chunks saved in it already (if
+        //   it is, chunks that aren't in the snapshot are left as they are)
+        bool restore(const String& name, Storage* dest, bool overwrite=false);
+
+        // remove all but the newest 'keep' snapshots, and any blobs that are no longer used by the rest,
+        //   returning the number of blobs removed
+        int prune(int keep);
+
+        private:
+
+        // this mutex makes sure only one snapshot is taken (or restored, or pruned) at once, and
+        //   controls access to 'table' and the statistics
+        std::mutex L_take;
+
+        // this mutex controls access to 'changed' and 'full'
+        std::mutex L_changed;
+
+        // the chunks that have been saved since the last snapshot
+        Set<ChunkID> changed;
+
+        // whether the next snapshot needs to check every chunk (i.e. it is the first since starting)
+        bool full;
+
+        // the table of the latest snapshot
+        Map<ChunkID, Hash> table;
+
+        // get the file name of a blob
+        String getBlobName(const Hash& hash);
+
+        // get the file name of a snapshot's table
+        String getTableName(const String& name);
+
+        // read a snapshot's table into 'res', returning whether it was successful
+        bool readTable(const String& name, Map<ChunkID, Hash>& res);
+
+        // write a snapshot's table, returning whether it was successful
+        bool writeTable(const String& name, const Map<ChunkID, Hash>& tab);
+
+    };
+
+
+    /* CHUNK CODECS */
+
+    // Codec - a way of turning the blocks of a chunk into bytes (i.e. to write them to a file, or send
+    //   them over the network) and back again
+    // Codecs encode into a buffer with room for at least 'getBound()' bytes, and decode straight into
+    //   a chunk's 'blocks', so nothing is allocated per block (or per chunk, if the buffer is reused)
+    // See the file `storage/Codec.cc` for the implementations
+    class Codec {
+        public:
+
+        // the name of the codec, i.e. for printing benchmarks
+        String name;
+
+        virtual ~Codec() {}
+
+        // return the most bytes that 'encode()' can write
+        virtual size_t getBound() = 0;
+
+        // encode CHUNK_NUM_BLOCKS blocks (in the same XZY order as `Chunk::blocks`) into 'out', returning
+        //   the number of bytes written, or 0 if it failed
+        virtual size_t encode(const BlockData* blocks, uint8_t* out) = 0;
+
+        // decode 'size' bytes written by 'encode()' into CHUNK_NUM_BLOCKS blocks, returning whether they
+        //   were valid
+        virtual bool decode(const uint8_t* data, size_t size, BlockData* blocks) = 0;
+
+    };
+
+    // RawCodec - the blocks as they are in memory, which is as fast as a copy, but the largest
+    class RawCodec : public Codec {
+        public:
+
+        RawCodec();
+
+        size_t getBound();
+        size_t encode(const BlockData* blocks, uint8_t* out);
+        bool decode(const uint8_t* data, size_t size, BlockData* blocks);
+
+    };
+
+    // ColumnRLECodec - each column (which is contiguous in XZY order) is run length encoded on its own,
+    //   so the usual column of stone, then dirt, then air is only a few runs
+    class ColumnRLECodec : public Codec {
+        public:
+
+        ColumnRLECodec();
+
+        size_t getBound();
+        size_t encode(const BlockData* blocks, uint8_t* out);
+        bool decode(const uint8_t* data, size_t size, BlockData* blocks);
+
+    };
+
+    // PaletteCodec - each distinct block in the chunk is stored once (in the palette), and every block is
+    //   stored as an index into the palette, packed into as few bits as possible (1, 2, 4 or 8). Chunks with
+    //   more than 256 distinct blocks are stored raw
+    // NOTE: the indices are built in a buffer kept between calls, so each thread needs its own codec
+    class PaletteCodec : public Codec {
+        public:
+
+        PaletteCodec();
+
+        size_t getBound();
+        size_t encode(const BlockData* blocks, uint8_t* out);
+        bool decode(const uint8_t* data, size_t size, BlockData* blocks);
+
+        // pack 'count' palette indices of 'bits' bits (1, 2, 4 or 8) each into 'count * bits / 8' bytes,
+        //   from the low bits of each byte up
+        static void packIndices(int bits, const uint8_t* idx, int count, uint8_t* out);
+
+        // unpack 'size' bytes of indices written by 'packIndices()', looking each one up in 'palette'
+        //   (which must have an entry for every possible index)
+        static void unpackIndices(int bits, const uint8_t* data, int size, const BlockData* palette, BlockData* out);
+
+        private:
+
+        // the palette index of each block, while encoding
+        List<uint8_t> idx;
+
+    };
+
+    // PaletteZlibCodec - a 'PaletteCodec', with the packed indices compressed with zlib, which is the
+    //   smallest, but the slowest
+    // NOTE: the zlib streams are kept between calls (so their state isn't allocated for each chunk), so
+    //   each thread needs its own codec
+    class PaletteZlibCodec : public Codec {
+        public:
+
+        // the zlib compression level used when encoding (0 through 9)
+        int level;
+
+        PaletteZlibCodec(int level=1);
+        ~PaletteZlibCodec();
+
+        size_t getBound();
+        size_t encode(const BlockData* blocks, uint8_t* out);
+        bool decode(const uint8_t* data, size_t size, BlockData* blocks);
+
+        private:
+
+        // the zlib streams (really a 'z_stream', which is kept out of this header), or NULL if they
+        //   haven't been used yet
+        void* deflater;
+        void* inflater;
+
+        // the palette index of each block, while encoding
+        List<uint8_t> idx;
+
+    };
+
+
+    /* WORLD ARCHIVES */
+
+    // Worlds can be moved between hosts as a single archive (a tar file), rather than as a copy of many
+    //   small files. The first entry is a manifest ('WORLD_MANIFEST'), followed by every file in the
+    //   world directory, each gzip compressed on its own (i.e. `r.0.0.blr.gz`)
+    // Both are a single streaming pass, so nothing is staged on disk, and the archive can be piped
+    //   (i.e. `Blok -E - | ssh host Blok -I -`)
+    // See the file `storage/Archive.cc` for the implementation
+
+    // the name of the manifest entry in world archives
+    extern const char* WORLD_MANIFEST;
+
+    // write all the files in the world directory 'path' to the archive 'file' (or standard output, if
+    //   it is "-"), returning whether it was successful
+    // Files are compressed by 'numThreads' threads (or all cores, if <= 0) at once, and written to the
+    //   archive in order as they finish, so only a few files are held in memory at a time
+    // NOTE: nothing should be saving to the world while it is exported
+    bool exportWorld(const String& path, const String& file, int numThreads=0);
+
+    // read a world archive 'file' (or standard input, if it is "-") into the world directory 'path',
+    //   which must be empty (or not exist yet), returning whether it was successful
+    // Each file is decompressed straight into the directory as it is read
+    bool importWorld(const String& file, const String& path);
+
+
+    /* WORLD DIRECTORIES */
+
+    // WorldFormat - the ways the chunks of a world directory can be stored. For region storages, this is
+    //   the format written in the header of each file (see `RegionStorage::format`)
+    enum WorldFormat {
+
+        // nothing has been saved in the directory yet
+        WORLD_NONE = 0,
+
+        // zlib compressed chunks (see `RegionStorage`)
+        WORLD_REGION = 1,
+
+        // palette encoded sections (see `MMapStorage`)
+        WORLD_MMAP = 2,
+
+        // edits to generated chunks (see `DeltaStorage`)
+        WORLD_DELTA = 3,
+
+        // a file per chunk (see `DirStorage`), which has no region files to write this in, so it is
+        //   recognized by its chunk files instead
+        WORLD_DIR = 4,
+
+    };
+
+    // return the format that the chunks in the world directory 'path' were saved in, or WORLD_NONE if
+    //   there aren't any (or it doesn't exist)
+    WorldFormat getWorldFormat(const String& path);
+
+    // open the storage for the world directory 'path', in the format its chunks were saved in, or in
+    //   'format' if it is a new world. 'gen' is what chunks are generated with (which is not owned by the
+    //   storage, and only used by WORLD_DELTA)
+    // A world can only be read in its own format, so if that isn't 'format', a warning is given and its
+    //   own is used
+    // See the file `storage/World.cc` for the implementation
+    Storage* openWorld(const String& path, WG::WG* gen, WorldFormat format=WORLD_REGION);
+
+}
+
+
+#endif /* BLOK_STORAGE_HH__ */
@@ -8,6 +8,15 @@
  * World Generators can have internal state (i.e. caching, list of worms for cave generation, 
  *   tree generation, etc)
  * 
+ * Most generators are a `Pipeline`, which is a list of `Stage`s (i.e. terrain -> carve -> surface -> decorate)
+ *   that are registered at construction, and ran in order on each chunk. Every stage keeps its own timing
+ *   statistics, so it is easy to see where generation time goes
+ * 
+ * Features that cross chunk borders (trees, boulders, buildings) write through `GenContext::set()`. Any
+ *   writes that land outside the chunk being generated are spilled into the generator's `EditQueue`, and
+ *   applied when that neighbour is generated (or by the server, if it is already loaded). So, neighbours
+ *   are never generated just to place a feature
+ * 
  */
 
 #pragma once
@@ -21,8 +30,301 @@
 // generators use the randomness library
 #include <Blok/Random.hh>
 
+// for the thread-safe caches
+#include <mutex>
+#include <list>
+
 namespace Blok::WG {
 
+    // forward declaration
+    class WG;
+
+    // HeightCache - a thread-safe, least-recently-used cache of heightmap tiles, shared between
+    //   every thread that generates chunks from the same generator
+    // Each tile covers TILE_SIZE*TILE_SIZE columns (i.e. 4x4 chunks), and is computed at once
+    //   from `WG::calcHeight()` the first time any column in it is requested. So, neighbouring chunks
+    //   (and any feature that needs to look past the border of a chunk) can get heights without
+    //   evaluating the noise layers again
+    // See `WG/HeightCache.cc` for the implementation
+    class HeightCache {
+        public:
+
+        // the size (in blocks) of a tile along X and Z. This should be a multiple of the chunk size,
+        //   so that a chunk never straddles 2 tiles
+        static const int TILE_SIZE = 64;
+
+        // Tile - a single cached tile of column heights
+        struct Tile {
+
+            // the tile coordinates (i.e. world coordinates divided by TILE_SIZE)
+            int TX, TZ;
+
+            // the heights of each column, indexed by TILE_SIZE * x + z (local coordinates)
+            int heights[TILE_SIZE * TILE_SIZE];
+
+        };
+
+        // the generator whose `calcHeight()` fills the tiles
+        WG* gen;
+
+        // the maximum number of tiles kept. If 0, caching is disabled, and every request
+        //   goes straight to `calcHeight()`
+        int capacity;
+
+        // statistics about the cache, which are updated atomically with the cache itself
+        struct {
+
+            // the number of requests that found their tile already computed
+            uint64_t n_hits;
+
+            // the number of requests that had to compute their tile
+            uint64_t n_misses;
+
+            // the total time spent computing tiles (in seconds)
+            double t_compute;
+
+        } stats;
+
+        // construct a cache for a given generator, holding up to `capacity` tiles
+        HeightCache(WG* gen, int capacity=256);
+
+        // free all cached tiles
+        ~HeightCache();
+
+        // get the surface height of a single column, in world coordinates
+        int getHeight(int x, int z);
+
+        // fill 'heights' with the heights of every column of a chunk, indexed [x][z] (local coordinates)
+        void getChunkHeights(ChunkID id, int heights[CHUNK_SIZE_X][CHUNK_SIZE_Z]);
+
+        // return the fraction of requests that were hits (0 if there have been no requests)
+        double getHitRate();
+
+        // remove all tiles from the cache (statistics are kept)
+        void clear();
+
+        private:
+
+        // this mutex controls access to the tiles and statistics
+        std::mutex L_tiles;
+
+        // the tiles, with the most recently used at the front
+        std::list<Tile*> lru;
+
+        // lookup from tile coordinates to their place in 'lru'
+        Map<Pair<int, int>, std::list<Tile*>::iterator> tiles;
+
+        // return a locked tile containing world column (x, z), computing it if it was not present
+        // NOTE: 'L_tiles' is held when this returns, the caller must unlock it
+        Tile* lockTile(int x, int z);
+
+    };
+
+    // BiomeMap - a coarse map of the climate, and the terrain parameters blended from it
+    // The climate noise is only sampled once per CELL_SIZE*CELL_SIZE columns, and samples are cached
+    //   in regions of REGION_CELLS*REGION_CELLS cells (i.e. 4x4 chunks), in a thread-safe, least-recently-used
+    //   cache like `HeightCache`. Every column gets its parameters bilinearly interpolated from the 4
+    //   nearest samples, so the terrain changes smoothly between biomes
+    // See `WG/BiomeMap.cc` for the implementation
+    class BiomeMap {
+        public:
+
+        // the number of columns (along X and Z) per climate sample
+        static const int CELL_SIZE = 4;
+
+        // the number of cells (along X and Z) per cached region
+        static const int REGION_CELLS = 16;
+
+        // the number of columns (along X and Z) per cached region
+        static const int REGION_SIZE = CELL_SIZE * REGION_CELLS;
+
+        // Params - the terrain parameters at a point, which are blended between biomes
+        struct Params {
+
+            // the terrain height is 'offset + scale * height noise'
+            float offset, scale;
+
+        };
+
+        // Biome - a single kind of terrain, which is centered on a given climate value
+        struct Biome {
+
+            // the human readable name of the biome (i.e. "plains")
+            String name;
+
+            // the climate value (from 'climate') that this biome is fully used at
+            float center;
+
+            // the terrain parameters used
+            Params params;
+
+        };
+
+        // Region - a single cached region of climate samples
+        struct Region {
+
+            // the region coordinates (i.e. world coordinates divided by REGION_SIZE)
+            int RX, RZ;
+
+            // the parameters at each sample, indexed (REGION_CELLS + 1) * cx + cz, including the
+            //   samples along the far edges, so that every column can be interpolated within the region
+            Params samples[(REGION_CELLS + 1) * (REGION_CELLS + 1)];
+
+        };
+
+        // the noise that gives the climate, which should output values in [0, 1]
+        Random::PerlinMux climate;
+
+        // the biomes, sorted by their 'center'
+        // NOTE: changing these (or 'climate') after regions have been cached requires calling 'clear()'
+        List<Biome> biomes;
+
+        // the maximum number of regions kept. If 0, caching is disabled, and every request
+        //   samples the climate directly
+        int capacity;
+
+        // statistics about the map, which are updated atomically with the cache itself
+        struct {
+
+            // the number of requests that found their region already computed
+            uint64_t n_hits;
+
+            // the number of requests that had to compute their region
+            uint64_t n_misses;
+
+            // the number of times 'climate' has been sampled
+            uint64_t n_samples;
+
+        } stats;
+
+        // construct an empty map (with no biomes), holding up to 'capacity' regions
+        BiomeMap(int capacity=64);
+
+        // free all cached regions
+        ~BiomeMap();
+
+        // add a biome, keeping them sorted
+        void addBiome(const String& name, float center, Params params);
+
+        // get the terrain parameters at a single column, in world coordinates
+        Params getParams(int x, int z);
+
+        // fill 'out' with the terrain parameters of a w*h block of columns starting at (x0, z0), indexed
+        //   [h * x + z] (local coordinates)
+        // This only locks each region it touches once, so it is much faster than calling 'getParams()'
+        //   on each column
+        void getParams(int x0, int z0, int w, int h, Params* out);
+
+        // return the parameters for a given climate value
+        Params blend(float c);
+
+        // remove all regions from the cache (statistics are kept)
+        void clear();
+
+        private:
+
+        // this mutex controls access to the regions and statistics
+        std::mutex L_regions;
+
+        // the regions, with the most recently used at the front
+        std::list<Region*> lru;
+
+        // lookup from region coordinates to their place in 'lru'
+        Map<Pair<int, int>, std::list<Region*>::iterator> regions;
+
+        // compute the parameters at a given sample (in cell coordinates)
+        Params sample(int cx, int cz);
+
+        // return a locked region with the given region coordinates, computing it if it was not present
+        // NOTE: 'L_regions' is held when this returns, the caller must unlock it
+        Region* lockRegion(int RX, int RZ);
+
+        // interpolate the parameters for world column (x, z) from a region that contains it
+        Params interp(const Region* region, int x, int z);
+
+    };
+
+    // EditQueue - a thread-safe store of block writes that are waiting for their chunk to exist, keyed
+    //   by the chunk they belong to
+    // Chunks that are never generated (i.e. just past where anyone has been) would keep their edits
+    //   forever, so only up to 'capacity' chunks are kept, and the edits for the one least recently
+    //   queued to are dropped first
+    // See `WG/EditQueue.cc` for the implementation
+    class EditQueue {
+        public:
+
+        // Edit - a single deferred block write
+        struct Edit {
+
+            // the local coordinates within the target chunk
+            uint8_t x, y, z;
+
+            // if true, the edit is only applied if the block is still air (i.e. so that decorations
+            //   don't overwrite terrain, or anything a player has built)
+            bool ifAir;
+
+            // the block to write
+            BlockData val;
+
+        };
+
+        // statistics about the queue, which are updated atomically with the queue itself
+        struct {
+
+            // the number of edits that have been queued
+            uint64_t n_pushed;
+
+            // the number of edits that have been applied to a chunk (and were not skipped)
+            uint64_t n_applied;
+
+            // the number of edits that were dropped to stay within 'capacity'
+            uint64_t n_dropped;
+
+        } stats;
+
+        // the maximum number of chunks that edits are kept for
+        int capacity;
+
+        // construct an empty queue, holding edits for up to 'capacity' chunks
+        EditQueue(int capacity=4096);
+
+        // queue an edit for a given chunk
+        void push(ChunkID id, const Edit& edit);
+
+        // remove all edits queued for a chunk, and apply them (in the order they were queued)
+        // Returns the number of blocks that were changed
+        int apply(Chunk* chunk);
+
+        // return the IDs of all chunks that have edits waiting
+        List<ChunkID> getPending();
+
+        // return the number of chunks that have edits waiting
+        int size();
+
+        private:
+
+        // Pending - the edits waiting for a single chunk
+        struct Pending {
+
+            // the chunk they are for
+            ChunkID id;
+
+            // the edits, in the order they were queued
+            List<Edit> edits;
+
+        };
+
+        // this mutex controls access to the edits and 'stats'
+        std::mutex L_edits;
+
+        // the chunks with edits waiting, with the most recently queued to at the front
+        std::list<Pending> lru;
+
+        // lookup from chunk IDs to their place in 'lru'
+        Map<ChunkID, std::list<Pending>::iterator> edits;
+
+    };
+
     // WG - abstract class describing a world WorldGenerator
     class WG {
         public:
@@ -43,12 +345,206 @@ namespace Blok::WG {
         // the position of the given chunk is CHUNK_SIZE * cx, 0 through CHUNK_HEIGHT, CHUNK_SIZE * cz
         virtual Chunk* getChunk(ChunkID id) = 0;
 
+        // generate the 'base' of a chunk, which depends only on its ID (and the generator's settings), and
+        //   not on what has been generated before (i.e. without edits from neighbours' features)
+        // By default, generators have no state, so this is the same as 'getChunk()'
+        virtual Chunk* getBaseChunk(ChunkID id) {
+            return getChunk(id);
+        }
+
+        // return a tag identifying the output of 'getBaseChunk()', which changes whenever the output for
+        //   any chunk would (i.e. a different seed, settings, or version of the algorithm), so that data
+        //   derived from generated chunks (see `Storage::DeltaStorage`) is never used with different terrain
+        virtual uint32_t getVersionTag() {
+            return seed;
+        }
+
+        // compute the surface height of the terrain at a given world column (x, z), i.e.
+        //   the Y coordinate of the first block above the base terrain
+        // By default, there is no terrain
+        virtual int calcHeight(int /*x*/, int /*z*/) {
+            return 0;
+        }
+
+        // compute the surface heights of a w*h block of columns starting at world column (x0, z0), into
+        //   'out', indexed [h * x + z] (local coordinates)
+        // By default, this calls 'calcHeight()' on each column, but generators can override it to share work
+        //   between columns (it should give the same results, though)
+        virtual void calcHeights(int x0, int z0, int w, int h, int* out) {
+            for (int x = 0; x < w; ++x) {
+                for (int z = 0; z < h; ++z) {
+                    out[h * x + z] = calcHeight(x0 + x, z0 + z);
+                }
+            }
+        }
+
+        // return the heightmap cache used by the generator, or NULL if it doesn't have one
+        virtual HeightCache* getHeightCache() {
+            return NULL;
+        }
+
+        // return the queue of edits that generated features have spilled into other chunks, or NULL
+        //   if the generator never writes outside of the chunk being generated
+        virtual EditQueue* getEditQueue() {
+            return NULL;
+        }
+
+    };
+
+
+    // GenContext - the state of a single chunk as it passes through the stages of a `Pipeline`
+    struct GenContext {
+
+        // the ID of the chunk being generated
+        ChunkID id;
+
+        // the chunk being generated, which each stage modifies in place
+        Chunk* chunk;
+
+        // the surface height of each column (indexed [x][z]), which is filled in by
+        //   whichever stage computes the base terrain, so that later stages can use it
+        int heights[CHUNK_SIZE_X][CHUNK_SIZE_Z];
+
+        // where writes outside of 'chunk' are sent (if NULL, they are dropped)
+        EditQueue* pending;
+
+        // construct a context for generating a chunk
+        GenContext(ChunkID id, Chunk* chunk, EditQueue* pending=NULL) {
+            this->id = id;
+            this->chunk = chunk;
+            this->pending = pending;
+            memset(heights, 0, sizeof(heights));
+        }
+
+        // set a block in world coordinates, which may be outside of the chunk being generated (in which
+        //   case it is queued in 'pending' for the chunk it belongs to)
+        // If 'ifAir' is true, the block is only written if it is still air
+        void set(int x, int y, int z, BlockData val, bool ifAir=false);
+
+    };
+
+
+    // Stage - abstract class describing a single step of a `Pipeline`, which modifies
+    //   a chunk that is being generated
+    class Stage {
+        public:
+
+        // the human readable name of the stage (i.e. "terrain", "carve")
+        String name;
+
+        // a structure describing statistics of performance
+        struct {
+
+            // the number of chunks this stage has been applied to
+            int n_chunks;
+
+            // the total time spent in this stage
+            double t_chunks;
+
+        } stats;
+
+        // construct a stage with a given name
+        Stage(const String& name) {
+            this->name = name;
+
+            // initialize statistics to nothing
+            stats.n_chunks = 0;
+            stats.t_chunks = 0.0;
+        }
+
+        virtual ~Stage() {
+            // do nothing by default, so that C++ is okay with virtual destructors on abstract classes
+        }
+
+        // apply the stage to a chunk being generated
+        virtual void apply(GenContext& ctx) = 0;
+
+        // apply the stage, and record how long it took into 'stats'
+        void run(GenContext& ctx) {
+            double stime = getTime();
+            apply(ctx);
+            stime = getTime() - stime;
+
+            L_stats.lock();
+            stats.n_chunks++;
+            stats.t_chunks += stime;
+            L_stats.unlock();
+        }
+
+        // return the average time (in seconds) spent per chunk
+        double getTimePerChunk() {
+            L_stats.lock();
+            double res = stats.n_chunks == 0 ? 0.0 : stats.t_chunks / stats.n_chunks;
+            L_stats.unlock();
+            return res;
+        }
+
+        private:
+
+        // this mutex controls access to 'stats', since multiple threads may be generating at once
+        std::mutex L_stats;
+
+    };
+
+
+    // Pipeline - a world generator made from a list of stages, which are applied in order to
+    //   an empty chunk
+    // See the file `WG/Pipeline.cc` for the implementation
+    class Pipeline : public WG {
+        public:
+
+        // the stages, in the order they are applied
+        // NOTE: these are owned by the pipeline, and are freed when it is
+        List<Stage*> stages;
+
+        // edits that stages have made outside of the chunk they were generating
+        EditQueue pending;
+
+        // construct an (empty) pipeline
+        Pipeline(uint32_t seed=0) : WG(seed) {
+            stages = {};
+        }
+
+        // free all the stages
+        ~Pipeline();
+
+        // add a stage to the end of the pipeline, which takes ownership of it
+        void addStage(Stage* stage) {
+            stages.push_back(stage);
+        }
+
+        // return the stage with a given name, or NULL if there is none
+        Stage* getStage(const String& name);
+
+        // generate a chunk by running all the stages, and then applying any edits that neighbours have
+        //   already queued for it
+        Chunk* getChunk(ChunkID id);
+
+        // generate a chunk by running all the stages, without sending edits to (or taking edits from) neighbours
+        Chunk* getBaseChunk(ChunkID id);
+
+        // return the queue of edits
+        EditQueue* getEditQueue() {
+            return &pending;
+        }
+
+        private:
+
+        // run the stages on a new chunk, sending edits outside of it to 'spill' (which may be NULL)
+        Chunk* generate(ChunkID id, EditQueue* spill);
+
     };
 
 
     // DefaultWG - the default world generator used by Blok.
+    // It is made up of these stages:
+    //   * "terrain": fills stone up to the height given by 'pmgen', scaled by the biome parameters
+    //       from 'biomes'
+    //   * "surface": covers the stone with dirt and grass
+    //   * "carve": removes caves using 3D noise from 'cavegen'
+    //   * "decorate": scatters stone boulders on the surface, which may cross into neighbouring chunks
     // See the file `WG/Default.cc` for the implmentation
-    class DefaultWG : public WG {
+    class DefaultWG : public Pipeline {
         public:
 
         // perlin noise generator
@@ -57,19 +553,38 @@ namespace Blok::WG {
         // cave generator
         Random::PerlinMux cavegen;
 
+        // the biomes, which give the terrain parameters
+        BiomeMap biomes;
+
+        // cache of heights computed from 'pmgen' and 'biomes'
+        HeightCache heightCache;
+
         // construct given a seed
         DefaultWG(uint32_t seed=0);
 
-        // generate a chunk from a given ChunkID
-        Chunk* getChunk(ChunkID id);
+        // compute the height of the stone layer at a given column
+        int calcHeight(int x, int z);
+
+        // compute the height of the stone layer at a block of columns, looking up the biome
+        //   parameters all at once
+        void calcHeights(int x0, int z0, int w, int h, int* out);
+
+        // return the heightmap cache
+        HeightCache* getHeightCache() {
+            return &heightCache;
+        }
+
+        // return a tag of the seed and version of the generator
+        uint32_t getVersionTag();
 
     };
 
 
     // FlatWG - a 'flat' world generator, with constant, unchanging layers, which can be set by
-    // "addLayer()", so the random seed does nothing
+    // modifying 'layers', so the random seed does nothing
+    // It is made up of a single "layers" stage
     // See the file `WG/Flat.cc` for the implmentation
-    class FlatWG : public WG {
+    class FlatWG : public Pipeline {
         public:
 
         // list of blockID's and size of the layers, starting from the floor
@@ -78,8 +593,11 @@ namespace Blok::WG {
         // construct given a seed (seed is never used)
         FlatWG(uint32_t seed=0);
 
-        // generate a chunk from a given ChunkID
-        Chunk* getChunk(ChunkID id);
+        // compute the height of the top layer
+        int calcHeight(int x, int z);
+
+        // return a tag of the layers
+        uint32_t getVersionTag();
 
     };
 
@@ -0,0 +1,210 @@
+/* WG/BiomeMap.cc - implementation of the coarse biome map used to vary terrain
+ *
+ * Like `HeightCache`, regions are computed outside of the lock, and if 2 threads happen to compute
+ *   the same region, the first one inserted wins
+ *
+ */
+
+// include the world generator protocol
+#include <Blok/WG.hh>
+
+namespace Blok::WG {
+
+// a region should line up with the heightmap tiles, so computing a tile only needs 1 region
+static_assert(HeightCache::TILE_SIZE % BiomeMap::REGION_SIZE == 0, "HeightCache::TILE_SIZE must be a multiple of BiomeMap::REGION_SIZE");
+
+// bilinearly interpolate parameters at the 4 corners of a cell
+static inline BiomeMap::Params lerp4(const BiomeMap::Params& p00, const BiomeMap::Params& p10, const BiomeMap::Params& p01, const BiomeMap::Params& p11, float tx, float tz) {
+    float w00 = (1 - tx) * (1 - tz), w10 = tx * (1 - tz), w01 = (1 - tx) * tz, w11 = tx * tz;
+    BiomeMap::Params res;
+    res.offset = w00 * p00.offset + w10 * p10.offset + w01 * p01.offset + w11 * p11.offset;
+    res.scale = w00 * p00.scale + w10 * p10.scale + w01 * p01.scale + w11 * p11.scale;
+    return res;
+}
+
+// construct an empty map
+BiomeMap::BiomeMap(int capacity) {
+    this->capacity = capacity;
+
+    // initialize statistics to nothing
+    stats.n_hits = 0;
+    stats.n_misses = 0;
+    stats.n_samples = 0;
+}
+
+// free all the regions
+BiomeMap::~BiomeMap() {
+    clear();
+}
+
+// remove all regions
+void BiomeMap::clear() {
+    L_regions.lock();
+    for (Region* region : lru) {
+        delete region;
+    }
+    lru.clear();
+    regions.clear();
+    L_regions.unlock();
+}
+
+// add a biome
+void BiomeMap::addBiome(const String& name, float center, Params params) {
+    Biome biome;
+    biome.name = name;
+    biome.center = center;
+    biome.params = params;
+
+    // insert it sorted by center
+    auto it = biomes.begin();
+    while (it != biomes.end() && it->center <= center) ++it;
+    biomes.insert(it, biome);
+}
+
+// blend the parameters of the 2 biomes closest to a climate value
+BiomeMap::Params BiomeMap::blend(float c) {
+    if (biomes.size() == 0) {
+        // no biomes, so use the noise as it is
+        Params res;
+        res.offset = 0.0f;
+        res.scale = 1.0f;
+        return res;
+    }
+
+    if (c <= biomes[0].center) return biomes[0].params;
+    if (c >= biomes.back().center) return biomes.back().params;
+
+    int i = 0;
+    while (c >= biomes[i + 1].center) ++i;
+
+    // smooth the transition, so each biome has a plateau around its center
+    float t = (c - biomes[i].center) / (biomes[i + 1].center - biomes[i].center);
+    t = t * t * (3 - 2 * t);
+
+    Params res;
+    res.offset = biomes[i].params.offset + t * (biomes[i + 1].params.offset - biomes[i].params.offset);
+    res.scale = biomes[i].params.scale + t * (biomes[i + 1].params.scale - biomes[i].params.scale);
+    return res;
+}
+
+// compute the parameters at a sample
+BiomeMap::Params BiomeMap::sample(int cx, int cz) {
+    return blend(climate.noise2d(CELL_SIZE * cx, CELL_SIZE * cz));
+}
+
+// find (or compute) a region, returning with 'L_regions' held
+BiomeMap::Region* BiomeMap::lockRegion(int RX, int RZ) {
+    Pair<int, int> key = { RX, RZ };
+
+    L_regions.lock();
+
+    auto it = regions.find(key);
+    if (it != regions.end()) {
+        // hit, so just move it to the front of the LRU list
+        stats.n_hits++;
+        lru.splice(lru.begin(), lru, it->second);
+        return *it->second;
+    }
+
+    stats.n_misses++;
+    L_regions.unlock();
+
+    // compute the region without holding the lock
+    Region* region = new Region();
+    region->RX = RX;
+    region->RZ = RZ;
+
+    for (int cx = 0; cx <= REGION_CELLS; ++cx) {
+        for (int cz = 0; cz <= REGION_CELLS; ++cz) {
+            region->samples[(REGION_CELLS + 1) * cx + cz] = sample(REGION_CELLS * RX + cx, REGION_CELLS * RZ + cz);
+        }
+    }
+
+    L_regions.lock();
+    stats.n_samples += (REGION_CELLS + 1) * (REGION_CELLS + 1);
+
+    it = regions.find(key);
+    if (it != regions.end()) {
+        // another thread beat us to it, so use theirs
+        delete region;
+        lru.splice(lru.begin(), lru, it->second);
+        return *it->second;
+    }
+
+    // insert it as the most recently used
+    lru.push_front(region);
+    regions[key] = lru.begin();
+
+    // evict the least recently used regions (never the one we just added)
+    while ((int)lru.size() > capacity && lru.size() > 1) {
+        Region* old = lru.back();
+        regions.erase({ old->RX, old->RZ });
+        lru.pop_back();
+        delete old;
+    }
+
+    return region;
+}
+
+// interpolate the parameters of a column within a region
+BiomeMap::Params BiomeMap::interp(const Region* region, int x, int z) {
+    int lx = x - REGION_SIZE * region->RX, lz = z - REGION_SIZE * region->RZ;
+    int cx = lx / CELL_SIZE, cz = lz / CELL_SIZE;
+    float tx = (float)(lx - CELL_SIZE * cx) / CELL_SIZE, tz = (float)(lz - CELL_SIZE * cz) / CELL_SIZE;
+
+    const Params* s = &region->samples[(REGION_CELLS + 1) * cx + cz];
+    return lerp4(s[0], s[REGION_CELLS + 1], s[1], s[REGION_CELLS + 2], tx, tz);
+}
+
+// get the parameters at a single column
+BiomeMap::Params BiomeMap::getParams(int x, int z) {
+    if (capacity <= 0) {
+        // caching is disabled, so just sample the 4 corners of the cell
+        int cx = floorDiv(x, CELL_SIZE), cz = floorDiv(z, CELL_SIZE);
+        float tx = (float)(x - CELL_SIZE * cx) / CELL_SIZE, tz = (float)(z - CELL_SIZE * cz) / CELL_SIZE;
+
+        L_regions.lock();
+        stats.n_misses++;
+        stats.n_samples += 4;
+        L_regions.unlock();
+
+        return lerp4(sample(cx, cz), sample(cx + 1, cz), sample(cx, cz + 1), sample(cx + 1, cz + 1), tx, tz);
+    }
+
+    Region* region = lockRegion(floorDiv(x, REGION_SIZE), floorDiv(z, REGION_SIZE));
+    Params res = interp(region, x, z);
+    L_regions.unlock();
+
+    return res;
+}
+
+// get the parameters of a block of columns
+void BiomeMap::getParams(int x0, int z0, int w, int h, Params* out) {
+    if (capacity <= 0) {
+        for (int x = 0; x < w; ++x) {
+            for (int z = 0; z < h; ++z) {
+                out[h * x + z] = getParams(x0 + x, z0 + z);
+            }
+        }
+        return;
+    }
+
+    // go through each region that overlaps the block
+    for (int RX = floorDiv(x0, REGION_SIZE); RX <= floorDiv(x0 + w - 1, REGION_SIZE); ++RX) {
+        for (int RZ = floorDiv(z0, REGION_SIZE); RZ <= floorDiv(z0 + h - 1, REGION_SIZE); ++RZ) {
+            // the columns of the block that are in this region
+            int xa = glm::max(x0, REGION_SIZE * RX), xb = glm::min(x0 + w, REGION_SIZE * (RX + 1));
+            int za = glm::max(z0, REGION_SIZE * RZ), zb = glm::min(z0 + h, REGION_SIZE * (RZ + 1));
+
+            Region* region = lockRegion(RX, RZ);
+            for (int x = xa; x < xb; ++x) {
+                for (int z = za; z < zb; ++z) {
+                    out[h * (x - x0) + (z - z0)] = interp(region, x, z);
+                }
+            }
+            L_regions.unlock();
+        }
+    }
+}
+
+};
@@ -9,82 +9,199 @@
 
 namespace Blok::WG {
 
-// construct given seed
-DefaultWG::DefaultWG(uint32_t seed) {
-    this->seed = seed;
+// TerrainStage - fills each column with stone up to its height
+class TerrainStage : public Stage {
+    public:
 
-    // create a muxer, to mix layers
-    pmgen = Random::PerlinMux();
+    // the generator whose heights we use
+    DefaultWG* wg;
 
-    // add a basic layer
-    pmgen.addLayer(Random::Perlin(seed + 1, vec3(0.002), vec2(0.3, 0.65), vec2(30, 80)));
-    pmgen.addLayer(Random::Perlin(seed + 2, vec3(0.02), vec2(0.2, 0.9), vec2(0, 20)));
-    pmgen.addLayer(Random::Perlin(seed + 3, vec3(0.007, .03, 0.0), vec2(0.7, 0.73), vec2(0, -40)));
+    TerrainStage(DefaultWG* wg) : Stage("terrain") {
+        this->wg = wg;
+    }
 
-    cavegen = Random::PerlinMux();
-    cavegen.addLayer(Random::Perlin(seed + 4, vec3(0.025, 0.08, 0.025), vec2(.6, .7), vec2(0.0, 1.0)));
-}
+    void apply(GenContext& ctx) {
+        // the heights of all the columns, which come from the cache (shared with neighbours)
+        wg->heightCache.getChunkHeights(ctx.id, ctx.heights);
 
-// generate a single chunk
-Chunk* DefaultWG::getChunk(ChunkID id) {
+        for (int x = 0; x < CHUNK_SIZE_X; ++x) {
+            for (int z = 0; z < CHUNK_SIZE_Z; ++z) {
+                int stone_h = ctx.heights[x][z];
 
-    // create a new chunk pointer
-    Chunk* res = new Chunk();
+                // just set the stone data
+                ctx.chunk->setRun(x, z, 0, stone_h, BlockData(ID::STONE));
+            }
+        }
+    }
 
-    // set the ID of the chunk
-    res->XZ = id;
+};
 
-    // first, do default terrain pass
-    int x, y, z;
+// SurfaceStage - covers the stone with a few layers of dirt, and grass on top (if above the
+//   water level)
+class SurfaceStage : public Stage {
+    public:
 
-    for (x = 0; x < CHUNK_SIZE_X; ++x) {
-        for (z = 0; z < CHUNK_SIZE_Z; ++z) {
-            // for now, just a basic Perlin noise generator
-            // in the future, perhaps have a class that is a PerlinMuxGen, to generate combined perlin noise
-            //int stone_h = layerGen->noise(id.X * CHUNK_SIZE + x, id.Z * CHUNK_SIZE + z, 0.5) + 20;
-            int stone_h = pmgen.noise2d(id.X * CHUNK_SIZE_X + x, id.Z * CHUNK_SIZE_Z + z);
-            if (stone_h < 3) stone_h = 3;
+    SurfaceStage() : Stage("surface") {}
 
-            int dirt_h = stone_h + 4;
+    void apply(GenContext& ctx) {
+        for (int x = 0; x < CHUNK_SIZE_X; ++x) {
+            for (int z = 0; z < CHUNK_SIZE_Z; ++z) {
+                int y = ctx.heights[x][z];
+                int dirt_h = y + 4;
 
-            // just set the stone data
-            for (y = 0; y < stone_h; ++y) {
-                res->set(x, y, z, BlockData(ID::STONE));
-            }
+                ctx.chunk->setRun(x, z, y, dirt_h, BlockData(ID::DIRT));
+                if (dirt_h > 15) {
+                    ctx.chunk->setRun(x, z, dirt_h, dirt_h + 1, BlockData(ID::DIRT_GRASS));
+                }
 
-            for (; y < dirt_h; ++y) {
-                res->set(x, y, z, BlockData(ID::DIRT));
+                // set the rest to air
+                //while (y++ < CHUNK_HEIGHT) res->set(x, y, z, BlockInfo(ID::NONE));
             }
-            for (; y < dirt_h + 1 && y > 15; ++y) {
-                res->set(x, y, z, BlockData(ID::DIRT_GRASS));
+        }
+    }
+
+};
+
+// CarveStage - deletes blocks out of the terrain to make caves
+class CarveStage : public Stage {
+    public:
+
+    // the generator whose cave noise we use
+    DefaultWG* wg;
+
+    CarveStage(DefaultWG* wg) : Stage("carve") {
+        this->wg = wg;
+    }
+
+    void apply(GenContext& ctx) {
+        for (int x = 0; x < CHUNK_SIZE_X; ++x) {
+            for (int z = 0; z < CHUNK_SIZE_Z; ++z) {
+
+                for (int y = 1; y < 100; ++y) {
+                    double smp = wg->cavegen.noise3d(ctx.id.X * CHUNK_SIZE_X + x, y, ctx.id.Z * CHUNK_SIZE_Z + z);
+                    double ff = (y - 30) / 30.0;
+                    double thresh = 0.75 + 0.2 * ff * ff;
+                    if (smp > thresh) {
+                        // clear it out
+                        ctx.chunk->set(x, y, z, BlockData(ID::AIR));
+                    }
+                }
             }
-            
-            // set the rest to air
-            //while (y++ < CHUNK_HEIGHT) res->set(x, y, z, BlockInfo(ID::NONE));
         }
     }
-    // now, do cave pass, deleting blocks out
-    for (x = 0; x < CHUNK_SIZE_X; ++x) {
-        for (z = 0; z < CHUNK_SIZE_Z; ++z) {
-
-            for (y = 1; y < 100; ++y) {
-                double smp = cavegen.noise3d(id.X * CHUNK_SIZE_X + x, y, id.Z * CHUNK_SIZE_Z + z);
-                double ff = (y - 30) / 30.0;
-                double thresh = 0.75 + 0.2 * ff * ff;
-                if (smp > thresh) {
-                    // clear it out
-                    res->set(x, y, z, BlockData(ID::AIR));
+
+};
+
+// DecorateStage - scatters stone boulders over the surface. Boulders are centered in the chunk
+//   being generated, but may stick out into its neighbours, in which case those blocks are queued
+class DecorateStage : public Stage {
+    public:
+
+    // the generator whose seed we use
+    DefaultWG* wg;
+
+    DecorateStage(DefaultWG* wg) : Stage("decorate") {
+        this->wg = wg;
+    }
+
+    void apply(GenContext& ctx) {
+        // every chunk gets its own stream, so decorations don't depend on generation order
+        Random::PCG32 rng(wg->seed, ((uint64_t)(uint32_t)ctx.id.X << 32) | (uint32_t)ctx.id.Z);
+
+        // about 1 in 4 chunks get a boulder
+        if (rng.getU32() % 4 != 0) return;
+
+        int lx = rng.getU32() % CHUNK_SIZE_X, lz = rng.getU32() % CHUNK_SIZE_Z;
+        float r = 1.5f + 2.0f * rng.getF();
+        int R = (int)ceil(r);
+
+        // center it on the grass (stone, then 4 dirt, then grass), half buried
+        int x0 = CHUNK_SIZE_X * ctx.id.X + lx, y0 = ctx.heights[lx][lz] + 5, z0 = CHUNK_SIZE_Z * ctx.id.Z + lz;
+
+        for (int dx = -R; dx <= R; ++dx) {
+            for (int dz = -R; dz <= R; ++dz) {
+                for (int dy = -R; dy <= R; ++dy) {
+                    if (dx * dx + dy * dy + dz * dz <= r * r) {
+                        ctx.set(x0 + dx, y0 + dy, z0 + dz, BlockData(ID::STONE), true);
+                    }
                 }
             }
         }
     }
 
-    return res;
+};
+
+
+// the version of the generator, which should be incremented whenever the terrain it generates changes
+static const uint32_t DEFAULT_VERSION = 1;
+
+
+// construct given seed
+DefaultWG::DefaultWG(uint32_t seed) : heightCache(this) {
+    this->seed = seed;
+
+    // create a muxer, to mix layers
+    pmgen = Random::PerlinMux();
+
+    // add a basic layer
+    pmgen.addLayer(Random::Perlin(seed + 1, vec3(0.002), vec2(0.3, 0.65), vec2(30, 80)));
+    pmgen.addLayer(Random::Perlin(seed + 2, vec3(0.02), vec2(0.2, 0.9), vec2(0, 20)));
+    pmgen.addLayer(Random::Perlin(seed + 3, vec3(0.007, .03, 0.0), vec2(0.7, 0.73), vec2(0, -40)));
+
+    cavegen = Random::PerlinMux();
+    cavegen.addLayer(Random::Perlin(seed + 4, vec3(0.025, 0.08, 0.025), vec2(.6, .7), vec2(0.0, 1.0)));
+
+    // the climate varies slowly, and picks between flatter and more mountainous terrain
+    // NOTE: the parameters are chosen so all of them are about the same height where 'pmgen' is average,
+    //   so the blends between them are gentle
+    biomes.climate.addLayer(Random::Perlin(seed + 5, vec3(0.0015), vec2(0.3, 0.7), vec2(0.0, 1.0)));
+    biomes.addBiome("plains", 0.25f, { 20.0f, 0.5f });
+    biomes.addBiome("hills", 0.5f, { 0.0f, 1.0f });
+    biomes.addBiome("mountains", 0.75f, { -30.0f, 1.6f });
+
+    // now, register the stages
+    // NOTE: the surface goes on before carving, so that caves can open up through the dirt
+    addStage(new TerrainStage(this));
+    addStage(new SurfaceStage());
+    addStage(new CarveStage(this));
+    addStage(new DecorateStage(this));
 }
 
+// compute the height of the stone from the noise and biome parameters
+static inline int stoneHeight(double noise, BiomeMap::Params params) {
+    int stone_h = params.offset + params.scale * noise;
+    if (stone_h < 3) stone_h = 3;
 
-};
+    return stone_h;
+}
 
+// compute the height of the stone at a column
+int DefaultWG::calcHeight(int x, int z) {
+    // a basic Perlin noise generator, scaled by the biome
+    //int stone_h = layerGen->noise(id.X * CHUNK_SIZE + x, id.Z * CHUNK_SIZE + z, 0.5) + 20;
+    return stoneHeight(pmgen.noise2d(x, z), biomes.getParams(x, z));
+}
 
+// compute the height of the stone at a block of columns
+void DefaultWG::calcHeights(int x0, int z0, int w, int h, int* out) {
+    List<BiomeMap::Params> params(w * h);
+    biomes.getParams(x0, z0, w, h, &params[0]);
+
+    for (int x = 0; x < w; ++x) {
+        for (int z = 0; z < h; ++z) {
+            out[h * x + z] = stoneHeight(pmgen.noise2d(x0 + x, z0 + z), params[h * x + z]);
+        }
+    }
+}
 
 
+// return the version tag
+uint32_t DefaultWG::getVersionTag() {
+    // FNV-1a of the seed and version
+    uint32_t res = 2166136261u;
+    res = (res ^ seed) * 16777619u;
+    res = (res ^ DEFAULT_VERSION) * 16777619u;
+    return res;
+}
+
+};
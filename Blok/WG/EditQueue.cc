@@ -0,0 +1,127 @@
+/* WG/EditQueue.cc - implementation of the queue of deferred edits between chunks
+ *
+ * Edits are stored per chunk, and taken out all at once when that chunk is available, so
+ *   applying them doesn't hold the lock
+ *
+ * The chunks are kept in least-recently-queued order (like `HeightCache`'s tiles), so when there are
+ *   too many, the ones furthest behind where generation is happening are dropped
+ *
+ */
+
+// include the world generator protocol
+#include <Blok/WG.hh>
+
+namespace Blok::WG {
+
+// set a block in world coordinates for a chunk being generated
+void GenContext::set(int x, int y, int z, BlockData val, bool ifAir) {
+    if (y < 0 || y >= CHUNK_SIZE_Y) return;
+
+    ChunkID target = ChunkID(floorDiv(x, CHUNK_SIZE_X), floorDiv(z, CHUNK_SIZE_Z));
+    int lx = x - CHUNK_SIZE_X * target.X, lz = z - CHUNK_SIZE_Z * target.Z;
+
+    if (target == id) {
+        // it's in this chunk, so just write it
+        if (!ifAir || chunk->get(lx, y, lz).id == ID::AIR) {
+            chunk->set(lx, y, lz, val);
+        }
+    } else if (pending != NULL) {
+        // save it for when the neighbour is generated
+        EditQueue::Edit edit;
+        edit.x = lx;
+        edit.y = y;
+        edit.z = lz;
+        edit.ifAir = ifAir;
+        edit.val = val;
+        pending->push(target, edit);
+    }
+}
+
+// construct an empty queue
+EditQueue::EditQueue(int capacity) {
+    this->capacity = capacity;
+
+    // initialize statistics to nothing
+    stats.n_pushed = 0;
+    stats.n_applied = 0;
+    stats.n_dropped = 0;
+}
+
+// queue an edit
+void EditQueue::push(ChunkID id, const Edit& edit) {
+    L_edits.lock();
+
+    auto it = edits.find(id);
+    if (it != edits.end()) {
+        // move it to the front, since it is still near where chunks are being generated
+        lru.splice(lru.begin(), lru, it->second);
+    } else {
+        lru.push_front(Pending());
+        lru.front().id = id;
+        edits[id] = lru.begin();
+
+        // drop the edits that have waited the longest, whose chunks are probably never being generated
+        while ((int)lru.size() > capacity && lru.size() > 1) {
+            stats.n_dropped += lru.back().edits.size();
+            edits.erase(lru.back().id);
+            lru.pop_back();
+        }
+    }
+
+    lru.front().edits.push_back(edit);
+    stats.n_pushed++;
+
+    L_edits.unlock();
+}
+
+// apply all edits for a chunk
+int EditQueue::apply(Chunk* chunk) {
+    List<Edit> todo;
+
+    L_edits.lock();
+    auto it = edits.find(chunk->XZ);
+    if (it != edits.end()) {
+        todo.swap(it->second->edits);
+        lru.erase(it->second);
+        edits.erase(it);
+    }
+    L_edits.unlock();
+
+    int res = 0;
+    for (const Edit& edit : todo) {
+        if (edit.ifAir && chunk->get(edit.x, edit.y, edit.z).id != ID::AIR) continue;
+        chunk->set(edit.x, edit.y, edit.z, edit.val);
+        res++;
+    }
+
+    if (res > 0) {
+        L_edits.lock();
+        stats.n_applied += res;
+        L_edits.unlock();
+    }
+
+    return res;
+}
+
+// get the chunks with edits waiting
+List<ChunkID> EditQueue::getPending() {
+    List<ChunkID> res;
+
+    L_edits.lock();
+    for (const Pending& entry : lru) {
+        res.push_back(entry.id);
+    }
+    L_edits.unlock();
+
+    return res;
+}
+
+// get the number of chunks with edits waiting
+int EditQueue::size() {
+    L_edits.lock();
+    int res = edits.size();
+    L_edits.unlock();
+    return res;
+}
+
+};
@@ -7,54 +7,84 @@
 
 namespace Blok::WG {
 
-// construct given seed
-FlatWG::FlatWG(uint32_t seed) {
-    this->seed = seed;
+// LayersStage - fills the chunk with the flat layers of a FlatWG
+class LayersStage : public Stage {
+    public:
 
-    // always include a layer of stone (TODO: bedrock)
-    layers.push_back({ID::STONE, 60});
-    layers.push_back({ID::DIRT, 20});
-    layers.push_back({ID::DIRT_GRASS, 1});
+    // the generator whose layers we use
+    FlatWG* wg;
 
-}
+    LayersStage(FlatWG* wg) : Stage("layers") {
+        this->wg = wg;
+    }
 
-// generate a single chunk
-Chunk* FlatWG::getChunk(ChunkID id) {
+    void apply(GenContext& ctx) {
+        // every column is the same, so build a single column and copy it everywhere
+        BlockData column[CHUNK_SIZE_Y];
 
-    // create a new chunk pointer
-    Chunk* res = new Chunk();
+        // current coordinates
+        int y = 0;
 
-    // set the ID of the chunk
-    res->XZ = id;
+        int lidx = 0;
+        while (y < CHUNK_SIZE_Y && lidx < wg->layers.size()) {
+            // get the current layer
+            auto& layer = wg->layers[lidx];
+            for (int ly = 0; ly < layer.second && y + ly < CHUNK_SIZE_Y; ++ly) {
+                // set it to the block
+                column[y + ly] = BlockData(layer.first);
+            }
 
-    // current coordinates
-    int y = 0;
+            // move the Y up
+            y += layer.second;
+            // move forward in the layers
+            lidx++;
+        }
+
+        ctx.chunk->fillColumns(column);
 
-    int lidx = 0;
-    while (y < CHUNK_SIZE_Y && lidx < layers.size()) {
-        // get the current layer
-        auto& layer = layers[lidx];
+        // every column is the same height
         for (int x = 0; x < CHUNK_SIZE_X; ++x) {
             for (int z = 0; z < CHUNK_SIZE_Z; ++z) {
-                for (int ly = 0; ly < layer.second && y + ly < CHUNK_SIZE_Y; ++ly) {
-                    // set it to the block
-                    res->set(x, y+ly, z, {layer.first});
-                }
+                ctx.heights[x][z] = y < CHUNK_SIZE_Y ? y : CHUNK_SIZE_Y;
             }
         }
-
-        // move the Y up
-        y += layer.second;
-        // move forward in the layers
-        lidx++;
     }
 
-    return res;
-}
+};
 
+// construct given seed
+FlatWG::FlatWG(uint32_t seed) {
+    this->seed = seed;
 
-};
+    // always include a layer of stone (TODO: bedrock)
+    layers.push_back({ID::STONE, 60});
+    layers.push_back({ID::DIRT, 20});
+    layers.push_back({ID::DIRT_GRASS, 1});
+
+    // the only stage
+    addStage(new LayersStage(this));
+}
 
+// compute the height of the top layer, which is the same everywhere
+int FlatWG::calcHeight(int /*x*/, int /*z*/) {
+    int y = 0;
+    for (auto& layer : layers) {
+        y += layer.second;
+    }
 
+    return y < CHUNK_SIZE_Y ? y : CHUNK_SIZE_Y;
+}
 
 
+// return the version tag
+uint32_t FlatWG::getVersionTag() {
+    // FNV-1a of the layers (the seed is never used)
+    uint32_t res = 2166136261u;
+    for (auto& layer : layers) {
+        res = (res ^ layer.first) * 16777619u;
+        res = (res ^ (uint32_t)layer.second) * 16777619u;
+    }
+    return res;
+}
+
+};
@@ -0,0 +1,151 @@
+/* WG/HeightCache.cc - implementation of the heightmap tile cache shared by world generators
+ *
+ * Tiles are computed outside of the lock, so multiple generation threads missing different tiles
+ *   don't serialize on each other. If 2 threads happen to compute the same tile, the first one
+ *   inserted wins, and the other is thrown away
+ *
+ */
+
+// include the world generator protocol
+#include <Blok/WG.hh>
+
+namespace Blok::WG {
+
+// a chunk should never straddle 2 tiles
+static_assert(HeightCache::TILE_SIZE % CHUNK_SIZE_X == 0 && HeightCache::TILE_SIZE % CHUNK_SIZE_Z == 0, "HeightCache::TILE_SIZE must be a multiple of the chunk size");
+
+// construct a cache for a generator
+HeightCache::HeightCache(WG* gen, int capacity) {
+    this->gen = gen;
+    this->capacity = capacity;
+
+    // initialize statistics to nothing
+    stats.n_hits = 0;
+    stats.n_misses = 0;
+    stats.t_compute = 0.0;
+}
+
+// free all the tiles
+HeightCache::~HeightCache() {
+    clear();
+}
+
+// remove all tiles
+void HeightCache::clear() {
+    L_tiles.lock();
+    for (Tile* tile : lru) {
+        delete tile;
+    }
+    lru.clear();
+    tiles.clear();
+    L_tiles.unlock();
+}
+
+// return the hit rate of the cache
+double HeightCache::getHitRate() {
+    L_tiles.lock();
+    uint64_t total = stats.n_hits + stats.n_misses;
+    double res = total == 0 ? 0.0 : (double)stats.n_hits / total;
+    L_tiles.unlock();
+    return res;
+}
+
+// find (or compute) the tile for a column, returning with 'L_tiles' held
+HeightCache::Tile* HeightCache::lockTile(int x, int z) {
+    Pair<int, int> key = { floorDiv(x, TILE_SIZE), floorDiv(z, TILE_SIZE) };
+
+    L_tiles.lock();
+
+    auto it = tiles.find(key);
+    if (it != tiles.end()) {
+        // hit, so just move it to the front of the LRU list
+        stats.n_hits++;
+        lru.splice(lru.begin(), lru, it->second);
+        return *it->second;
+    }
+
+    stats.n_misses++;
+    L_tiles.unlock();
+
+    // compute the tile without holding the lock
+    double stime = getTime();
+
+    Tile* tile = new Tile();
+    tile->TX = key.first;
+    tile->TZ = key.second;
+
+    gen->calcHeights(TILE_SIZE * tile->TX, TILE_SIZE * tile->TZ, TILE_SIZE, TILE_SIZE, tile->heights);
+
+    stime = getTime() - stime;
+
+    L_tiles.lock();
+    stats.t_compute += stime;
+
+    it = tiles.find(key);
+    if (it != tiles.end()) {
+        // another thread beat us to it, so use theirs
+        delete tile;
+        lru.splice(lru.begin(), lru, it->second);
+        return *it->second;
+    }
+
+    // insert it as the most recently used
+    lru.push_front(tile);
+    tiles[key] = lru.begin();
+
+    // evict the least recently used tiles (never the one we just added)
+    while ((int)lru.size() > capacity && lru.size() > 1) {
+        Tile* old = lru.back();
+        tiles.erase({ old->TX, old->TZ });
+        lru.pop_back();
+        delete old;
+    }
+
+    return tile;
+}
+
+// get the height of a single column
+int HeightCache::getHeight(int x, int z) {
+    if (capacity <= 0) {
+        // caching is disabled
+        L_tiles.lock();
+        stats.n_misses++;
+        L_tiles.unlock();
+        return gen->calcHeight(x, z);
+    }
+
+    Tile* tile = lockTile(x, z);
+    int res = tile->heights[TILE_SIZE * (x - TILE_SIZE * tile->TX) + (z - TILE_SIZE * tile->TZ)];
+    L_tiles.unlock();
+
+    return res;
+}
+
+// get the heights of an entire chunk
+void HeightCache::getChunkHeights(ChunkID id, int heights[CHUNK_SIZE_X][CHUNK_SIZE_Z]) {
+    int x0 = CHUNK_SIZE_X * id.X, z0 = CHUNK_SIZE_Z * id.Z;
+
+    if (capacity <= 0) {
+        // caching is disabled
+        L_tiles.lock();
+        stats.n_misses++;
+        L_tiles.unlock();
+
+        gen->calcHeights(x0, z0, CHUNK_SIZE_X, CHUNK_SIZE_Z, &heights[0][0]);
+        return;
+    }
+
+    // since TILE_SIZE is a multiple of the chunk size, the whole chunk is in this tile
+    Tile* tile = lockTile(x0, z0);
+
+    int lx0 = x0 - TILE_SIZE * tile->TX, lz0 = z0 - TILE_SIZE * tile->TZ;
+    for (int x = 0; x < CHUNK_SIZE_X; ++x) {
+        for (int z = 0; z < CHUNK_SIZE_Z; ++z) {
+            heights[x][z] = tile->heights[TILE_SIZE * (lx0 + x) + (lz0 + z)];
+        }
+    }
+
+    L_tiles.unlock();
+}
+
+};
@@ -0,0 +1,64 @@
+/* WG/Pipeline.cc - implementation of the staged world generator
+ *
+ * Each chunk starts out as all air, and is handed to each stage in order. Stages are
+ *   timed individually (see `Stage::run()`), so the cost of generation can be broken down
+ *
+ */
+
+// include the world generator protocol
+#include <Blok/WG.hh>
+
+namespace Blok::WG {
+
+// free all the stages
+Pipeline::~Pipeline() {
+    for (Stage* stage : stages) {
+        delete stage;
+    }
+    stages.clear();
+}
+
+// find a stage by name
+Stage* Pipeline::getStage(const String& name) {
+    for (Stage* stage : stages) {
+        if (stage->name == name) return stage;
+    }
+
+    // not found
+    return NULL;
+}
+
+// run the stages on a new chunk
+Chunk* Pipeline::generate(ChunkID id, EditQueue* spill) {
+
+    // create a new chunk pointer
+    Chunk* res = new Chunk();
+
+    // set the ID of the chunk
+    res->XZ = id;
+
+    // now, apply all the stages in order
+    GenContext ctx(id, res, spill);
+    for (Stage* stage : stages) {
+        stage->run(ctx);
+    }
+
+    return res;
+}
+
+// generate a single chunk
+Chunk* Pipeline::getChunk(ChunkID id) {
+    Chunk* res = generate(id, &pending);
+
+    // and finally, anything neighbours have spilled into it
+    pending.apply(res);
+
+    return res;
+}
+
+// generate a chunk without its neighbours
+Chunk* Pipeline::getBaseChunk(ChunkID id) {
+    return generate(id, NULL);
+}
+
+};
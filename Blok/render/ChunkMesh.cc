@@ -1,6 +1,25 @@
 /* ChunkMesh.cc - implementation of the ChunkMesh class
  *
  * Essentially, this is a subset of meshes that can be generated from a chunk
+ *
+ * There are 3 meshers (see `ChunkMesh::Mesher`):
+ *   - MESHER_FACES adds every visible face of every block on its own (see 'addBlock()'), from flags of
+ *       what each block of the section (and its border) does to the faces next to it
+ *   - MESHER_GREEDY goes through each slice of the chunk (along each of the 6 directions), and builds a mask
+ *       of the visible faces in it, keyed by block ID & ambient occlusion. Then, starting from each face that
+ *       is left, it is grown as far as possible along one axis, then as far as possible along the other, and
+ *       that rectangle is emitted as a single quad. Faces with uneven ambient occlusion (i.e. in corners) are
+ *       never merged, since the occlusion would be stretched across the whole quad
+ *   - MESHER_BINARY turns each column of a section (and its border) into a bitmask of which blocks are
+ *       solid, so the visible faces of a whole column come from a shift (up & down) or the column next to
+ *       it, and an AND-NOT. Then a quad is added for each set bit (see 'addBinary()')
+ * They all produce the same faces, with the same winding, texture orientation and ambient occlusion, and
+ *   they all build from a copy of the chunk with a border of 1 block from its neighbours (see
+ *   `ChunkMesh::Padded`), so they never look in the neighbours, and the copy can be built on another thread
+ *
+ * The mesh is built in sections of `ChunkMesh::SECTION_SIZE` blocks high, each of which only has the faces
+ *   of the blocks in it, so a section can be rebuilt without the rest. The greedy mesher doesn't merge
+ *   faces across sections, which costs a few more quads on tall walls
  * 
  */
 
@@ -10,65 +29,124 @@
 namespace Blok::Render {
 
 
-// add visible faces to the list
-static void addBlock(List<ChunkMeshVertex>& vertices, List<Face>& faces, Chunk* chunk, int x, int y, int z) {
+// return the column at a local (x, z), which may be in a neighbouring chunk (up to 1 chunk away along
+//   each axis), or NULL if its chunk isn't there
+// NOTE: the diagonal chunks are found through the left & right neighbours
+static inline const BlockData* getColumn(Chunk* chunk, int x, int z) {
+    if (x < 0) {
+        chunk = chunk->rcache.cL;
+        x += CHUNK_SIZE_X;
+    } else if (x >= CHUNK_SIZE_X) {
+        chunk = chunk->rcache.cR;
+        x -= CHUNK_SIZE_X;
+    }
+    if (chunk == NULL) return NULL;
+
+    if (z < 0) {
+        chunk = chunk->rcache.cB;
+        z += CHUNK_SIZE_Z;
+    } else if (z >= CHUNK_SIZE_Z) {
+        chunk = chunk->rcache.cT;
+        z -= CHUNK_SIZE_Z;
+    }
+    if (chunk == NULL) return NULL;
 
-    // top, bottom, left, right, forward, and reverse faces
-    bool doTop=false, doBot=false, doLef=false, doRig=false, doFor=false, doBac=false;
+    return &chunk->blocks[chunk->getIndex(x, 0, z)];
+}
 
-    // get the ID
-    int id = chunk->get(x, y, z).id;
 
-    // check top and bottom faces
-    if (y == CHUNK_SIZE_Y - 1) {
-        doTop = true;
-    } else if (chunk->get(x, y+1, z).id == ID::AIR) {
-        doTop = true;
-    }
+/* PADDED CHUNKS */
 
-    if (y == 0) {
-        doBot = true;
-    } else if (chunk->get(x, y-1, z).id == ID::AIR) {
-        doBot = true;
-    }
+// copy the rows of a chunk (and of its neighbours that touch it) that some sections look at
+void ChunkMesh::Padded::fill(Chunk* chunk, uint32_t sectionMask) {
 
-    // check left & right faces
-    if (x == CHUNK_SIZE_X-1) {
-        if (chunk->rcache.cR != NULL && chunk->rcache.cR->get(0, y, z).id == ID::AIR) {
-            doRig = true;
+    // nothing above the highest block has any faces, so only go up to there
+    top = 0;
+    for (int x = 0; x < CHUNK_SIZE_X; ++x) {
+        for (int z = 0; z < CHUNK_SIZE_Z; ++z) {
+            const BlockData* col = &chunk->blocks[chunk->getIndex(x, 0, z)];
+            for (int y = CHUNK_SIZE_Y - 1; y >= top; --y) {
+                if (col[y].id != ID::AIR) {
+                    top = y + 1;
+                    break;
+                }
+            }
         }
-    } else if (chunk->get(x+1, y, z).id == ID::AIR) {
-        doRig = true;
     }
 
-    if (x == 0) {
-        if (chunk->rcache.cL != NULL && chunk->rcache.cL->get(CHUNK_SIZE_X-1, y, z).id == ID::AIR) {
-            doLef = true;
+    // the faces of the blocks from y0 to y1 (exclusive) look at the rows from y0 - 1 to y1 (inclusive)
+    if (sectionMask == 0) return;
+    int y0 = SECTION_SIZE * __builtin_ctz(sectionMask);
+    int y1 = std::min(SECTION_SIZE * (32 - __builtin_clz(sectionMask)), top);
+    if (y1 <= y0) return;
+
+    for (int x = -1; x <= CHUNK_SIZE_X; ++x) {
+        for (int z = -1; z <= CHUNK_SIZE_Z; ++z) {
+            const BlockData* col = getColumn(chunk, x, z);
+            ID* out = &ids[getIndex(x, 0, z)];
+            present[x + 1][z + 1] = col != NULL;
+
+            // above & below the world is always air
+            if (y0 == 0) out[-1] = ID::AIR;
+            if (y1 == CHUNK_SIZE_Y) out[CHUNK_SIZE_Y] = ID::AIR;
+            for (int y = std::max(y0 - 1, 0); y <= std::min(y1, CHUNK_SIZE_Y - 1); ++y) {
+                out[y] = col != NULL ? col[y].id : ID::AIR;
+            }
         }
-    } else if (chunk->get(x-1, y, z).id == ID::AIR) {
-        doLef = true;
     }
+}
 
-
-    // check forward and back faces
-    if (z == CHUNK_SIZE_Z-1) {
-        if (chunk->rcache.cT != NULL && chunk->rcache.cT->get(x, y, 0).id == ID::AIR) {
-            doFor = true;
+// the offset between neighbouring blocks, along each axis
+static const int PAD_DY = ChunkMesh::Padded::DY, PAD_DZ = ChunkMesh::Padded::DZ, PAD_DX = ChunkMesh::Padded::DX;
+
+// the flags of a block for MESHER_FACES, which are stored like a padded chunk
+enum PadBlock : uint8_t {
+    // it is air (or above or below the world)
+    PAD_AIR = 0,
+
+    // it counts for the ambient occlusion of the faces around it
+    PAD_SOLID = 1,
+
+    // it hides the faces touching it (which a chunk that isn't there does, without occluding)
+    PAD_HIDES = 2,
+};
+
+// fill in the flags of the rows from y0 - 1 to y1 (inclusive), i.e. everything the faces of the blocks
+//   from y0 to y1 (exclusive) look at
+static void fillFlags(uint8_t* flags, const ChunkMesh::Padded& pad, int y0, int y1) {
+    for (int x = -1; x <= CHUNK_SIZE_X; ++x) {
+        for (int z = -1; z <= CHUNK_SIZE_Z; ++z) {
+            int idx = ChunkMesh::Padded::getIndex(x, 0, z);
+            const ID* col = &pad.ids[idx];
+            uint8_t* out = &flags[idx];
+            bool present = pad.present[x + 1][z + 1];
+            for (int y = y0 - 1; y <= y1; ++y) {
+                if (y < 0 || y >= CHUNK_SIZE_Y) {
+                    out[y] = PAD_AIR;
+                } else if (!present) {
+                    out[y] = PAD_HIDES;
+                } else {
+                    out[y] = col[y] != ID::AIR ? PAD_SOLID | PAD_HIDES : PAD_AIR;
+                }
+            }
         }
-    } else if (chunk->get(x, y, z+1).id == ID::AIR) {
-        doFor = true;
     }
+}
 
-    if (z == 0) {
-        if (chunk->rcache.cB != NULL && chunk->rcache.cB->get(x, y, CHUNK_SIZE_Z-1).id == ID::AIR) {
-            doBac = true;
-        }
-    } else if (chunk->get(x, y, z-1).id == ID::AIR) {
-        doBac = true;
-    }
+// add visible faces to the list, for the block 'id' at a local position, given the flags of its section
+static void addBlock(List<ChunkMeshVertex>& vertices, const uint8_t* flags, int x, int y, int z, int id) {
+
+    // the block in the flags, from which every block around it is a constant offset
+    const uint8_t* b = &flags[ChunkMesh::Padded::getIndex(x, y, z)];
+
+    // top, bottom, left, right, forward, and reverse faces, which are visible unless the block they face
+    //   hides them
+    bool doTop = !(b[PAD_DY] & PAD_HIDES), doBot = !(b[-PAD_DY] & PAD_HIDES);
+    bool doRig = !(b[PAD_DX] & PAD_HIDES), doLef = !(b[-PAD_DX] & PAD_HIDES);
+    bool doFor = !(b[PAD_DZ] & PAD_HIDES), doBac = !(b[-PAD_DZ] & PAD_HIDES);
 
     // now, add them to the mesh, if they are visible
-    // keep a array of all blocks around the origin
+    // the blocks around the origin are numbered like so (and are 1 if they are solid)
     //    +---+---+---+
     // Y /           /|
     //  /    ...    / |
@@ -78,281 +156,601 @@ static void addBlock(List<ChunkMeshVertex>& vertices, List<Face>& faces, Chunk*
     // | 0 | 9 |18 | /
     // +---+---+---+/ X
     //
-    BlockData surround[27];
 
     // get surrounding sample
-    #define GET_S(_x, _y, _z) (surround[(_x) * 9 + (_z) * 3 + (_y)])
-
-
-    // basically a monte carlo sample
-    float raycastFac = 1.0;
-
-    if (doTop || doBot || doRig || doLef || doFor || doBac) {
-        // fill up the surrounds
-        for (int lx = -1; lx <= 1; ++lx) {
-            for (int lz = -1; lz <= 1; ++lz) {
-                int nx = x+lx, nz = z+lz;
-
-                // source for the chunk
-                Chunk* src = chunk;
-                if (nx < 0) {
-                    src = src->rcache.cL;
-                    nx += CHUNK_SIZE_X;
-                } else if (nx >= CHUNK_SIZE_X) {
-                    src = src->rcache.cR;
-                    nx -= CHUNK_SIZE_X;
-                }
-                if (src == NULL) continue;
-
-                if (nz < 0) {
-                    src = src->rcache.cB;
-                    nz += CHUNK_SIZE_Z;
-                } else if (nz >= CHUNK_SIZE_Z) {
-                    src = src->rcache.cT;
-                    nz -= CHUNK_SIZE_Z;
-                }
-                if (src == NULL) continue;
+    #define GET_S(_x, _y, _z) (b[((_x) - 1) * PAD_DX + ((_z) - 1) * PAD_DZ + ((_y) - 1) * PAD_DY] & PAD_SOLID)
 
-                for (int ly = -1; ly <= 1; ++ly) {
-                    // sample inner cube
-                    if (y+ly >= 0 && y+ly < CHUNK_SIZE_Y) {
-
-                        GET_S(lx+1, ly+1, lz+1) = src->get(nx, y+ly, nz);
-                    }
-                    //surround[lx * 9 + lz * 3 + ly] = chunk->get(x+lx, y+ly, z+lz);
-                }
-            }            
-        }
-    }
+    // each face is 4 vertices, which are drawn with the shared quad indices (see `ChunkMesh::QUAD_INDICES`),
+    //   so the faces that wind the other way add their 2nd & 3rd corners swapped
 
     if (doTop) {
         // we are on top, so always render the top face
-        int idx = vertices.size();
-
-        int last0 = (GET_S(0, 2, 0).id != ID::AIR ? 1 : 0) + (GET_S(1, 2, 0).id != ID::AIR ? 1 : 0) + (GET_S(0, 2, 1).id != ID::AIR ? 1 : 0);
-        vertices.push_back(ChunkMeshVertex(vec3(x, y+1, z),     vec2(0.0, 0.5), vec3(0, 1, 0), id, (3 - last0) / 3.0));
-
-        int last1 = (GET_S(0, 2, 2).id != ID::AIR ? 1 : 0) + (GET_S(0, 2, 1).id != ID::AIR ? 1 : 0) + (GET_S(1, 2, 2).id != ID::AIR ? 1 : 0);
-        vertices.push_back(ChunkMeshVertex(vec3(x, y+1, z+1),   vec2(0.0, 0.0), vec3(0, 1, 0), id, (3 - last1) / 3.0));
+        int last0 = GET_S(0, 2, 0) + GET_S(1, 2, 0) + GET_S(0, 2, 1);
+        vertices.push_back(ChunkMeshVertex(vec3i(x, y+1, z),     ChunkMeshVertex::FACE_TOP, last0, id));
 
-        int last2 = (GET_S(2, 2, 1).id != ID::AIR ? 1 : 0) + (GET_S(1, 2, 0).id != ID::AIR ? 1 : 0) + (GET_S(2, 2, 0).id != ID::AIR ? 1 : 0);
-        vertices.push_back(ChunkMeshVertex(vec3(x+1, y+1, z),   vec2(0.5, 0.5), vec3(0, 1, 0), id, (3 - last2) / 3.0));
+        int last1 = GET_S(0, 2, 2) + GET_S(0, 2, 1) + GET_S(1, 2, 2);
+        vertices.push_back(ChunkMeshVertex(vec3i(x, y+1, z+1),   ChunkMeshVertex::FACE_TOP, last1, id));
 
-        int last3 = (GET_S(1, 2, 2).id != ID::AIR ? 1 : 0) + (GET_S(2, 2, 1).id != ID::AIR ? 1 : 0) + (GET_S(2, 2, 2).id != ID::AIR ? 1 : 0);
-        vertices.push_back(ChunkMeshVertex(vec3(x+1, y+1, z+1), vec2(0.5, 0.0), vec3(0, 1, 0), id, (3 - last3) / 3.0));
+        int last2 = GET_S(2, 2, 1) + GET_S(1, 2, 0) + GET_S(2, 2, 0);
+        vertices.push_back(ChunkMeshVertex(vec3i(x+1, y+1, z),   ChunkMeshVertex::FACE_TOP, last2, id));
 
-        faces.push_back({idx, idx+1, idx+2});
-        faces.push_back({idx+1, idx+3, idx+2});
+        int last3 = GET_S(1, 2, 2) + GET_S(2, 2, 1) + GET_S(2, 2, 2);
+        vertices.push_back(ChunkMeshVertex(vec3i(x+1, y+1, z+1), ChunkMeshVertex::FACE_TOP, last3, id));
     }
 
     if (doBot) {
         // we are on top, so always render the top face
-        int idx = vertices.size();
+        int last0 = GET_S(0, 0, 0) + GET_S(1, 0, 0) + GET_S(0, 0, 1);
+        vertices.push_back(ChunkMeshVertex(vec3i(x, y, z),       ChunkMeshVertex::FACE_BOTTOM, last0, id));
 
-        int last0 = (GET_S(0, 0, 0).id != ID::AIR ? 1 : 0) + (GET_S(1, 0, 0).id != ID::AIR ? 1 : 0) + (GET_S(0, 0, 1).id != ID::AIR ? 1 : 0);
-        vertices.push_back(ChunkMeshVertex(vec3(x, y, z),       vec2(1.0, 0.5), vec3(0, -1, 0), id, (3 - last0) / 3.0));
+        int last2 = GET_S(2, 0, 1) + GET_S(1, 0, 0) + GET_S(2, 0, 0);
+        vertices.push_back(ChunkMeshVertex(vec3i(x+1, y, z),     ChunkMeshVertex::FACE_BOTTOM, last2, id));
 
-        int last1 = (GET_S(0, 0, 2).id != ID::AIR ? 1 : 0) + (GET_S(0, 0, 1).id != ID::AIR ? 1 : 0) + (GET_S(1, 0, 2).id != ID::AIR ? 1 : 0);
-        vertices.push_back(ChunkMeshVertex(vec3(x, y, z+1),     vec2(1.0, 0.0), vec3(0, -1, 0), id, (3 - last1) / 3.0));
+        int last1 = GET_S(0, 0, 2) + GET_S(0, 0, 1) + GET_S(1, 0, 2);
+        vertices.push_back(ChunkMeshVertex(vec3i(x, y, z+1),     ChunkMeshVertex::FACE_BOTTOM, last1, id));
 
-        int last2 = (GET_S(2, 0, 1).id != ID::AIR ? 1 : 0) + (GET_S(1, 0, 0).id != ID::AIR ? 1 : 0) + (GET_S(2, 0, 0).id != ID::AIR ? 1 : 0);
-        vertices.push_back(ChunkMeshVertex(vec3(x+1, y, z),     vec2(0.5, 0.5), vec3(0, -1, 0), id, (3 - last2) / 3.0));
+        int last3 = GET_S(1, 0, 2) + GET_S(2, 0, 1) + GET_S(2, 0, 2);
+        vertices.push_back(ChunkMeshVertex(vec3i(x+1, y, z+1),   ChunkMeshVertex::FACE_BOTTOM, last3, id));
+    }
 
-        int last3 = (GET_S(1, 0, 2).id != ID::AIR ? 1 : 0) + (GET_S(2, 0, 1).id != ID::AIR ? 1 : 0) + (GET_S(2, 0, 2).id != ID::AIR ? 1 : 0);
-        vertices.push_back(ChunkMeshVertex(vec3(x+1, y, z+1),   vec2(0.5, 0.0), vec3(0, -1, 0), id, (3 - last3) / 3.0));
+    if (doRig) {
+        // we are on top, so always render the top face
+        int last0 = GET_S(2, 0, 0) + GET_S(2, 1, 0) + GET_S(2, 0, 1);
+        vertices.push_back(ChunkMeshVertex(vec3i(x+1, y, z),     ChunkMeshVertex::FACE_RIGHT, last0, id));
+
+        int last2 = GET_S(2, 2, 1) + GET_S(2, 1, 0) + GET_S(2, 2, 0);
+        vertices.push_back(ChunkMeshVertex(vec3i(x+1, y+1, z),   ChunkMeshVertex::FACE_RIGHT, last2, id));
 
-        faces.push_back({idx+1, idx, idx+2});
-        faces.push_back({idx+1, idx+2, idx+3});
+        int last1 = GET_S(2, 0, 2) + GET_S(2, 0, 1) + GET_S(2, 1, 2);
+        vertices.push_back(ChunkMeshVertex(vec3i(x+1, y, z+1),   ChunkMeshVertex::FACE_RIGHT, last1, id));
+
+        int last3 = GET_S(2, 1, 2) + GET_S(2, 2, 1) + GET_S(2, 2, 2);
+        vertices.push_back(ChunkMeshVertex(vec3i(x+1, y+1, z+1), ChunkMeshVertex::FACE_RIGHT, last3, id));
     }
 
-    if (doRig) {
+    if (doLef) {
         // we are on top, so always render the top face
-        int idx = vertices.size();
+        int last0 = GET_S(0, 0, 0) + GET_S(0, 1, 0) + GET_S(0, 0, 1);
+        vertices.push_back(ChunkMeshVertex(vec3i(x, y, z),     ChunkMeshVertex::FACE_LEFT, last0, id));
+
+        int last1 = GET_S(0, 0, 2) + GET_S(0, 0, 1) + GET_S(0, 1, 2);
+        vertices.push_back(ChunkMeshVertex(vec3i(x, y, z+1),   ChunkMeshVertex::FACE_LEFT, last1, id));
 
-        int last0 = (GET_S(2, 0, 0).id != ID::AIR ? 1 : 0) + (GET_S(2, 1, 0).id != ID::AIR ? 1 : 0) + (GET_S(2, 0, 1).id != ID::AIR ? 1 : 0);
-        vertices.push_back(ChunkMeshVertex(vec3(x+1, y, z),     vec2(0.0, 1.0), vec3(1, 0, 0), id, (3 - last0) / 3.0));
+        int last2 = GET_S(0, 2, 1) + GET_S(0, 1, 0) + GET_S(0, 2, 0);
+        vertices.push_back(ChunkMeshVertex(vec3i(x, y+1, z),   ChunkMeshVertex::FACE_LEFT, last2, id));
 
-        int last1 = (GET_S(2, 0, 2).id != ID::AIR ? 1 : 0) + (GET_S(2, 0, 1).id != ID::AIR ? 1 : 0) + (GET_S(2, 1, 2).id != ID::AIR ? 1 : 0);
-        vertices.push_back(ChunkMeshVertex(vec3(x+1, y, z+1),   vec2(0.5, 1.0), vec3(1, 0, 0), id, (3 - last1) / 3.0));
+        int last3 = GET_S(0, 1, 2) + GET_S(0, 2, 1) + GET_S(0, 2, 2);
+        vertices.push_back(ChunkMeshVertex(vec3i(x, y+1, z+1), ChunkMeshVertex::FACE_LEFT, last3, id));
+    }
 
-        int last2 = (GET_S(2, 2, 1).id != ID::AIR ? 1 : 0) + (GET_S(2, 1, 0).id != ID::AIR ? 1 : 0) + (GET_S(2, 2, 0).id != ID::AIR ? 1 : 0);
-        vertices.push_back(ChunkMeshVertex(vec3(x+1, y+1, z),   vec2(0.0, 0.5), vec3(1, 0, 0), id, (3 - last2) / 3.0));
 
-        int last3 = (GET_S(2, 1, 2).id != ID::AIR ? 1 : 0) + (GET_S(2, 2, 1).id != ID::AIR ? 1 : 0) + (GET_S(2, 2, 2).id != ID::AIR ? 1 : 0);
-        vertices.push_back(ChunkMeshVertex(vec3(x+1, y+1, z+1), vec2(0.5, 0.5), vec3(1, 0, 0), id, (3 - last3) / 3.0));
+    if (doFor) {
+        // we are on top, so always render the top face
+        int last0 = GET_S(0, 0, 2) + GET_S(1, 0, 2) + GET_S(0, 1, 2);
+        vertices.push_back(ChunkMeshVertex(vec3i(x, y, z+1),     ChunkMeshVertex::FACE_FORWARD, last0, id));
 
-        faces.push_back({idx, idx+2, idx+1});
-        faces.push_back({idx+1, idx+2, idx+3});
+        int last2 = GET_S(2, 1, 2) + GET_S(1, 0, 2) + GET_S(2, 0, 2);
+        vertices.push_back(ChunkMeshVertex(vec3i(x+1, y, z+1),   ChunkMeshVertex::FACE_FORWARD, last2, id));
+
+        int last1 = GET_S(0, 2, 2) + GET_S(0, 1, 2) + GET_S(1, 2, 2);
+        vertices.push_back(ChunkMeshVertex(vec3i(x, y+1, z+1),   ChunkMeshVertex::FACE_FORWARD, last1, id));
+
+        int last3 = GET_S(1, 2, 2) + GET_S(2, 1, 2) + GET_S(2, 2, 2);
+        vertices.push_back(ChunkMeshVertex(vec3i(x+1, y+1, z+1), ChunkMeshVertex::FACE_FORWARD, last3, id));
     }
 
-    if (doLef) {
+    if (doBac) {
         // we are on top, so always render the top face
-        int idx = vertices.size();
+        int last0 = GET_S(0, 0, 0) + GET_S(1, 0, 0) + GET_S(0, 1, 0);
+        vertices.push_back(ChunkMeshVertex(vec3i(x, y, z),     ChunkMeshVertex::FACE_BACK, last0, id));
+
+        int last1 = GET_S(0, 2, 0) + GET_S(0, 1, 0) + GET_S(1, 2, 0);
+        vertices.push_back(ChunkMeshVertex(vec3i(x, y+1, z),   ChunkMeshVertex::FACE_BACK, last1, id));
+
+        int last2 = GET_S(2, 1, 0) + GET_S(1, 0, 0) + GET_S(2, 0, 0);
+        vertices.push_back(ChunkMeshVertex(vec3i(x+1, y, z),   ChunkMeshVertex::FACE_BACK, last2, id));
+
+        int last3 = GET_S(1, 2, 0) + GET_S(2, 1, 0) + GET_S(2, 2, 0);
+        vertices.push_back(ChunkMeshVertex(vec3i(x+1, y+1, z), ChunkMeshVertex::FACE_BACK, last3, id));
+    }
+    // done with this face
+
+    #undef GET_S
+}
+
+
+/* GREEDY MESHING */
 
-        int last0 = (GET_S(0, 0, 0).id != ID::AIR ? 1 : 0) + (GET_S(0, 1, 0).id != ID::AIR ? 1 : 0) + (GET_S(0, 0, 1).id != ID::AIR ? 1 : 0);
-        vertices.push_back(ChunkMeshVertex(vec3(x, y, z),     vec2(0.5, 1.0), vec3(-1, 0, 0), id, (3 - last0) / 3.0));
+// the size of the chunk along each axis
+static const int AXIS_SIZE[3] = { CHUNK_SIZE_X, CHUNK_SIZE_Y, CHUNK_SIZE_Z };
 
-        int last1 = (GET_S(0, 0, 2).id != ID::AIR ? 1 : 0) + (GET_S(0, 0, 1).id != ID::AIR ? 1 : 0) + (GET_S(0, 1, 2).id != ID::AIR ? 1 : 0);
-        vertices.push_back(ChunkMeshVertex(vec3(x, y, z+1),   vec2(0.0, 1.0), vec3(-1, 0, 0), id, (3 - last1) / 3.0));
+// Direction - one of the 6 directions a face can point in, and how a quad facing it is built
+struct Direction {
 
-        int last2 = (GET_S(0, 2, 1).id != ID::AIR ? 1 : 0) + (GET_S(0, 1, 0).id != ID::AIR ? 1 : 0) + (GET_S(0, 2, 0).id != ID::AIR ? 1 : 0);
-        vertices.push_back(ChunkMeshVertex(vec3(x, y+1, z),   vec2(0.5, 0.5), vec3(-1, 0, 0), id, (3 - last2) / 3.0));
+    // the axis the face points along (0=X, 1=Y, 2=Z), and which way (+1 or -1)
+    int axis, sign;
 
-        int last3 = (GET_S(0, 1, 2).id != ID::AIR ? 1 : 0) + (GET_S(0, 2, 1).id != ID::AIR ? 1 : 0) + (GET_S(0, 2, 2).id != ID::AIR ? 1 : 0);
-        vertices.push_back(ChunkMeshVertex(vec3(x, y+1, z+1), vec2(0.0, 0.5), vec3(-1, 0, 0), id, (3 - last3) / 3.0));
+    // the 2 axes the quad spans
+    int P, Q;
 
-        faces.push_back({idx, idx+1, idx+2});
-        faces.push_back({idx+1, idx+3, idx+2});
+    // whether the 2nd & 3rd corners are swapped, so the quad winds the right way (corner 'c' is at an
+    //   offset of 'c >> 1' along P, and 'c & 1' along Q)
+    bool swap;
+
+    // the face the vertices are marked with
+    ChunkMeshVertex::Face face;
+
+};
+
+// these match the faces made by 'addBlock()' (and are in the order of `ChunkMeshVertex::Face`)
+static const Direction DIRECTIONS[6] = {
+    { 1, +1, 0, 2, false, ChunkMeshVertex::FACE_TOP },
+    { 1, -1, 0, 2, true , ChunkMeshVertex::FACE_BOTTOM },
+    { 0, +1, 1, 2, true , ChunkMeshVertex::FACE_RIGHT },
+    { 0, -1, 1, 2, false, ChunkMeshVertex::FACE_LEFT },
+    { 2, +1, 0, 1, true , ChunkMeshVertex::FACE_FORWARD },
+    { 2, -1, 0, 1, false, ChunkMeshVertex::FACE_BACK },
+};
+
+// the bit of a mask entry that marks it as having a face (since ID 0 is a valid block)
+static const uint32_t MASK_PRESENT = 1 << 16;
+
+// the bit of a mask entry that marks a face with uneven ambient occlusion, which is never merged
+static const uint32_t MASK_UNEVEN = 0x80000000;
+
+// what is in the layer a slice of faces looks out into
+enum LayerBlock : uint8_t {
+    LAYER_AIR = 0,
+    LAYER_SOLID = 1,
+
+    // in a chunk that isn't there (hides the face, but doesn't occlude)
+    LAYER_MISSING = 2,
+};
+
+// add a quad covering 'w' blocks along P and 'h' along Q, from the block at 'pos'
+static void addQuad(List<ChunkMeshVertex>& vertices, const Direction& dir, vec3i pos, int w, int h, int id, const int ao[4]) {
+    for (int i = 0; i < 4; ++i) {
+        int c = dir.swap && (i == 1 || i == 2) ? 3 - i : i;
+
+        vec3i vpos = pos;
+        if (dir.sign > 0) vpos[dir.axis] += 1;
+        vpos[dir.P] += (c >> 1) * w;
+        vpos[dir.Q] += (c & 1) * h;
+
+        vertices.push_back(ChunkMeshVertex(vpos, dir.face, ao[c], id));
     }
+}
 
+// add the faces of the blocks from y0 to y1 (exclusive) of a chunk, merging them into as few quads as possible
+static void addGreedy(List<ChunkMeshVertex>& vertices, const ChunkMesh::Padded& pad, int y0, int y1) {
+    // the largest slice is 16 * 256 faces
+    static const int MAX_MASK = CHUNK_SIZE_Y * (CHUNK_SIZE_X > CHUNK_SIZE_Z ? CHUNK_SIZE_X : CHUNK_SIZE_Z);
+
+    // the faces in the current slice (0 for none, otherwise the ID, the ambient occlusion in the next byte,
+    //   and MASK_PRESENT, possibly with MASK_UNEVEN set), and the corner ambient occlusion of uneven faces
+    uint32_t mask[MAX_MASK];
+    uint8_t uneven[MAX_MASK][4];
+
+    // the layer the current slice faces into, with a border of 1 block for the ambient occlusion
+    static const int MAX_LAYER = (CHUNK_SIZE_Y + 2) * ((CHUNK_SIZE_X > CHUNK_SIZE_Z ? CHUNK_SIZE_X : CHUNK_SIZE_Z) + 2);
+    uint8_t layer[MAX_LAYER];
+
+    // the first block along each axis, and how many there are
+    const int lo[3] = { 0, y0, 0 }, num[3] = { AXIS_SIZE[0], y1 - y0, AXIS_SIZE[2] };
+    if (num[1] <= 0) return;
+
+    for (const Direction& dir : DIRECTIONS) {
+        int nP = num[dir.P], nQ = num[dir.Q];
+
+        // the stride of a row of 'layer', and the offsets of the neighbours of an entry
+        int lP = nP + 2;
+        const int dQ = lP, dP = 1;
+
+        for (int s = lo[dir.axis]; s < lo[dir.axis] + num[dir.axis]; ++s) {
+            // fill in the layer, once for the whole slice
+            for (int q = -1; q <= nQ; ++q) {
+                for (int p = -1; p <= nP; ++p) {
+                    vec3i npos;
+                    npos[dir.axis] = s + dir.sign;
+                    npos[dir.P] = lo[dir.P] + p;
+                    npos[dir.Q] = lo[dir.Q] + q;
+
+                    // faces on the edge of the world are always visible, but faces on the edge of a loaded
+                    //   chunk are hidden until the chunk next to it is there
+                    uint8_t& l = layer[lP * (q + 1) + p + 1];
+                    if (npos.y < 0 || npos.y >= CHUNK_SIZE_Y) {
+                        l = LAYER_AIR;
+                    } else if (!pad.present[npos.x + 1][npos.z + 1]) {
+                        l = LAYER_MISSING;
+                    } else {
+                        l = pad.ids[ChunkMesh::Padded::getIndex(npos.x, npos.y, npos.z)] != ID::AIR ? LAYER_SOLID : LAYER_AIR;
+                    }
+                }
+            }
 
-    if (doFor) {
-        // we are on top, so always render the top face
-        int idx = vertices.size();
+            // find the visible faces in this slice
+            bool any = false;
+            for (int q = 0; q < nQ; ++q) {
+                for (int p = 0; p < nP; ++p) {
+                    uint32_t& m = mask[nP * q + p];
+                    m = 0;
+
+                    const uint8_t* l = &layer[lP * (q + 1) + p + 1];
+                    if (*l != LAYER_AIR) continue;
+
+                    vec3i pos;
+                    pos[dir.axis] = s;
+                    pos[dir.P] = lo[dir.P] + p;
+                    pos[dir.Q] = lo[dir.Q] + q;
+
+                    int id = pad.ids[ChunkMesh::Padded::getIndex(pos.x, pos.y, pos.z)];
+                    if (id == ID::AIR) continue;
+
+                    // count the solid blocks around each corner, in the same way as 'addBlock()'
+                    int ao[4];
+                    for (int c = 0; c < 4; ++c) {
+                        int oP = (c >> 1) ? dP : -dP, oQ = (c & 1) ? dQ : -dQ;
+                        ao[c] = (l[oP] == LAYER_SOLID) + (l[oQ] == LAYER_SOLID) + (l[oP + oQ] == LAYER_SOLID);
+                    }
+                    if (ao[0] == ao[1] && ao[0] == ao[2] && ao[0] == ao[3]) {
+                        m = id | ao[0] << 8 | MASK_PRESENT;
+                    } else {
+                        m = id | MASK_PRESENT | MASK_UNEVEN;
+                        for (int c = 0; c < 4; ++c) uneven[nP * q + p][c] = ao[c];
+                    }
+                    any = true;
+                }
+            }
 
-        int last0 = (GET_S(0, 0, 2).id != ID::AIR ? 1 : 0) + (GET_S(1, 0, 2).id != ID::AIR ? 1 : 0) + (GET_S(0, 1, 2).id != ID::AIR ? 1 : 0);
-        vertices.push_back(ChunkMeshVertex(vec3(x, y, z+1),     vec2(0.5, 1.0), vec3(0, 0, 1), id, (3 - last0) / 3.0));
+            if (!any) continue;
 
-        int last1 = (GET_S(0, 2, 2).id != ID::AIR ? 1 : 0) + (GET_S(0, 1, 2).id != ID::AIR ? 1 : 0) + (GET_S(1, 2, 2).id != ID::AIR ? 1 : 0);
-        vertices.push_back(ChunkMeshVertex(vec3(x, y+1, z+1),   vec2(0.5, 0.5), vec3(0, 0, 1), id, (3 - last1) / 3.0));
+            // now, grow each face into the largest rectangle it can
+            for (int q = 0; q < nQ; ++q) {
+                for (int p = 0; p < nP; ) {
+                    uint32_t m = mask[nP * q + p];
+                    if (m == 0) {
+                        p++;
+                        continue;
+                    }
 
-        int last2 = (GET_S(2, 1, 2).id != ID::AIR ? 1 : 0) + (GET_S(1, 0, 2).id != ID::AIR ? 1 : 0) + (GET_S(2, 0, 2).id != ID::AIR ? 1 : 0);
-        vertices.push_back(ChunkMeshVertex(vec3(x+1, y, z+1),   vec2(0.0, 1.0), vec3(0, 0, 1), id, (3 - last2) / 3.0));
+                    vec3i pos;
+                    pos[dir.axis] = s;
+                    pos[dir.P] = lo[dir.P] + p;
+                    pos[dir.Q] = lo[dir.Q] + q;
+                    int id = m & 0xFF;
+
+                    if (m & MASK_UNEVEN) {
+                        int ao[4] = { uneven[nP * q + p][0], uneven[nP * q + p][1], uneven[nP * q + p][2], uneven[nP * q + p][3] };
+                        addQuad(vertices, dir, pos, 1, 1, id, ao);
+                        mask[nP * q + p] = 0;
+                        p++;
+                        continue;
+                    }
 
-        int last3 = (GET_S(1, 2, 2).id != ID::AIR ? 1 : 0) + (GET_S(2, 1, 2).id != ID::AIR ? 1 : 0) + (GET_S(2, 2, 2).id != ID::AIR ? 1 : 0);
-        vertices.push_back(ChunkMeshVertex(vec3(x+1, y+1, z+1), vec2(0.0, 0.5), vec3(0, 0, 1), id, (3 - last3) / 3.0));
+                    // along P, then along Q while every face in the row matches
+                    int w = 1;
+                    while (p + w < nP && mask[nP * q + p + w] == m) w++;
+
+                    int h = 1;
+                    for (; q + h < nQ; ++h) {
+                        bool same = true;
+                        for (int k = 0; k < w && same; ++k) {
+                            same = mask[nP * (q + h) + p + k] == m;
+                        }
+                        if (!same) break;
+                    }
+
+                    for (int j = 0; j < h; ++j) {
+                        for (int k = 0; k < w; ++k) {
+                            mask[nP * (q + j) + p + k] = 0;
+                        }
+                    }
 
-        faces.push_back({idx, idx+2, idx+1});
-        faces.push_back({idx+1, idx+2, idx+3});
+                    int ao = (m >> 8) & 0xFF, aos[4] = { ao, ao, ao, ao };
+                    addQuad(vertices, dir, pos, w, h, id, aos);
+                    p += w;
+                }
+            }
+        }
     }
+}
 
-    if (doBac) {
-        // we are on top, so always render the top face
-        int idx = vertices.size();
 
-        int last0 = (GET_S(0, 0, 0).id != ID::AIR ? 1 : 0) + (GET_S(1, 0, 0).id != ID::AIR ? 1 : 0) + (GET_S(0, 1, 0).id != ID::AIR ? 1 : 0);
-        vertices.push_back(ChunkMeshVertex(vec3(x, y, z),     vec2(0.0, 1.0), vec3(0, 0, -1), id, (3 - last0) / 3.0));
+/* BINARY MESHING */
 
-        int last1 = (GET_S(0, 2, 0).id != ID::AIR ? 1 : 0) + (GET_S(0, 1, 0).id != ID::AIR ? 1 : 0) + (GET_S(1, 2, 0).id != ID::AIR ? 1 : 0);
-        vertices.push_back(ChunkMeshVertex(vec3(x, y+1, z),   vec2(0.0, 0.5), vec3(0, 0, -1), id, (3 - last1) / 3.0));
+// the columns of a section, with a border of 1 block all around (along every axis), as bitmasks
+// bit 'k' of a column is the block at y = y0 - 1 + k, so a section with its border fits in 32 bits
+static_assert(ChunkMesh::SECTION_SIZE + 2 <= 32, "a section's columns must fit in a 'uint32_t'");
 
-        int last2 = (GET_S(2, 1, 0).id != ID::AIR ? 1 : 0) + (GET_S(1, 0, 0).id != ID::AIR ? 1 : 0) + (GET_S(2, 0, 0).id != ID::AIR ? 1 : 0);
-        vertices.push_back(ChunkMeshVertex(vec3(x+1, y, z),   vec2(0.5, 1.0), vec3(0, 0, -1), id, (3 - last2) / 3.0));
+// shift a column so that bit 'k' is what was at bit 'k + d' (for d in -1..1)
+static inline uint32_t shiftColumn(uint32_t col, int d) {
+    return d > 0 ? col >> d : col << -d;
+}
 
-        int last3 = (GET_S(1, 2, 0).id != ID::AIR ? 1 : 0) + (GET_S(2, 1, 0).id != ID::AIR ? 1 : 0) + (GET_S(2, 2, 0).id != ID::AIR ? 1 : 0);
-        vertices.push_back(ChunkMeshVertex(vec3(x+1, y+1, z), vec2(0.5, 0.5), vec3(0, 0, -1), id, (3 - last3) / 3.0));
+// add a quad for every visible face of the blocks from y0 to y1 (exclusive) of a chunk, using bitmasks
+static void addBinary(List<ChunkMeshVertex>& vertices, const ChunkMesh::Padded& pad, int y0, int y1) {
+    int n = y1 - y0;
+    if (n <= 0) return;
 
-        faces.push_back({idx, idx+1, idx+2});
-        faces.push_back({idx+1, idx+3, idx+2});
+    // the bits that are in the world (since above & below it is always air), and those that are the
+    //   section itself (not its border)
+    uint32_t world = 0, inner = ((1u << n) - 1) << 1;
+    for (int k = 0; k < n + 2; ++k) {
+        if (y0 - 1 + k >= 0 && y0 - 1 + k < CHUNK_SIZE_Y) world |= 1u << k;
     }
-    // done with this face
 
+    // the blocks that are solid (which occlude for the ambient occlusion), and those that hide the
+    //   faces next to them (which also includes all of a chunk that isn't there), at [x + 1][z + 1]
+    uint32_t solid[CHUNK_SIZE_X + 2][CHUNK_SIZE_Z + 2];
+    uint32_t hides[CHUNK_SIZE_X + 2][CHUNK_SIZE_Z + 2];
+
+    for (int x = -1; x <= CHUNK_SIZE_X; ++x) {
+        for (int z = -1; z <= CHUNK_SIZE_Z; ++z) {
+            // faces on the edge of a loaded chunk are hidden until the chunk next to it is there
+            if (!pad.present[x + 1][z + 1]) {
+                solid[x + 1][z + 1] = 0;
+                hides[x + 1][z + 1] = world;
+                continue;
+            }
+
+            const ID* col = &pad.ids[ChunkMesh::Padded::getIndex(x, 0, z)];
+            uint32_t m = 0;
+            for (int k = 0; k < n + 2; ++k) {
+                if (world & (1u << k)) m |= (uint32_t)(col[y0 - 1 + k] != ID::AIR) << k;
+            }
+            solid[x + 1][z + 1] = hides[x + 1][z + 1] = m;
+        }
+    }
+
+    // the faces of each column that aren't hidden by the blocks they face, for each direction, which
+    //   are all found first, so the vertices can be reserved up front
+    uint32_t visible[6][CHUNK_SIZE_X][CHUNK_SIZE_Z];
+    int numFaces = 0;
+    for (int d = 0; d < 6; ++d) {
+        const Direction& dir = DIRECTIONS[d];
+        for (int x = 0; x < CHUNK_SIZE_X; ++x) {
+            for (int z = 0; z < CHUNK_SIZE_Z; ++z) {
+                uint32_t self = solid[x + 1][z + 1] & inner, vis;
+                if (dir.axis == 1) {
+                    vis = self & ~shiftColumn(hides[x + 1][z + 1], dir.sign);
+                } else if (dir.axis == 0) {
+                    vis = self & ~hides[x + 1 + dir.sign][z + 1];
+                } else {
+                    vis = self & ~hides[x + 1][z + 1 + dir.sign];
+                }
+                visible[d][x][z] = vis;
+                numFaces += __builtin_popcount(vis);
+            }
+        }
+    }
+    vertices.reserve(vertices.size() + 4 * numFaces);
+
+    for (int d = 0; d < 6; ++d) {
+        const Direction& dir = DIRECTIONS[d];
+
+        // the offset of each vertex of a face from its block, and which corner it is (see 'addQuad()')
+        vec3i offset[4];
+        int corner[4];
+        for (int i = 0; i < 4; ++i) {
+            int c = dir.swap && (i == 1 || i == 2) ? 3 - i : i;
+            offset[i] = vec3i(0);
+            if (dir.sign > 0) offset[i][dir.axis] += 1;
+            offset[i][dir.P] += c >> 1;
+            offset[i][dir.Q] += c & 1;
+            corner[i] = c;
+        }
+
+        for (int x = 0; x < CHUNK_SIZE_X; ++x) {
+            for (int z = 0; z < CHUNK_SIZE_Z; ++z) {
+                uint32_t vis = visible[d][x][z];
+                if (vis == 0) continue;
+
+                // the layer the faces look into, as columns lined up with this one, so that bit 'k' of
+                //   'layer[i][j]' is what is next to the face of the block at bit 'k', offset by 'i - 1'
+                //   along P and 'j - 1' along Q
+                uint32_t layer[3][3];
+                for (int i = 0; i < 3; ++i) {
+                    for (int j = 0; j < 3; ++j) {
+                        if (dir.axis == 1) {
+                            layer[i][j] = shiftColumn(solid[x + i][z + j], dir.sign);
+                        } else if (dir.axis == 0) {
+                            layer[i][j] = shiftColumn(solid[x + 1 + dir.sign][z + j], i - 1);
+                        } else {
+                            layer[i][j] = shiftColumn(solid[x + i][z + 1 + dir.sign], j - 1);
+                        }
+                    }
+                }
+
+                // count the solid blocks around each corner of every face at once, in the same way as
+                //   'addBlock()', as 2 bits ('aoLo' and 'aoHi') of the count of 3 blocks
+                uint32_t aoLo[4], aoHi[4];
+                for (int c = 0; c < 4; ++c) {
+                    int oP = (c >> 1) ? 2 : 0, oQ = (c & 1) ? 2 : 0;
+                    uint32_t sideP = layer[oP][1], sideQ = layer[1][oQ], diag = layer[oP][oQ];
+                    aoLo[c] = sideP ^ sideQ ^ diag;
+                    aoHi[c] = (sideP & sideQ) | (diag & (sideP ^ sideQ));
+                }
+
+                const ID* col = &pad.ids[ChunkMesh::Padded::getIndex(x, 0, z)];
+                while (vis != 0) {
+                    int k = __builtin_ctz(vis);
+                    vis &= vis - 1;
+
+                    int y = y0 - 1 + k, id = col[y];
+                    for (int i = 0; i < 4; ++i) {
+                        int c = corner[i], ao = ((aoLo[c] >> k) & 1) + 2 * ((aoHi[c] >> k) & 1);
+                        vertices.push_back(ChunkMeshVertex(vec3i(x, y, z) + offset[i], dir.face, ao, id));
+                    }
+                }
+            }
+        }
+    }
 }
 
-// update the mesh from a given chunk data
-void ChunkMesh::update(Chunk* chunk) {
 
-    // reset the variables here
-    vertices = {};
-    faces = {};
+// build the geometry of some sections of a chunk
+void ChunkMesh::build(Chunk* chunk, Mesher mesher, List<ChunkMeshVertex>* sections, uint32_t sectionMask) {
+    Padded* pad = new Padded;
+    pad->fill(chunk, sectionMask);
+    build(*pad, mesher, sections, sectionMask);
+    delete pad;
+}
 
-    // iterate through all non-empty blocks, adding them
-    // TODO: maybe use the dirtyMin/Max to only update parts of the mesh?
-    for (int x = 0; x < CHUNK_SIZE_X; ++x) {
-        for (int z = 0; z < CHUNK_SIZE_Z; ++z) {
-            for (int y = 0; y < CHUNK_SIZE_Y; ++y) {
-                if (chunk->get(x, y, z).id != ID::AIR) {
-                    addBlock(vertices, faces, chunk, x, y, z);
+// build the geometry of some sections of a padded chunk
+void ChunkMesh::build(const Padded& pad, Mesher mesher, List<ChunkMeshVertex>* sections, uint32_t sectionMask) {
+
+    // the flags for MESHER_FACES (see 'fillFlags()'), which are only allocated if they are used
+    List<uint8_t> flags;
+
+    for (int i = 0; i < NUM_SECTIONS; ++i) {
+        if (!(sectionMask & (1u << i))) continue;
+
+        // reset the variables here
+        List<ChunkMeshVertex>& vertices = sections[i];
+        vertices.clear();
+
+        // nothing above the highest block has any faces (and the rows above it weren't copied)
+        int y0 = SECTION_SIZE * i, y1 = std::min(y0 + SECTION_SIZE, pad.top);
+        if (y1 <= y0) continue;
+
+        if (mesher == MESHER_GREEDY) {
+            addGreedy(vertices, pad, y0, y1);
+        } else if (mesher == MESHER_BINARY) {
+            addBinary(vertices, pad, y0, y1);
+        } else {
+            // work out what the section looks at, so each block only needs constant offsets
+            if (flags.size() == 0) flags.resize(Padded::NUM_BLOCKS);
+            fillFlags(&flags[0], pad, y0, y1);
+
+            // iterate through all non-empty blocks, adding them
+            for (int x = 0; x < CHUNK_SIZE_X; ++x) {
+                for (int z = 0; z < CHUNK_SIZE_Z; ++z) {
+                    const ID* col = &pad.ids[Padded::getIndex(x, 0, z)];
+                    for (int y = y0; y < y1; ++y) {
+                        if (col[y] != ID::AIR) {
+                            addBlock(vertices, &flags[0], x, y, z, col[y]);
+                        }
+                    }
                 }
             }
         }
     }
 
-    // translate them to real world positions
-    for (int i = 0; i < vertices.size(); ++i) {
-        vertices[i].pos += vec3(chunk->getWorldPos());
+    // NOTE: the vertices are left relative to the chunk, and the shader moves them to 'origin' (and adds
+    //   the height to the ambient occlusion)
+}
 
-        // and add an AO effect based on height
-        vertices[i].ao *= (0.75 + 0.35 * vertices[i].pos.y / CHUNK_SIZE_Y);
+// update the mesh from a given chunk data
+void ChunkMesh::update(Chunk* chunk, Mesher mesher, uint32_t sectionMask) {
+    List<ChunkMeshVertex> built[NUM_SECTIONS];
+    build(chunk, mesher, built, sectionMask);
+    origin = chunk->getWorldPos();
+
+    for (int i = 0; i < NUM_SECTIONS; ++i) {
+        if (!(sectionMask & (1u << i))) continue;
+        std::swap(sections[i].vertices, built[i]);
+        upload(i);
     }
+}
+
+// upload the built geometry of a section
+void ChunkMesh::upload(int section) {
+    Section& sec = sections[section];
+
+    // nothing has ever been in it, so don't bother making buffers yet
+    if (sec.glVAO == 0 && sec.vertices.size() == 0) return;
+
+    // make sure there are enough shared indices to draw it
+    reserveQuads(sec.vertices.size() / 4);
+
+    if (sec.glVAO == 0) {
+        // create OpenGL handles for everything
+        glGenVertexArrays(1, &sec.glVAO);
+        glGenBuffers(1, &sec.glVBO);
+
+        // now, innitialize the OpenGL information
+        glBindVertexArray(sec.glVAO);
+
+        // draw from the shared indices
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, glQuadEBO);
 
-    // now, store in the OpenGL objects
-    glBindVertexArray(glVAO);
+        // load data into vertex buffers
+        glBindBuffer(GL_ARRAY_BUFFER, sec.glVBO);
+        // set the vertex attribute pointers
+
+        // the packed vertices (see 'ChunkMeshVertex'), which are integers all the way to the shader
+        glEnableVertexAttribArray(0);
+        glVertexAttribIPointer(0, 2, GL_UNSIGNED_INT, sizeof(ChunkMeshVertex), (void*)0);
+    } else {
+        // now, store in the OpenGL objects
+        glBindVertexArray(sec.glVAO);
+    }
 
     // now, upload the data
     // load data into vertex buffers
-    glBindBuffer(GL_ARRAY_BUFFER, glVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, sec.glVBO);
 
     // A great thing about structs is that their memory layout is sequential for all its items.
     // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a vec3/2 array which
     // again translates to 3/2 floats which translates to a byte array.
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(ChunkMeshVertex), &vertices[0], GL_DYNAMIC_DRAW);  
-
-    // add the faces to the EBO
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, glEBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, faces.size() * 3 * sizeof(int), &faces[0], GL_DYNAMIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, sec.vertices.size() * sizeof(ChunkMeshVertex), sec.vertices.data(), GL_DYNAMIC_DRAW);
 
     // unbind this state
     glBindVertexArray(0);
 
-}
-
-// construct a mesh from a list of vertices and faces.
-//   each face is a list of indexes into the vertices array, making up
-//   triangles
-ChunkMesh::ChunkMesh() {
-
-    // create OpenGL handles for everything
-    glGenVertexArrays(1, &glVAO);
-    glGenBuffers(1, &glVBO);
-    glGenBuffers(1, &glEBO);
-
-    // now, innitialize the OpenGL information and send the vertex data to the GPU
-    glBindVertexArray(glVAO);
-    
-    // load data into vertex buffers
-    glBindBuffer(GL_ARRAY_BUFFER, glVBO);
-    // set the vertex attribute pointers
+    // OpenGL has its own copy now, so free ours (rather than just clearing it)
+    sec.numQuads = sec.vertices.size() / 4;
+    List<ChunkMeshVertex>().swap(sec.vertices);
 
-    // vertex Positions
-    glEnableVertexAttribArray(0);	
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(ChunkMeshVertex), (void*)offsetof(ChunkMeshVertex, pos));
+}
 
-    // vertex texture coords
-    glEnableVertexAttribArray(1);	
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(ChunkMeshVertex), (void*)offsetof(ChunkMeshVertex, uv));
+// the shared indices, and how many quads they cover
+uint ChunkMesh::glQuadEBO = 0;
+int ChunkMesh::numQuadEBO = 0;
 
-    // vertex tangent
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(ChunkMeshVertex), (void*)offsetof(ChunkMeshVertex, T));
+// the triangles of a quad, which wind clockwise for the corners in the order the meshers add them
+const int ChunkMesh::QUAD_INDICES[6] = { 0, 1, 2, 1, 3, 2 };
 
-    // vertex bitangent
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(ChunkMeshVertex), (void*)offsetof(ChunkMeshVertex, B));
+// make sure the shared indices cover enough quads
+void ChunkMesh::reserveQuads(int numQuads) {
+    if (glQuadEBO != 0 && numQuads <= numQuadEBO) return;
 
-    // vertex normals
-    glEnableVertexAttribArray(4);	
-    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(ChunkMeshVertex), (void*)offsetof(ChunkMeshVertex, N));
+    // grow by at least double, so it is only regenerated a few times
+    numQuadEBO = std::max(numQuads, std::max(2 * numQuadEBO, 16384));
 
-    // vertex block ID
-    glEnableVertexAttribArray(5);	
-    glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, sizeof(ChunkMeshVertex), (void*)offsetof(ChunkMeshVertex, blockID));
+    List<uint32_t> indices(6 * numQuadEBO);
+    for (int i = 0; i < numQuadEBO; ++i) {
+        for (int j = 0; j < 6; ++j) {
+            indices[6 * i + j] = 4 * i + QUAD_INDICES[j];
+        }
+    }
 
-    // ambient occlusion
-    glEnableVertexAttribArray(6);	
-    glVertexAttribPointer(6, 1, GL_FLOAT, GL_FALSE, sizeof(ChunkMeshVertex), (void*)offsetof(ChunkMeshVertex, ao));
+    // the same buffer is kept (so every chunk mesh's VAO still refers to it), and it is bound through a
+    //   target that isn't part of the VAO state, so whatever VAO is bound is left alone
+    if (glQuadEBO == 0) glGenBuffers(1, &glQuadEBO);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, glQuadEBO);
+    glBufferData(GL_COPY_WRITE_BUFFER, indices.size() * sizeof(uint32_t), &indices[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
 
+// construct a mesh, with no vertices
+ChunkMesh::ChunkMesh() {
 
-    // unbind state
-    glBindVertexArray(0);
+    // the OpenGL handles of each section are only created once it has something in it (see 'upload()')
+    for (Section& sec : sections) {
+        sec.glVAO = sec.glVBO = 0;
+        sec.numQuads = 0;
+    }
 }
 
 // deconstruct the mesh
 ChunkMesh::~ChunkMesh() {
     // just delete our OpenGL handles's resourceses
-    glDeleteVertexArrays(1, &glVAO);
-    glDeleteBuffers(1, &glVBO);
-    glDeleteBuffers(1, &glEBO);
+    for (Section& sec : sections) {
+        if (sec.glVAO == 0) continue;
+        glDeleteVertexArrays(1, &sec.glVAO);
+        glDeleteBuffers(1, &sec.glVBO);
+    }
 }
 
 
@@ -0,0 +1,120 @@
+/* render/ChunkMeshWorkers.cc - building chunk meshes on background threads
+ *
+ * A job's snapshot only holds what 'ChunkMesh::build()' reads: the IDs of the chunk's blocks, with a border
+ *   of 1 block from its neighbours (for face culling & ambient occlusion), which is taken on the main thread
+ *   with 'ChunkMesh::Padded::fill()', so the meshers see exactly what they would have there
+ *
+ */
+
+#include <Blok/Render.hh>
+
+namespace Blok::Render {
+
+// start the workers
+ChunkMeshWorkers::ChunkMeshWorkers(int numThreads) {
+    if (numThreads <= 0) numThreads = std::max((int)std::thread::hardware_concurrency() - 1, 1);
+
+    stats.n_submitted = stats.n_built = 0;
+    stats.t_snapshot = stats.t_build = 0.0;
+
+    numBuilding = 0;
+    nextSeq = 1;
+
+    running = true;
+    for (int i = 0; i < numThreads; ++i) {
+        T_workers.push_back(std::thread(&ChunkMeshWorkers::T_worker_run, this));
+    }
+}
+
+// stop the workers, and throw away any unfinished jobs
+ChunkMeshWorkers::~ChunkMeshWorkers() {
+    std::unique_lock<std::mutex> lock(L_jobs);
+    running = false;
+    C_queued.notify_all();
+    lock.unlock();
+
+    for (std::thread& worker : T_workers) {
+        worker.join();
+    }
+
+    for (Job* job : queued) {
+        delete job->pad;
+        delete job;
+    }
+    for (Job* job : done) {
+        delete job;
+    }
+}
+
+// snapshot a chunk, and queue it
+uint64_t ChunkMeshWorkers::submit(Chunk* chunk, ChunkMesh::Mesher mesher, uint32_t sectionMask) {
+    double stime = getTime();
+
+    Job* job = new Job();
+    job->chunk = chunk;
+    job->id = chunk->XZ;
+    job->mesher = mesher;
+    job->sections = sectionMask;
+    job->t_build = 0.0;
+
+    job->pad = new ChunkMesh::Padded;
+    job->pad->fill(chunk, sectionMask);
+
+    std::unique_lock<std::mutex> lock(L_jobs);
+    job->seq = nextSeq++;
+    queued.push_back(job);
+    stats.n_submitted++;
+    stats.t_snapshot += getTime() - stime;
+    C_queued.notify_one();
+
+    return job->seq;
+}
+
+// take a finished job
+ChunkMeshWorkers::Job* ChunkMeshWorkers::poll() {
+    std::unique_lock<std::mutex> lock(L_jobs);
+    if (done.size() == 0) return NULL;
+
+    Job* job = done.front();
+    done.pop_front();
+    return job;
+}
+
+// return the number of jobs that aren't finished (or are, but haven't been taken)
+int ChunkMeshWorkers::numPending() {
+    std::unique_lock<std::mutex> lock(L_jobs);
+    return queued.size() + numBuilding + done.size();
+}
+
+// build jobs, until told to stop
+void ChunkMeshWorkers::T_worker_run() {
+    std::unique_lock<std::mutex> lock(L_jobs);
+
+    while (true) {
+        while (running && queued.size() == 0) {
+            C_queued.wait(lock);
+        }
+        if (!running) break;
+
+        Job* job = queued.front();
+        queued.pop_front();
+        numBuilding++;
+        lock.unlock();
+
+        double stime = getTime();
+
+        ChunkMesh::build(*job->pad, job->mesher, job->vertices, job->sections);
+        delete job->pad;
+        job->pad = NULL;
+
+        job->t_build = getTime() - stime;
+
+        lock.lock();
+        numBuilding--;
+        done.push_back(job);
+        stats.n_built++;
+        stats.t_build += job->t_build;
+    }
+}
+
+}
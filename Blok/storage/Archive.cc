@@ -0,0 +1,429 @@
+/* storage/Archive.cc - implementation of world import/export, as a single archive
+ *
+ * A world archive is a (pax) tar file, which looks like:
+ *   - the manifest (`WORLD_MANIFEST`), a few lines of text: "Blok world 1", the build that wrote it,
+ *       and the number of files that follow
+ *   - each file of the world directory, gzip compressed on its own, with ".gz" added to its name
+ *
+ * Compressing each file on its own (rather than the whole tar) means they can be compressed in
+ *   parallel, and the archive can still be unpacked with standard tools
+ *
+ */
+
+#include <Blok/Storage.hh>
+
+// for reading & writing the archive
+#include <archive.h>
+#include <archive_entry.h>
+
+// for compressing files
+#include <zlib.h>
+
+// for file operations
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <atomic>
+
+namespace Blok::Storage {
+
+// the name of the manifest entry
+const char* WORLD_MANIFEST = "blok-world.txt";
+
+// the first line of the manifest, which includes the version of the archive layout
+static const char* MANIFEST_HEADER = "Blok world 1";
+
+// the suffix added to the names of compressed files
+static const String GZ_SUFFIX = ".gz";
+
+// return whether a file name is safe to create in the world directory (i.e. it can't escape it)
+static bool isSafeName(const String& name) {
+    return name.size() > 0 && name[0] != '.' && name.find('/') == String::npos;
+}
+
+// read all of a file into 'out', returning whether it was successful
+static bool readFile(const String& fname, List<uint8_t>& out) {
+    int fd = ::open(fname.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    out.resize(st.st_size);
+    size_t pos = 0;
+    while (pos < out.size()) {
+        ssize_t res = ::read(fd, &out[pos], out.size() - pos);
+        if (res < 0 && errno == EINTR) continue;
+        if (res <= 0) break;
+        pos += res;
+    }
+    ::close(fd);
+
+    // it may have been truncated while reading
+    out.resize(pos);
+    return true;
+}
+
+// gzip compress 'data' into 'out', returning whether it was successful
+static bool gzipData(const List<uint8_t>& data, List<uint8_t>& out) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+
+    // 16 extra window bits asks for a gzip header, rather than a zlib one
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) return false;
+
+    out.resize(deflateBound(&zs, data.size()) + 32);
+    zs.next_in = (Bytef*)data.data();
+    zs.avail_in = data.size();
+    zs.next_out = &out[0];
+    zs.avail_out = out.size();
+
+    int res = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+
+    return res == Z_STREAM_END;
+}
+
+// export a world
+bool exportWorld(const String& path, const String& file, int numThreads) {
+    // collect the files in the world (in a consistent order)
+    List<String> names;
+    DIR* dir = opendir(path.c_str());
+    if (dir == NULL) {
+        blok_error("Failed to open world directory '%s': %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != NULL) {
+        String name = ent->d_name;
+        struct stat st;
+        if (!isSafeName(name) || stat((path + "/" + name).c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+        names.push_back(name);
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+
+    if (numThreads <= 0) numThreads = std::thread::hardware_concurrency();
+    if (numThreads <= 0) numThreads = 1;
+
+    struct archive* ar = archive_write_new();
+    archive_write_set_format_pax_restricted(ar);
+    if (archive_write_open_filename(ar, file == "-" ? NULL : file.c_str()) != ARCHIVE_OK) {
+        blok_error("Failed to open archive '%s': %s", file.c_str(), archive_error_string(ar));
+        archive_write_free(ar);
+        return false;
+    }
+
+    // write an entry, returning whether it was successful
+    auto writeEntry = [&](const String& name, const uint8_t* data, size_t size, time_t mtime) -> bool {
+        struct archive_entry* entry = archive_entry_new();
+        archive_entry_set_pathname(entry, name.c_str());
+        archive_entry_set_size(entry, size);
+        archive_entry_set_filetype(entry, AE_IFREG);
+        archive_entry_set_perm(entry, 0644);
+        archive_entry_set_mtime(entry, mtime, 0);
+
+        bool ok = archive_write_header(ar, entry) == ARCHIVE_OK && (size == 0 || archive_write_data(ar, data, size) == (la_ssize_t)size);
+        archive_entry_free(entry);
+        return ok;
+    };
+
+    double stime = getTime();
+    bool ok = true;
+
+    char manifest[256];
+    snprintf(manifest, sizeof(manifest), "%s\nbuild %i.%i.%i\nfiles %i\n", MANIFEST_HEADER, BUILD_MAJOR, BUILD_MINOR, BUILD_PATCH, (int)names.size());
+    ok = writeEntry(WORLD_MANIFEST, (const uint8_t*)manifest, strlen(manifest), time(NULL));
+
+    // Slot - a file that is being compressed (or is waiting to be written)
+    struct Slot {
+
+        // the compressed file
+        List<uint8_t> data;
+
+        // the size of the file before compression
+        size_t rawSize;
+
+        // the modification time of the file
+        time_t mtime;
+
+        // whether it has been compressed, and whether that was successful
+        bool ready, ok;
+
+    };
+
+    List<Slot> slots(names.size());
+
+    // only this many files are compressed ahead of the one being written, so memory stays bounded
+    int window = 2 * numThreads;
+
+    // the next file to compress, and the number of files written so far
+    std::atomic<int> next(0);
+    int written = 0;
+
+    // this mutex controls access to 'slots' and 'written'
+    std::mutex L_slots;
+
+    // signaled when a file is compressed, or written
+    std::condition_variable C_slots;
+
+    // whether the writer has given up (so the workers should stop)
+    bool failed = !ok;
+
+    auto worker = [&]() {
+        int i;
+        while ((i = next++) < (int)names.size()) {
+            {
+                std::unique_lock<std::mutex> lock(L_slots);
+                C_slots.wait(lock, [&]() { return failed || i < written + window; });
+                if (failed) return;
+            }
+
+            String fname = path + "/" + names[i];
+            struct stat st;
+            List<uint8_t> raw, data;
+            bool res = stat(fname.c_str(), &st) == 0 && readFile(fname, raw) && gzipData(raw, data);
+
+            std::unique_lock<std::mutex> lock(L_slots);
+            slots[i].data.swap(data);
+            slots[i].rawSize = raw.size();
+            slots[i].mtime = res ? st.st_mtime : 0;
+            slots[i].ok = res;
+            slots[i].ready = true;
+            C_slots.notify_all();
+        }
+    };
+
+    for (Slot& slot : slots) {
+        slot.ready = slot.ok = false;
+    }
+
+    List<std::thread> threads;
+    for (int i = 0; i < numThreads; ++i) {
+        threads.push_back(std::thread(worker));
+    }
+
+    // write them in order, as they finish
+    uint64_t n_raw = 0, n_compressed = 0;
+    for (int i = 0; ok && i < (int)names.size(); ++i) {
+        std::unique_lock<std::mutex> lock(L_slots);
+        C_slots.wait(lock, [&]() { return slots[i].ready; });
+        lock.unlock();
+
+        if (!slots[i].ok) {
+            blok_error("Failed to read & compress '%s/%s'", path.c_str(), names[i].c_str());
+            ok = false;
+        } else if (!writeEntry(names[i] + GZ_SUFFIX, slots[i].data.data(), slots[i].data.size(), slots[i].mtime)) {
+            blok_error("Failed to write '%s' to archive '%s': %s", names[i].c_str(), file.c_str(), archive_error_string(ar));
+            ok = false;
+        }
+
+        n_raw += slots[i].rawSize;
+        n_compressed += slots[i].data.size();
+
+        lock.lock();
+        List<uint8_t>().swap(slots[i].data);
+        written++;
+        C_slots.notify_all();
+    }
+
+    // let any waiting workers go
+    L_slots.lock();
+    failed = !ok;
+    C_slots.notify_all();
+    L_slots.unlock();
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    if (archive_write_close(ar) != ARCHIVE_OK) {
+        blok_error("Failed to finish archive '%s': %s", file.c_str(), archive_error_string(ar));
+        ok = false;
+    }
+    archive_write_free(ar);
+
+    stime = getTime() - stime;
+    if (ok) {
+        blok_info("Exported %i files (%.1lfMB, %.1lfMB compressed) from '%s' in %.2lfs (%.1lfMB/sec)", (int)names.size(), n_raw / 1e6, n_compressed / 1e6, path.c_str(), stime, n_raw / (1e6 * stime));
+    }
+
+    return ok;
+}
+
+// decompress the data of the current entry of 'ar' into the file 'fname', returning the number of bytes
+//   written (or -1 if it failed)
+static int64_t inflateEntry(struct archive* ar, const String& fname) {
+    // write it to the side first, so a failed import never leaves a partial file with the real name
+    String tmpname = fname + ".tmp";
+    int fd = ::open(tmpname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // 16 extra window bits only accepts a gzip header
+    if (inflateInit2(&zs, 15 + 16) != Z_OK) {
+        ::close(fd);
+        unlink(tmpname.c_str());
+        return -1;
+    }
+
+    uint8_t buf[1 << 16];
+    int64_t total = 0;
+    int zres = Z_OK;
+    bool ok = true;
+
+    const void* block;
+    size_t size;
+    la_int64_t offset;
+    int ares = ARCHIVE_OK;
+    while (ok && (ares = archive_read_data_block(ar, &block, &size, &offset)) == ARCHIVE_OK) {
+        zs.next_in = (Bytef*)block;
+        zs.avail_in = size;
+        while (ok && zs.avail_in > 0 && zres != Z_STREAM_END) {
+            zs.next_out = buf;
+            zs.avail_out = sizeof(buf);
+            zres = inflate(&zs, Z_NO_FLUSH);
+            if (zres != Z_OK && zres != Z_STREAM_END) {
+                ok = false;
+                break;
+            }
+
+            // write out what was decompressed
+            size_t have = sizeof(buf) - zs.avail_out;
+            size_t pos = 0;
+            while (pos < have) {
+                ssize_t res = ::write(fd, buf + pos, have - pos);
+                if (res < 0 && errno == EINTR) continue;
+                if (res <= 0) {
+                    ok = false;
+                    break;
+                }
+                pos += res;
+            }
+            total += have;
+        }
+    }
+    inflateEnd(&zs);
+
+    ok = ok && ares == ARCHIVE_EOF && zres == Z_STREAM_END && fsync(fd) == 0;
+    ok = ::close(fd) == 0 && ok;
+
+    if (!ok || rename(tmpname.c_str(), fname.c_str()) != 0) {
+        unlink(tmpname.c_str());
+        return -1;
+    }
+
+    return total;
+}
+
+// import a world
+bool importWorld(const String& file, const String& path) {
+    // make sure the directory exists, and doesn't already have a world in it
+    if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST) {
+        blok_error("Failed to create world directory '%s': %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    DIR* dir = opendir(path.c_str());
+    if (dir == NULL) {
+        blok_error("Failed to open world directory '%s': %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    struct dirent* ent;
+    bool empty = true;
+    while ((ent = readdir(dir)) != NULL) {
+        if (strcmp(ent->d_name, ".") != 0 && strcmp(ent->d_name, "..") != 0) empty = false;
+    }
+    closedir(dir);
+    if (!empty) {
+        blok_error("Refusing to import into '%s', since it is not empty", path.c_str());
+        return false;
+    }
+
+    struct archive* ar = archive_read_new();
+    archive_read_support_format_tar(ar);
+    if (archive_read_open_filename(ar, file == "-" ? NULL : file.c_str(), 1 << 16) != ARCHIVE_OK) {
+        blok_error("Failed to open archive '%s': %s", file.c_str(), archive_error_string(ar));
+        archive_read_free(ar);
+        return false;
+    }
+
+    double stime = getTime();
+    bool ok = true, hasManifest = false;
+    int n_files = 0, n_expected = -1;
+    uint64_t n_raw = 0;
+
+    struct archive_entry* entry;
+    int res;
+    while (ok && (res = archive_read_next_header(ar, &entry)) == ARCHIVE_OK) {
+        String name = archive_entry_pathname(entry);
+
+        if (!hasManifest) {
+            // the manifest must come first, so other archives are rejected before anything is written
+            char manifest[256] = { 0 };
+            if (name != WORLD_MANIFEST || archive_read_data(ar, manifest, sizeof(manifest) - 1) < 0 || strncmp(manifest, MANIFEST_HEADER, strlen(MANIFEST_HEADER)) != 0 || manifest[strlen(MANIFEST_HEADER)] != '\n') {
+                blok_error("'%s' is not a Blok world archive (or is from a newer version)", file.c_str());
+                ok = false;
+                break;
+            }
+
+            const char* files = strstr(manifest, "\nfiles ");
+            if (files != NULL) sscanf(files, "\nfiles %i", &n_expected);
+            hasManifest = true;
+            continue;
+        }
+
+        if (archive_entry_filetype(entry) != AE_IFREG || name.size() <= GZ_SUFFIX.size() || name.compare(name.size() - GZ_SUFFIX.size(), GZ_SUFFIX.size(), GZ_SUFFIX) != 0) {
+            blok_warn("Skipping unknown entry '%s' in archive '%s'", name.c_str(), file.c_str());
+            continue;
+        }
+
+        String fname = name.substr(0, name.size() - GZ_SUFFIX.size());
+        if (!isSafeName(fname)) {
+            blok_error("Archive '%s' has an invalid file name '%s'", file.c_str(), name.c_str());
+            ok = false;
+            break;
+        }
+
+        int64_t size = inflateEntry(ar, path + "/" + fname);
+        if (size < 0) {
+            blok_error("Failed to extract '%s' from archive '%s'", name.c_str(), file.c_str());
+            ok = false;
+            break;
+        }
+
+        n_files++;
+        n_raw += size;
+    }
+
+    if (ok && res != ARCHIVE_EOF) {
+        blok_error("Failed to read archive '%s': %s", file.c_str(), archive_error_string(ar));
+        ok = false;
+    }
+    archive_read_free(ar);
+
+    if (ok && !hasManifest) {
+        blok_error("'%s' is not a Blok world archive (or is from a newer version)", file.c_str());
+        ok = false;
+    }
+    if (ok && n_expected >= 0 && n_files != n_expected) {
+        blok_error("Archive '%s' is truncated (%i of %i files)", file.c_str(), n_files, n_expected);
+        ok = false;
+    }
+
+    stime = getTime() - stime;
+    if (ok) {
+        blok_info("Imported %i files (%.1lfMB) into '%s' in %.2lfs (%.1lfMB/sec)", n_files, n_raw / 1e6, path.c_str(), stime, n_raw / (1e6 * stime));
+    }
+
+    return ok;
+}
+
+}
@@ -0,0 +1,444 @@
+/* storage/Codec.cc - implementation of the chunk codecs
+ *
+ * RawCodec is just the `BlockData` array (id, meta), in the same XZY order as `Chunk::blocks`
+ *
+ * ColumnRLECodec is, for every column (in XZ order), its runs from the bottom up, each of which is the
+ *   length minus 1 (u8), and the block (id, meta). Runs never cross columns, so they always fit in a byte.
+ *   It is also what cold chunks are compressed with in memory (see `Chunk::compress()`, at the end)
+ *
+ * PaletteCodec and PaletteZlibCodec are:
+ *   - the number of bits per index (u8), which is 0 (every block is the first in the palette), 1, 2, 4, 8, or
+ *       PALETTE_RAW (there are more than 256 distinct blocks, and the raw blocks follow, instead of the rest)
+ *   - the number of palette entries minus 1 (u8), and the palette entries (id, meta)
+ *   - the index of each block, packed from the low bits of each byte up. For PaletteZlibCodec, this is a zlib
+ *       stream of them, which is written and read in small pieces, so the packed indices never need a buffer
+ *       of their own
+ *   The packing of the indices is shared with the sections of `MMapStorage`
+ *
+ */
+
+#include <Blok/Storage.hh>
+
+// for PaletteZlibCodec
+#include <zlib.h>
+
+namespace Blok::Storage {
+
+// the number of blocks in each column
+static const int COLUMN_BLOCKS = CHUNK_SIZE_Y;
+
+// the number of columns in a chunk
+static const int NUM_COLUMNS = CHUNK_SIZE_X * CHUNK_SIZE_Z;
+
+// the bits per index that marks chunks stored raw by the palette codecs
+static const int PALETTE_RAW = 16;
+
+// the size of the pieces the indices are packed & compressed in by PaletteZlibCodec
+static const int PIECE_BYTES = 4096;
+
+static_assert(sizeof(BlockData) == 2, "BlockData is stored as (id, meta) bytes");
+static_assert(COLUMN_BLOCKS <= 256, "column runs must fit in a byte");
+static_assert(CHUNK_NUM_BLOCKS % 8 == 0, "indices must pack into whole bytes");
+
+
+/* RAW */
+
+RawCodec::RawCodec() {
+    this->name = "raw";
+}
+
+size_t RawCodec::getBound() {
+    return sizeof(BlockData) * CHUNK_NUM_BLOCKS;
+}
+
+size_t RawCodec::encode(const BlockData* blocks, uint8_t* out) {
+    memcpy(out, blocks, sizeof(BlockData) * CHUNK_NUM_BLOCKS);
+    return sizeof(BlockData) * CHUNK_NUM_BLOCKS;
+}
+
+bool RawCodec::decode(const uint8_t* data, size_t size, BlockData* blocks) {
+    if (size != sizeof(BlockData) * CHUNK_NUM_BLOCKS) return false;
+    memcpy(blocks, data, size);
+    return true;
+}
+
+
+/* COLUMN RLE */
+
+ColumnRLECodec::ColumnRLECodec() {
+    this->name = "column RLE";
+}
+
+// every block could be its own run
+size_t ColumnRLECodec::getBound() {
+    return 3 * CHUNK_NUM_BLOCKS;
+}
+
+size_t ColumnRLECodec::encode(const BlockData* blocks, uint8_t* out) {
+    uint8_t* ptr = out;
+    for (int c = 0; c < NUM_COLUMNS; ++c) {
+        const BlockData* col = &blocks[COLUMN_BLOCKS * c];
+        int y = 0;
+        while (y < COLUMN_BLOCKS) {
+            BlockData val = col[y];
+            int end = y + 1;
+            while (end < COLUMN_BLOCKS && col[end].id == val.id && col[end].meta == val.meta) end++;
+
+            ptr[0] = end - y - 1;
+            ptr[1] = val.id;
+            ptr[2] = val.meta;
+            ptr += 3;
+            y = end;
+        }
+    }
+    return ptr - out;
+}
+
+bool ColumnRLECodec::decode(const uint8_t* data, size_t size, BlockData* blocks) {
+    const uint8_t* end = data + size;
+    for (int c = 0; c < NUM_COLUMNS; ++c) {
+        BlockData* col = &blocks[COLUMN_BLOCKS * c];
+        int y = 0;
+        while (y < COLUMN_BLOCKS) {
+            if (end - data < 3) return false;
+            int len = data[0] + 1;
+            if (y + len > COLUMN_BLOCKS) return false;
+
+            std::fill(col + y, col + y + len, BlockData((ID)data[1], data[2]));
+            data += 3;
+            y += len;
+        }
+    }
+    return data == end;
+}
+
+
+/* PALETTES */
+
+// build the palette of a chunk and the index of every block into it, returning the number of entries,
+//   or 0 if there are too many
+static int buildPalette(const BlockData* blocks, BlockData palette[256], uint8_t* idx) {
+    int n = 0;
+
+    // the last index found, since runs of the same block are common
+    int last = 0;
+    for (int i = 0; i < CHUNK_NUM_BLOCKS; ++i) {
+        BlockData val = blocks[i];
+        if (n == 0 || palette[last].id != val.id || palette[last].meta != val.meta) {
+            last = 0;
+            while (last < n && (palette[last].id != val.id || palette[last].meta != val.meta)) last++;
+            if (last == n) {
+                if (n == 256) return 0;
+                palette[n++] = val;
+            }
+        }
+        idx[i] = last;
+    }
+
+    return n;
+}
+
+// return the bits per index needed for a palette of 'n' entries
+static int paletteBits(int n) {
+    return n == 0 ? PALETTE_RAW : n == 1 ? 0 : n <= 2 ? 1 : n <= 4 ? 2 : n <= 16 ? 4 : 8;
+}
+
+// write the header and palette, returning the number of bytes written
+static int writePalette(uint8_t* out, int bits, const BlockData* palette, int n) {
+    out[0] = bits;
+    if (bits == PALETTE_RAW) return 1;
+
+    out[1] = n - 1;
+    for (int i = 0; i < n; ++i) {
+        out[2 + 2 * i] = palette[i].id;
+        out[3 + 2 * i] = palette[i].meta;
+    }
+    return 2 + 2 * n;
+}
+
+// read the header and palette, returning the number of bytes read, or 0 if they were invalid
+// Unused entries (up to 256) are set to air, so out of range indices never read past the palette
+static int readPalette(const uint8_t* data, size_t size, int& bits, BlockData palette[256]) {
+    if (size < 1) return 0;
+    bits = data[0];
+    if (bits == PALETTE_RAW) return 1;
+    if ((bits != 0 && bits != 1 && bits != 2 && bits != 4 && bits != 8) || size < 2) return 0;
+
+    int n = data[1] + 1;
+    if (size < 2 + 2 * (size_t)n) return 0;
+    for (int i = 0; i < n; ++i) {
+        palette[i] = BlockData((ID)data[2 + 2 * i], data[3 + 2 * i]);
+    }
+    for (int i = n; i < 256; ++i) {
+        palette[i] = BlockData();
+    }
+    return 2 + 2 * n;
+}
+
+// pack 'count' indices into 'count * BITS / 8' bytes
+template<int BITS>
+static void packBits(const uint8_t* idx, int count, uint8_t* out) {
+    const int per = 8 / BITS;
+    for (int o = 0; o < count / per; ++o) {
+        uint8_t val = 0;
+        for (int k = 0; k < per; ++k) {
+            val |= idx[per * o + k] << (BITS * k);
+        }
+        out[o] = val;
+    }
+}
+
+// unpack 'size' bytes of indices, looking each one up in the palette
+template<int BITS>
+static void unpackBits(const uint8_t* data, int size, const BlockData* palette, BlockData* out) {
+    const int per = 8 / BITS, mask = (1 << BITS) - 1;
+    for (int o = 0; o < size; ++o) {
+        uint8_t val = data[o];
+        for (int k = 0; k < per; ++k) {
+            out[per * o + k] = palette[(val >> (BITS * k)) & mask];
+        }
+    }
+}
+
+// pack indices with any number of bits (except 0)
+void PaletteCodec::packIndices(int bits, const uint8_t* idx, int count, uint8_t* out) {
+    switch (bits) {
+        case 1: packBits<1>(idx, count, out); break;
+        case 2: packBits<2>(idx, count, out); break;
+        case 4: packBits<4>(idx, count, out); break;
+        default: memcpy(out, idx, count); break;
+    }
+}
+
+// unpack indices with any number of bits (except 0)
+void PaletteCodec::unpackIndices(int bits, const uint8_t* data, int size, const BlockData* palette, BlockData* out) {
+    switch (bits) {
+        case 1: unpackBits<1>(data, size, palette, out); break;
+        case 2: unpackBits<2>(data, size, palette, out); break;
+        case 4: unpackBits<4>(data, size, palette, out); break;
+        default: unpackBits<8>(data, size, palette, out); break;
+    }
+}
+
+
+/* PALETTE */
+
+PaletteCodec::PaletteCodec() {
+    this->name = "palette";
+    this->idx.resize(CHUNK_NUM_BLOCKS);
+}
+
+// the raw blocks are the largest it can be
+size_t PaletteCodec::getBound() {
+    return 1 + sizeof(BlockData) * CHUNK_NUM_BLOCKS;
+}
+
+size_t PaletteCodec::encode(const BlockData* blocks, uint8_t* out) {
+    BlockData palette[256];
+    int n = buildPalette(blocks, palette, &idx[0]);
+    int bits = paletteBits(n);
+
+    size_t size = writePalette(out, bits, palette, n);
+    if (bits == PALETTE_RAW) {
+        memcpy(out + size, blocks, sizeof(BlockData) * CHUNK_NUM_BLOCKS);
+        return size + sizeof(BlockData) * CHUNK_NUM_BLOCKS;
+    } else if (bits > 0) {
+        packIndices(bits, &idx[0], CHUNK_NUM_BLOCKS, out + size);
+        size += CHUNK_NUM_BLOCKS * bits / 8;
+    }
+
+    return size;
+}
+
+bool PaletteCodec::decode(const uint8_t* data, size_t size, BlockData* blocks) {
+    BlockData palette[256];
+    int bits;
+    int hdr = readPalette(data, size, bits, palette);
+    if (hdr == 0) return false;
+    data += hdr;
+    size -= hdr;
+
+    if (bits == PALETTE_RAW) {
+        if (size != sizeof(BlockData) * CHUNK_NUM_BLOCKS) return false;
+        memcpy(blocks, data, size);
+    } else if (bits == 0) {
+        if (size != 0) return false;
+        std::fill(blocks, blocks + CHUNK_NUM_BLOCKS, palette[0]);
+    } else {
+        if (size != (size_t)CHUNK_NUM_BLOCKS * bits / 8) return false;
+        unpackIndices(bits, data, size, palette, blocks);
+    }
+
+    return true;
+}
+
+
+/* PALETTE + ZLIB */
+
+PaletteZlibCodec::PaletteZlibCodec(int level) {
+    this->name = "palette+zlib";
+    this->level = level;
+    this->deflater = NULL;
+    this->inflater = NULL;
+    this->idx.resize(CHUNK_NUM_BLOCKS);
+}
+
+PaletteZlibCodec::~PaletteZlibCodec() {
+    if (deflater != NULL) {
+        deflateEnd((z_stream*)deflater);
+        delete (z_stream*)deflater;
+    }
+    if (inflater != NULL) {
+        inflateEnd((z_stream*)inflater);
+        delete (z_stream*)inflater;
+    }
+}
+
+// the raw blocks, or the largest palette followed by incompressible indices
+size_t PaletteZlibCodec::getBound() {
+    return std::max<size_t>(1 + sizeof(BlockData) * CHUNK_NUM_BLOCKS, 2 + 2 * 256 + compressBound(CHUNK_NUM_BLOCKS));
+}
+
+size_t PaletteZlibCodec::encode(const BlockData* blocks, uint8_t* out) {
+    BlockData palette[256];
+    int n = buildPalette(blocks, palette, &idx[0]);
+    int bits = paletteBits(n);
+
+    size_t size = writePalette(out, bits, palette, n);
+    if (bits == PALETTE_RAW) {
+        memcpy(out + size, blocks, sizeof(BlockData) * CHUNK_NUM_BLOCKS);
+        return size + sizeof(BlockData) * CHUNK_NUM_BLOCKS;
+    } else if (bits == 0) {
+        return size;
+    }
+
+    z_stream* zs = (z_stream*)deflater;
+    if (zs == NULL) {
+        zs = new z_stream();
+        if (deflateInit(zs, level) != Z_OK) {
+            delete zs;
+            return 0;
+        }
+        deflater = zs;
+    } else if (deflateReset(zs) != Z_OK || deflateParams(zs, level, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return 0;
+    }
+
+    zs->next_out = out + size;
+    zs->avail_out = getBound() - size;
+
+    // pack a piece at a time, compressing each one as it is packed
+    uint8_t piece[PIECE_BYTES];
+    int perPiece = PIECE_BYTES * 8 / bits, res = Z_OK;
+    for (int i = 0; i < CHUNK_NUM_BLOCKS && res == Z_OK; i += perPiece) {
+        int count = std::min(perPiece, CHUNK_NUM_BLOCKS - i);
+        PaletteCodec::packIndices(bits, &idx[i], count, piece);
+
+        zs->next_in = piece;
+        zs->avail_in = count * bits / 8;
+        res = deflate(zs, i + count >= CHUNK_NUM_BLOCKS ? Z_FINISH : Z_NO_FLUSH);
+        if (res == Z_OK && zs->avail_in > 0) res = Z_BUF_ERROR;
+    }
+
+    if (res != Z_STREAM_END) return 0;
+    return size + zs->total_out;
+}
+
+bool PaletteZlibCodec::decode(const uint8_t* data, size_t size, BlockData* blocks) {
+    BlockData palette[256];
+    int bits;
+    int hdr = readPalette(data, size, bits, palette);
+    if (hdr == 0) return false;
+    data += hdr;
+    size -= hdr;
+
+    if (bits == PALETTE_RAW) {
+        if (size != sizeof(BlockData) * CHUNK_NUM_BLOCKS) return false;
+        memcpy(blocks, data, size);
+        return true;
+    } else if (bits == 0) {
+        if (size != 0) return false;
+        std::fill(blocks, blocks + CHUNK_NUM_BLOCKS, palette[0]);
+        return true;
+    }
+
+    z_stream* zs = (z_stream*)inflater;
+    if (zs == NULL) {
+        zs = new z_stream();
+        if (inflateInit(zs) != Z_OK) {
+            delete zs;
+            return false;
+        }
+        inflater = zs;
+    } else if (inflateReset(zs) != Z_OK) {
+        return false;
+    }
+
+    zs->next_in = (Bytef*)data;
+    zs->avail_in = size;
+
+    // inflate a piece at a time, unpacking each one as it is inflated
+    uint8_t piece[PIECE_BYTES];
+    int perPiece = PIECE_BYTES * 8 / bits, res = Z_OK;
+    for (int i = 0; i < CHUNK_NUM_BLOCKS; i += perPiece) {
+        int count = std::min(perPiece, CHUNK_NUM_BLOCKS - i);
+        zs->next_out = piece;
+        zs->avail_out = count * bits / 8;
+        while (zs->avail_out > 0 && res == Z_OK) {
+            res = inflate(zs, Z_NO_FLUSH);
+        }
+        if (zs->avail_out > 0 || (res != Z_OK && res != Z_STREAM_END)) return false;
+
+        PaletteCodec::unpackIndices(bits, piece, count * bits / 8, palette, &blocks[i]);
+    }
+
+    // the stream must end exactly after the indices (the extra byte of room is only there to catch
+    //   streams with more in them)
+    uint8_t extra;
+    zs->next_out = &extra;
+    zs->avail_out = 1;
+    if (res == Z_OK) res = inflate(zs, Z_FINISH);
+    return res == Z_STREAM_END && zs->avail_out == 1 && zs->avail_in == 0;
+}
+
+
+}
+
+
+namespace Blok {
+
+/* CHUNK COMPRESSION */
+
+// cold chunks are column run length encoded (which doesn't keep any state, so it can be shared)
+static Storage::ColumnRLECodec chunkCodec;
+
+// compress the blocks of a chunk
+size_t Chunk::compress() {
+    if (blocks == NULL) return packed.size();
+
+    // encode into a buffer that is kept for each thread, so only the bytes that are used are copied
+    static thread_local List<uint8_t> buf(chunkCodec.getBound());
+    size_t size = chunkCodec.encode(blocks, &buf[0]);
+    packed.assign(buf.begin(), buf.begin() + size);
+    packed.shrink_to_fit();
+
+    delete[] blocks;
+    blocks = NULL;
+    return packed.size();
+}
+
+// decompress the blocks of a chunk
+void Chunk::decompress() {
+    if (blocks != NULL) return;
+
+    blocks = new BlockData[CHUNK_NUM_BLOCKS];
+    if (!chunkCodec.decode(packed.data(), packed.size(), blocks)) {
+        // this can only happen if 'packed' was changed by something else, so the blocks are lost
+        blok_error("Compressed blocks of chunk %i,%i are corrupt", XZ.X, XZ.Z);
+        std::fill(blocks, blocks + CHUNK_NUM_BLOCKS, BlockData());
+    }
+
+    List<uint8_t>().swap(packed);
+}
+
+}
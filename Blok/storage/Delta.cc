@@ -0,0 +1,120 @@
+/* storage/Delta.cc - implementation of the region storage that only stores edits
+ *
+ * Each chunk is stored as:
+ *   - the version tag of the generator (u32)
+ *   - any number of runs of changed blocks, each one being the index of the first block (in `Chunk::blocks`, u16),
+ *       the number of blocks (u16), and then the blocks themselves (id, meta)
+ * Unchanged blocks between 2 changed ones are included in the run if the gap is shorter than a run header,
+ *   since that is smaller than starting a new run
+ * A chunk with no changes (and no entities) is stored as no data at all, which is still saved (see
+ *   `RegionStorage::saveChunk()`), so it is loaded as the base chunk rather than generated again
+ *
+ */
+
+#include <Blok/Storage.hh>
+
+namespace Blok::Storage {
+
+// the longest gap of unchanged blocks that is included in a run
+static const int MAX_GAP = 2;
+
+// the longest run
+static const int MAX_RUN = 0xFFFF;
+
+static_assert(CHUNK_NUM_BLOCKS <= 0x10000, "block indices must fit in 16 bits");
+
+// return whether 2 blocks differ
+static inline bool differs(BlockData a, BlockData b) {
+    return a.id != b.id || a.meta != b.meta;
+}
+
+// construct a storage in a directory
+DeltaStorage::DeltaStorage(const String& path, WG::WG* gen, int capacity) : RegionStorage(path, capacity) {
+    this->gen = gen;
+    this->format = WORLD_DELTA;
+}
+
+// encode the edits to a chunk
+bool DeltaStorage::encode(Chunk* chunk, List<uint8_t>& out) {
+    out.clear();
+
+    Chunk* base = gen->getBaseChunk(chunk->XZ);
+
+    int i = 0;
+    while (i < CHUNK_NUM_BLOCKS) {
+        // find the start of the next run
+        while (i < CHUNK_NUM_BLOCKS && !differs(chunk->blocks[i], base->blocks[i])) i++;
+        if (i >= CHUNK_NUM_BLOCKS) break;
+
+        // and the end, which is 1 past the last changed block
+        int start = i, end = i + 1;
+        for (int j = i + 1; j < CHUNK_NUM_BLOCKS && j - end <= MAX_GAP && j - start < MAX_RUN; ++j) {
+            if (differs(chunk->blocks[j], base->blocks[j])) end = j + 1;
+        }
+
+        if (out.size() == 0) {
+            // this is the first run, so write the tag first
+            uint32_t tag = gen->getVersionTag();
+            out.resize(4);
+            memcpy(&out[0], &tag, 4);
+        }
+
+        uint16_t hdr[2] = { (uint16_t)start, (uint16_t)(end - start) };
+        int pos = out.size();
+        out.resize(pos + sizeof(hdr) + sizeof(BlockData) * (end - start));
+        memcpy(&out[pos], hdr, sizeof(hdr));
+        memcpy(&out[pos + sizeof(hdr)], &chunk->blocks[start], sizeof(BlockData) * (end - start));
+
+        i = end;
+    }
+
+    delete base;
+
+    if (out.size() == 0 && chunk->entities.size() > 0) {
+        // the blocks are unchanged, but the entities still need somewhere to be stored
+        uint32_t tag = gen->getVersionTag();
+        out.resize(4);
+        memcpy(&out[0], &tag, 4);
+    }
+
+    // NOTE: if nothing changed, 'out' is empty, so no sectors are used at all
+    return true;
+}
+
+// regenerate a chunk, and apply its edits
+bool DeltaStorage::decode(const uint8_t* data, uint32_t size, Chunk* chunk) {
+    // a chunk with no changes has no data (not even the tag), so it is just the base chunk
+    if (size > 0) {
+        uint32_t tag;
+        if (size < 4) return false;
+        memcpy(&tag, data, 4);
+        if (tag != gen->getVersionTag()) {
+            blok_warn("Chunk %i,%i was saved with a different world generator (tag %08x, expected %08x)", chunk->XZ.X, chunk->XZ.Z, (unsigned)tag, (unsigned)gen->getVersionTag());
+            return false;
+        }
+    }
+
+    Chunk* base = gen->getBaseChunk(chunk->XZ);
+    memcpy(chunk->blocks, base->blocks, sizeof(BlockData) * CHUNK_NUM_BLOCKS);
+    delete base;
+
+    if (size == 0) return true;
+
+    const uint8_t* ptr = data + 4, * end = data + size;
+    while (ptr < end) {
+        uint16_t hdr[2];
+        if (end - ptr < (int)sizeof(hdr)) return false;
+        memcpy(hdr, ptr, sizeof(hdr));
+        ptr += sizeof(hdr);
+
+        int start = hdr[0], count = hdr[1];
+        if (start + count > CHUNK_NUM_BLOCKS || end - ptr < (int)sizeof(BlockData) * count) return false;
+
+        memcpy(&chunk->blocks[start], ptr, sizeof(BlockData) * count);
+        ptr += sizeof(BlockData) * count;
+    }
+
+    return true;
+}
+
+};
@@ -0,0 +1,159 @@
+/* storage/Dir.cc - implementation of a storage that keeps one file per chunk
+ *
+ * Each file has a small header (magic "BLKC" and a format version), followed by the raw
+ *   `BlockData` array of the chunk, in the same XZY order as `Chunk::blocks`, and then the entities of
+ *   the chunk (see `Entity.cc`), if it has any
+ *
+ */
+
+#include <Blok/Storage.hh>
+
+// for creating & listing directories
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+
+// for syncing files & directories
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace Blok::Storage {
+
+// the magic bytes at the start of every chunk file
+static const char DIR_MAGIC[4] = { 'B', 'L', 'K', 'C' };
+
+// the current version of the chunk file format
+static const uint32_t DIR_VERSION = 1;
+
+// construct a storage in a directory
+DirStorage::DirStorage(const String& path) {
+    this->path = path;
+
+    // make sure the directory exists
+    if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST) {
+        blok_error("Failed to create world directory '%s': %s", path.c_str(), strerror(errno));
+    }
+}
+
+// get the file name of a chunk
+String DirStorage::getFileName(ChunkID id) {
+    char tmp[64];
+    snprintf(tmp, sizeof(tmp), "/c.%i.%i.blk", id.X, id.Z);
+    return path + tmp;
+}
+
+// return whether the chunk has a file
+bool DirStorage::hasChunk(ChunkID id) {
+    struct stat st;
+    return stat(getFileName(id).c_str(), &st) == 0;
+}
+
+// load a chunk
+Chunk* DirStorage::loadChunk(ChunkID id) {
+    String fname = getFileName(id);
+    FILE* fp = fopen(fname.c_str(), "rb");
+
+    // it was never saved
+    if (fp == NULL) return NULL;
+
+    // check the header
+    char magic[4];
+    uint32_t version;
+    if (fread(magic, 1, 4, fp) != 4 || memcmp(magic, DIR_MAGIC, 4) != 0 || fread(&version, sizeof(version), 1, fp) != 1) {
+        blok_warn("Chunk file '%s' is corrupt", fname.c_str());
+        fclose(fp);
+        return NULL;
+    }
+
+    if (version != DIR_VERSION) {
+        blok_warn("Chunk file '%s' has unknown version %u", fname.c_str(), (unsigned)version);
+        fclose(fp);
+        return NULL;
+    }
+
+    // read the blocks straight into a new chunk
+    Chunk* res = new Chunk();
+    res->XZ = id;
+    if (fread(res->blocks, sizeof(BlockData), CHUNK_NUM_BLOCKS, fp) != CHUNK_NUM_BLOCKS) {
+        blok_warn("Chunk file '%s' is truncated", fname.c_str());
+        delete res;
+        res = NULL;
+    } else {
+        // anything left is the entities
+        List<uint8_t> ents;
+        uint8_t tmp[4096];
+        size_t n;
+        while ((n = fread(tmp, 1, sizeof(tmp), fp)) > 0) {
+            ents.insert(ents.end(), tmp, tmp + n);
+        }
+        if (ents.size() > 0 && !res->decodeEntities(&ents[0], ents.size())) {
+            blok_warn("Chunk file '%s' has corrupt entities", fname.c_str());
+            res->clearEntities();
+        }
+    }
+
+    fclose(fp);
+    return res;
+}
+
+// save a chunk
+bool DirStorage::saveChunk(Chunk* chunk) {
+    String fname = getFileName(chunk->XZ);
+
+    // write to a temporary file first (which is on disk before it is renamed), and rename it over the
+    //   old one, so a crash never leaves a half written chunk
+    String tmpname = fname + ".tmp";
+    FILE* fp = fopen(tmpname.c_str(), "wb");
+    if (fp == NULL) {
+        blok_error("Failed to open '%s' for writing: %s", tmpname.c_str(), strerror(errno));
+        return false;
+    }
+
+    List<uint8_t> ents;
+    chunk->encodeEntities(ents);
+
+    bool ok = fwrite(DIR_MAGIC, 1, 4, fp) == 4 && fwrite(&DIR_VERSION, sizeof(DIR_VERSION), 1, fp) == 1 &&
+        fwrite(chunk->blocks, sizeof(BlockData), CHUNK_NUM_BLOCKS, fp) == CHUNK_NUM_BLOCKS &&
+        (ents.size() == 0 || fwrite(&ents[0], 1, ents.size(), fp) == ents.size());
+    ok = ok && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    ok = fclose(fp) == 0 && ok;
+
+    if (!ok || rename(tmpname.c_str(), fname.c_str()) != 0) {
+        blok_error("Failed to write chunk file '%s'", fname.c_str());
+        remove(tmpname.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+// sync the directory, so the renames of the chunk files saved so far are on disk too
+bool DirStorage::sync() {
+    int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY);
+    bool ok = fd >= 0 && fsync(fd) == 0;
+    if (!ok) blok_error("Failed to sync world directory '%s': %s", path.c_str(), strerror(errno));
+    if (fd >= 0) ::close(fd);
+    return ok;
+}
+
+// list the chunk files
+List<ChunkID> DirStorage::listChunks() {
+    List<ChunkID> res;
+    DIR* dir = opendir(path.c_str());
+    if (dir == NULL) return res;
+
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != NULL) {
+        ChunkID id;
+        char tmp[64];
+        if (sscanf(ent->d_name, "c.%i.%i.blk", &id.X, &id.Z) != 2) continue;
+        // make sure it is exactly a chunk file's name (and not i.e. a temporary file)
+        snprintf(tmp, sizeof(tmp), "c.%i.%i.blk", id.X, id.Z);
+        if (strcmp(tmp, ent->d_name) == 0) res.push_back(id);
+    }
+    closedir(dir);
+
+    return res;
+}
+
+};
@@ -0,0 +1,352 @@
+/* storage/Journal.cc - implementation of the block edit journal
+ *
+ * A journal file is a sequence of batches, each of which looks like:
+ *   - magic "BLKJ"
+ *   - the number of edits in the batch (uint32_t)
+ *   - the CRC32 of the number of edits and the edits themselves (uint32_t)
+ *   - the edits, as `Journal::Edit` structures
+ *
+ * Batches are written at the end of the valid part of the file, so if a write is torn (or fails),
+ *   the next batch overwrites it rather than being stuck behind it
+ *
+ * Compaction moves the journal aside (to '.old') until the chunks it edited are durable. If that never
+ *   happens (i.e. saving failed), the next compaction moves the journal onto the end of '.old' instead,
+ *   so '.old' always has every edit that may not be durable, and the journal itself stays small
+ *
+ */
+
+#include <Blok/Storage.hh>
+
+// for the checksums
+#include <zlib.h>
+
+// for file operations
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+namespace Blok::Storage {
+
+// the magic bytes at the start of every batch
+static const char JOURNAL_MAGIC[4] = { 'B', 'L', 'K', 'J' };
+
+// the size of a batch header (in bytes)
+static const size_t BATCH_HEADER = 12;
+
+// edits are written as-is, so make sure there is no padding in them
+static_assert(sizeof(Journal::Edit) == 12, "Journal::Edit must be packed");
+
+// write all of a buffer at an offset, retrying on short writes
+static bool pwriteAll(int fd, const void* buf, size_t size, off_t off) {
+    const char* ptr = (const char*)buf;
+    while (size > 0) {
+        ssize_t res = pwrite(fd, ptr, size, off);
+        if (res < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        ptr += res;
+        off += res;
+        size -= res;
+    }
+    return true;
+}
+
+// compute the checksum of a batch
+static uint32_t batchCRC(uint32_t count, const Journal::Edit* edits) {
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, (const Bytef*)&count, sizeof(count));
+    crc = crc32(crc, (const Bytef*)edits, sizeof(Journal::Edit) * count);
+    return (uint32_t)crc;
+}
+
+// open & start committing
+Journal::Journal(const String& path, double commitInterval) {
+    this->path = path;
+    this->commitInterval = commitInterval;
+    this->compactSize = 1 << 20;
+    this->compactInterval = 60.0;
+
+    // initialize statistics to nothing
+    stats.n_edits = stats.n_batches = 0;
+    stats.n_bytes = 0;
+    stats.n_compactions = 0;
+    stats.t_commits = 0.0;
+
+    firstEditTime = -1.0;
+    retryTime = 0.0;
+    rotated = false;
+
+    fd = -1;
+    L_file.lock();
+    open();
+    L_file.unlock();
+
+    running = true;
+    T_commit = std::thread(&Journal::T_commit_run, this);
+}
+
+// commit & stop
+Journal::~Journal() {
+    running = false;
+    T_commit.join();
+
+    L_file.lock();
+    commitLocked();
+    if (fd >= 0) close(fd);
+    fd = -1;
+    L_file.unlock();
+}
+
+// open the journal file
+void Journal::open() {
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        blok_error("Failed to open journal '%s': %s", path.c_str(), strerror(errno));
+        size = 0;
+        return;
+    }
+
+    struct stat st;
+    size = fstat(fd, &st) == 0 ? st.st_size : 0;
+}
+
+// buffer an edit
+void Journal::append(vec3i pos, BlockData val) {
+    Edit edit;
+    edit.x = pos.x;
+    edit.z = pos.z;
+    edit.y = pos.y;
+    edit.id = (uint8_t)val.id;
+    edit.meta = val.meta;
+
+    L_pending.lock();
+    pending.push_back(edit);
+    L_pending.unlock();
+}
+
+// commit now
+void Journal::commit() {
+    L_file.lock();
+    commitLocked();
+    L_file.unlock();
+}
+
+// write a batch of everything buffered
+void Journal::commitLocked() {
+    // take the buffer, so appends are never blocked on the disk
+    List<Edit> batch;
+    L_pending.lock();
+    batch.swap(pending);
+    L_pending.unlock();
+
+    if (batch.size() == 0 || fd < 0) return;
+
+    double stime = getTime();
+
+    uint32_t count = batch.size();
+    uint32_t crc = batchCRC(count, &batch[0]);
+
+    // build the whole batch, so it is a single write
+    List<char> data(BATCH_HEADER + sizeof(Edit) * count);
+    memcpy(&data[0], JOURNAL_MAGIC, 4);
+    memcpy(&data[4], &count, 4);
+    memcpy(&data[8], &crc, 4);
+    memcpy(&data[BATCH_HEADER], &batch[0], sizeof(Edit) * count);
+
+    if (!pwriteAll(fd, &data[0], data.size(), size) || fdatasync(fd) != 0) {
+        // don't advance, so the next batch overwrites whatever made it to the disk
+        blok_error("Failed to commit %i edits to journal '%s': %s", (int)count, path.c_str(), strerror(errno));
+        return;
+    }
+
+    size += data.size();
+
+    for (const Edit& edit : batch) {
+        affected.insert(ChunkID::fromPos(vec3i(edit.x, edit.y, edit.z)));
+    }
+    if (firstEditTime < 0) firstEditTime = getTime();
+
+    stats.n_edits += count;
+    stats.n_batches++;
+    stats.n_bytes += data.size();
+    stats.t_commits += getTime() - stime;
+}
+
+// read the valid batches from a file
+size_t Journal::replayFile(const String& fname, List<Edit>& res) {
+    FILE* fp = fopen(fname.c_str(), "rb");
+    if (fp == NULL) return 0;
+
+    size_t valid = 0;
+    int n_batches = 0;
+    bool torn = false;
+
+    while (true) {
+        char header[BATCH_HEADER];
+        size_t got = fread(header, 1, BATCH_HEADER, fp);
+        if (got == 0) break;
+
+        uint32_t count, crc;
+        memcpy(&count, &header[4], 4);
+        memcpy(&crc, &header[8], 4);
+
+        if (got != BATCH_HEADER || memcmp(header, JOURNAL_MAGIC, 4) != 0 || count == 0 || count > (1 << 24)) {
+            torn = true;
+            break;
+        }
+
+        List<Edit> batch(count);
+        if (fread(&batch[0], sizeof(Edit), count, fp) != count || batchCRC(count, &batch[0]) != crc) {
+            torn = true;
+            break;
+        }
+
+        res.insert(res.end(), batch.begin(), batch.end());
+        valid += BATCH_HEADER + sizeof(Edit) * count;
+        n_batches++;
+    }
+
+    fclose(fp);
+
+    if (torn) {
+        blok_warn("Journal '%s' has a torn or corrupt batch after %i batches, ignoring the rest of it", fname.c_str(), n_batches);
+
+        // cut it off, so new batches are not stuck behind it
+        if (fname == path && fd >= 0 && ftruncate(fd, valid) == 0) size = valid;
+    }
+
+    return valid;
+}
+
+// read everything committed
+List<Journal::Edit> Journal::replay() {
+    List<Journal::Edit> res;
+
+    L_file.lock();
+    replayFile(path + ".old", res);
+    replayFile(path, res);
+    L_file.unlock();
+
+    return res;
+}
+
+// remove all edits
+void Journal::reset() {
+    L_file.lock();
+
+    // drop anything buffered too, since the caller has saved everything
+    L_pending.lock();
+    pending.clear();
+    L_pending.unlock();
+
+    if (fd >= 0 && (ftruncate(fd, 0) != 0 || fsync(fd) != 0)) {
+        blok_error("Failed to truncate journal '%s': %s", path.c_str(), strerror(errno));
+    }
+    size = 0;
+    remove((path + ".old").c_str());
+
+    affected.clear();
+    firstEditTime = -1.0;
+    rotated = false;
+
+    L_file.unlock();
+}
+
+// check whether to compact
+bool Journal::needsCompaction() {
+    L_file.lock();
+    bool res = getTime() >= retryTime && (size >= compactSize || (firstEditTime >= 0 && getTime() - firstEditTime >= compactInterval));
+    L_file.unlock();
+    return res;
+}
+
+// move the journal aside
+Set<ChunkID> Journal::rotate() {
+    L_file.lock();
+    commitLocked();
+
+    Set<ChunkID> res;
+    res.swap(affected);
+
+    String old = path + ".old";
+    struct stat st;
+    if (stat(old.c_str(), &st) == 0) {
+        // the last compaction never finished, so the old journal's edits may not be durable. Its chunks
+        //   are saved again along with ours, and our edits go on the end of it, so this compaction
+        //   covers both
+        List<Edit> edits;
+        size_t valid = replayFile(old, edits);
+        for (const Edit& edit : edits) {
+            res.insert(ChunkID::fromPos(vec3i(edit.x, edit.y, edit.z)));
+        }
+
+        if (!appendOld(old, valid)) {
+            // keep both files, and put the chunks back, so they are saved next time
+            blok_error("Failed to move journal '%s' onto the end of the old one: %s", path.c_str(), strerror(errno));
+            affected.insert(res.begin(), res.end());
+            rotated = false;
+            retryTime = getTime() + compactInterval;
+            L_file.unlock();
+            return res;
+        }
+    } else {
+        if (fd >= 0) close(fd);
+        if (rename(path.c_str(), old.c_str()) != 0) {
+            blok_error("Failed to move journal '%s' aside: %s", path.c_str(), strerror(errno));
+        }
+        open();
+    }
+    rotated = true;
+
+    firstEditTime = -1.0;
+    stats.n_compactions++;
+
+    L_file.unlock();
+
+    return res;
+}
+
+// move the journal onto the end of the old one
+bool Journal::appendOld(const String& old, size_t oldSize) {
+    if (fd < 0) return false;
+
+    List<char> data(size);
+    if (size > 0 && pread(fd, &data[0], size, 0) != (ssize_t)size) return false;
+
+    int oldfd = ::open(old.c_str(), O_WRONLY);
+    if (oldfd < 0) return false;
+
+    // anything past the valid part of the old journal is torn, so it is written over
+    bool ok = (size == 0 || pwriteAll(oldfd, &data[0], size, oldSize)) && ftruncate(oldfd, oldSize + size) == 0 && fsync(oldfd) == 0;
+    ok = ::close(oldfd) == 0 && ok;
+    if (!ok) return false;
+
+    // NOTE: if this fails, the edits are in both files, and replaying them twice (in order) is harmless
+    if (ftruncate(fd, 0) != 0 || fsync(fd) != 0) return false;
+    size = 0;
+    return true;
+}
+
+// remove the old journal
+void Journal::finishCompaction() {
+    L_file.lock();
+    if (rotated) remove((path + ".old").c_str());
+    rotated = false;
+    L_file.unlock();
+}
+
+// commit every so often, until stopped
+void Journal::T_commit_run() {
+    struct timespec tim;
+    tim.tv_sec = (time_t)commitInterval;
+    tim.tv_nsec = (long)(1e9 * (commitInterval - tim.tv_sec));
+
+    while (running) {
+        nanosleep(&tim, NULL);
+        commit();
+    }
+}
+
+};
@@ -0,0 +1,259 @@
+/* storage/MMap.cc - implementation of the memory mapped region storage
+ *
+ * Chunks are stored as CHUNK_SIZE_Y / SECTION_HEIGHT sections, from the bottom up. Each section starts with
+ *   a mode byte, followed by:
+ *   - SECTION_UNIFORM: the single block (id, meta) the whole section is made of
+ *   - SECTION_PALETTE: the number of bits per index (1, 2, 4 or 8), the number of palette entries (minus 1),
+ *       the palette entries (id, meta), and then an index for every block, packed from the low bits up (by
+ *       `PaletteCodec::packIndices()`)
+ *   - SECTION_RAW: every block (id, meta)
+ * Blocks within a section are in the same XZY order as `Chunk::blocks`, so each column of a section is
+ *   decoded straight into its place in the chunk
+ *
+ */
+
+#include <Blok/Storage.hh>
+
+// for mapping files
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+
+namespace Blok::Storage {
+
+// the height of each section
+static const int SECTION_HEIGHT = 16;
+
+// the number of sections per chunk
+static const int NUM_SECTIONS = CHUNK_SIZE_Y / SECTION_HEIGHT;
+
+// the number of blocks in each section
+static const int SECTION_BLOCKS = CHUNK_SIZE_X * CHUNK_SIZE_Z * SECTION_HEIGHT;
+
+// the ways a section can be stored
+enum {
+    SECTION_UNIFORM = 0,
+    SECTION_PALETTE = 1,
+    SECTION_RAW = 2,
+};
+
+static_assert(CHUNK_SIZE_Y % SECTION_HEIGHT == 0, "CHUNK_SIZE_Y must be a multiple of SECTION_HEIGHT");
+static_assert(SECTION_HEIGHT % 8 == 0, "the indices of each column of a section must be whole bytes");
+static_assert(sizeof(BlockData) == 2, "BlockData is stored as (id, meta) bytes");
+
+// construct a storage in a directory
+MMapStorage::MMapStorage(const String& path, int capacity) : RegionStorage(path, capacity) {
+    this->format = WORLD_MMAP;
+}
+
+// unmap the files before `RegionStorage` closes them
+MMapStorage::~MMapStorage() {
+    L_regions.lock();
+    for (Region* region : lru) {
+        unmap(region);
+    }
+    L_regions.unlock();
+}
+
+// unmap a region
+void MMapStorage::unmap(Region* region) {
+    if (region->map != NULL) {
+        munmap(region->map, MAP_SIZE);
+        region->map = NULL;
+    }
+}
+
+// encode a chunk into sections
+bool MMapStorage::encode(Chunk* chunk, List<uint8_t>& out) {
+    out.clear();
+
+    for (int s = 0; s < NUM_SECTIONS; ++s) {
+        // build the palette, and the index of each block into it
+        BlockData palette[256];
+        int n = 0;
+        uint8_t idx[SECTION_BLOCKS];
+
+        // the last index found, since runs of the same block are common
+        int last = 0;
+        bool fits = true;
+        for (int c = 0; c < CHUNK_SIZE_X * CHUNK_SIZE_Z && fits; ++c) {
+            const BlockData* col = &chunk->blocks[CHUNK_SIZE_Y * c + SECTION_HEIGHT * s];
+            for (int y = 0; y < SECTION_HEIGHT; ++y) {
+                BlockData val = col[y];
+                if (n == 0 || palette[last].id != val.id || palette[last].meta != val.meta) {
+                    last = 0;
+                    while (last < n && (palette[last].id != val.id || palette[last].meta != val.meta)) last++;
+                    if (last == n) {
+                        if (n == 256) {
+                            fits = false;
+                            break;
+                        }
+                        palette[n++] = val;
+                    }
+                }
+                idx[SECTION_HEIGHT * c + y] = last;
+            }
+        }
+
+        int bits = n <= 2 ? 1 : n <= 4 ? 2 : n <= 16 ? 4 : 8;
+
+        if (fits && n == 1) {
+            out.push_back(SECTION_UNIFORM);
+            out.push_back(palette[0].id);
+            out.push_back(palette[0].meta);
+        } else if (fits && 3 + 2 * n + SECTION_BLOCKS * bits / 8 < (int)sizeof(BlockData) * SECTION_BLOCKS) {
+            out.push_back(SECTION_PALETTE);
+            out.push_back(bits);
+            out.push_back(n - 1);
+            for (int i = 0; i < n; ++i) {
+                out.push_back(palette[i].id);
+                out.push_back(palette[i].meta);
+            }
+
+            // pack the indices
+            int start = out.size();
+            out.resize(start + SECTION_BLOCKS * bits / 8);
+            PaletteCodec::packIndices(bits, idx, SECTION_BLOCKS, &out[start]);
+        } else {
+            out.push_back(SECTION_RAW);
+            int start = out.size();
+            out.resize(start + sizeof(BlockData) * SECTION_BLOCKS);
+            for (int c = 0; c < CHUNK_SIZE_X * CHUNK_SIZE_Z; ++c) {
+                memcpy(&out[start + sizeof(BlockData) * SECTION_HEIGHT * c], &chunk->blocks[CHUNK_SIZE_Y * c + SECTION_HEIGHT * s], sizeof(BlockData) * SECTION_HEIGHT);
+            }
+        }
+    }
+
+    return true;
+}
+
+// decode sections into a chunk
+bool MMapStorage::decode(const uint8_t* data, uint32_t size, Chunk* chunk) {
+    const uint8_t* end = data + size;
+
+    for (int s = 0; s < NUM_SECTIONS; ++s) {
+        if (data >= end) return false;
+        int mode = *data++;
+
+        if (mode == SECTION_UNIFORM) {
+            if (end - data < 2) return false;
+            BlockData val = BlockData((ID)data[0], data[1]);
+            data += 2;
+
+            for (int c = 0; c < CHUNK_SIZE_X * CHUNK_SIZE_Z; ++c) {
+                BlockData* col = &chunk->blocks[CHUNK_SIZE_Y * c + SECTION_HEIGHT * s];
+                std::fill(col, col + SECTION_HEIGHT, val);
+            }
+        } else if (mode == SECTION_PALETTE) {
+            if (end - data < 2) return false;
+            int bits = data[0], n = data[1] + 1;
+            data += 2;
+            if ((bits != 1 && bits != 2 && bits != 4 && bits != 8) || end - data < 2 * n + SECTION_BLOCKS * bits / 8) return false;
+
+            BlockData palette[256];
+            for (int i = 0; i < n; ++i) {
+                palette[i] = BlockData((ID)data[2 * i], data[2 * i + 1]);
+            }
+            // out of range indices become air, rather than reading past the palette
+            for (int i = n; i < (1 << bits); ++i) {
+                palette[i] = BlockData();
+            }
+            data += 2 * n;
+
+            // each column's indices are whole bytes, so they are unpacked straight into place
+            int colBytes = SECTION_HEIGHT * bits / 8;
+            for (int c = 0; c < CHUNK_SIZE_X * CHUNK_SIZE_Z; ++c) {
+                PaletteCodec::unpackIndices(bits, data + colBytes * c, colBytes, palette, &chunk->blocks[CHUNK_SIZE_Y * c + SECTION_HEIGHT * s]);
+            }
+            data += SECTION_BLOCKS * bits / 8;
+        } else if (mode == SECTION_RAW) {
+            if (end - data < (int)sizeof(BlockData) * SECTION_BLOCKS) return false;
+
+            for (int c = 0; c < CHUNK_SIZE_X * CHUNK_SIZE_Z; ++c) {
+                memcpy(&chunk->blocks[CHUNK_SIZE_Y * c + SECTION_HEIGHT * s], data + sizeof(BlockData) * SECTION_HEIGHT * c, sizeof(BlockData) * SECTION_HEIGHT);
+            }
+            data += sizeof(BlockData) * SECTION_BLOCKS;
+        } else {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// load a chunk from the mapping
+Chunk* MMapStorage::loadChunk(ChunkID id) {
+    Region* region = acquire(id, false);
+    if (region == NULL) return NULL;
+
+    region->L_region.lock();
+
+    if (region->map == NULL) {
+        // map the file, reserving enough space that it never needs to be remapped as it grows
+        void* ptr = mmap(NULL, MAP_SIZE, PROT_READ, MAP_SHARED, region->fd, 0);
+        if (ptr == MAP_FAILED) {
+            blok_error("Failed to map region file '%s': %s", getFileName(region->RX, region->RZ).c_str(), strerror(errno));
+            region->L_region.unlock();
+            release(region);
+            return NULL;
+        }
+        region->map = (uint8_t*)ptr;
+
+        // chunks are read in whatever order they are requested, so don't read ahead by default
+        madvise(region->map, MAP_SIZE, MADV_RANDOM);
+    }
+
+    int idx = getTableIndex(id);
+    uint32_t entry = region->table[idx][1];
+    size_t off = (size_t)region->table[idx][0] * SECTOR_SIZE, size = entry & ~ENTITY_FLAG;
+
+    // touching a page of the mapping past the end of the file is a SIGBUS, so a table entry that points
+    //   past it (i.e. the file was truncated) must be caught before reading anything
+    // NOTE: region files never shrink, so the size can't go stale while the chunk is decoded
+    struct stat st;
+    size_t fileSize = fstat(region->fd, &st) == 0 ? (size_t)st.st_size : 0;
+    bool inFile = off + size <= fileSize && off + size <= MAP_SIZE;
+
+    Chunk* res = NULL;
+    bool ok = true;
+    if (size > 0 && inFile) {
+        // each chunk is contiguous, so ask for all of its pages at once (rather than faulting them
+        //   in one at a time while decoding)
+        static const size_t pageSize = sysconf(_SC_PAGESIZE);
+        size_t pageOff = off - off % pageSize;
+        madvise(region->map + pageOff, size + (off - pageOff), MADV_WILLNEED);
+
+        // NOTE: decoding holds the lock, so the sectors can't be reused by a save while we read them
+        res = new Chunk();
+        res->XZ = id;
+        if (!decodeStored(region->map + off, entry, res)) {
+            delete res;
+            res = NULL;
+            ok = false;
+        }
+    } else if (size > 0) {
+        ok = false;
+    }
+
+    region->L_region.unlock();
+    release(region);
+
+    if (!ok && !inFile) {
+        blok_error("Chunk %i,%i in '%s' is past the end of its region file (was it truncated?)", id.X, id.Z, path.c_str());
+        return NULL;
+    } else if (!ok) {
+        blok_warn("Chunk %i,%i in '%s' is corrupt", id.X, id.Z, path.c_str());
+        return NULL;
+    }
+
+    if (res != NULL) {
+        L_regions.lock();
+        stats.n_loads++;
+        L_regions.unlock();
+    }
+
+    return res;
+}
+
+};
@@ -0,0 +1,520 @@
+/* storage/Region.cc - implementation of a storage that groups chunks into region files
+ *
+ * A region file looks like:
+ *   - magic "BLKR", and the format of the chunk data (see `RegionStorage::format`)
+ *   - the chunk table (see `RegionStorage::Region::table`)
+ *   - padding to HEADER_SECTORS sectors
+ *   - chunk data, each one starting at a sector boundary. By default, this is a zlib stream of the raw
+ *       `BlockData` array (in the same XZY order as `Chunk::blocks`)
+ *   - if the chunk has entities, ENTITY_FLAG is set in its size, and the data is followed by the
+ *       entities (see `Entity.cc`) and their size, so readers that only want blocks can skip them
+ *
+ * Compression & decompression are done without holding any locks, so only the actual reads and
+ *   writes of a region are serialized
+ *
+ */
+
+#include <Blok/Storage.hh>
+
+// for compressing chunks
+#include <zlib.h>
+
+// for file operations
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+namespace Blok::Storage {
+
+// the magic bytes at the start of every region file
+static const char REGION_MAGIC[4] = { 'B', 'L', 'K', 'R' };
+
+// the number of chunks in a region
+static const int REGION_CHUNKS = RegionStorage::REGION_SIZE * RegionStorage::REGION_SIZE;
+
+// the size of the header (in bytes), and the number of sectors reserved for it
+static const int HEADER_BYTES = 8 + 8 * REGION_CHUNKS;
+static const int HEADER_SECTORS = (HEADER_BYTES + RegionStorage::SECTOR_SIZE - 1) / RegionStorage::SECTOR_SIZE;
+
+// the sector in the table for chunks that are saved, but have no data (real sectors are always after the header)
+static const uint32_t EMPTY_SECTOR = 0xFFFFFFFF;
+
+// return the index of a chunk within its region's table
+int RegionStorage::getTableIndex(ChunkID id) {
+    int lx = id.X - REGION_SIZE * floorDiv(id.X, REGION_SIZE);
+    int lz = id.Z - REGION_SIZE * floorDiv(id.Z, REGION_SIZE);
+    return REGION_SIZE * lx + lz;
+}
+
+// return the number of sectors needed for a number of bytes (ignoring ENTITY_FLAG, so table sizes can
+//   be passed directly)
+static inline int numSectors(uint32_t size) {
+    size &= ~RegionStorage::ENTITY_FLAG;
+    return (size + RegionStorage::SECTOR_SIZE - 1) / RegionStorage::SECTOR_SIZE;
+}
+
+// read/write all of a buffer at an offset, retrying on short reads/writes
+static bool preadAll(int fd, void* buf, size_t size, off_t off) {
+    char* ptr = (char*)buf;
+    while (size > 0) {
+        ssize_t res = pread(fd, ptr, size, off);
+        if (res <= 0) {
+            if (res < 0 && errno == EINTR) continue;
+            return false;
+        }
+        ptr += res;
+        off += res;
+        size -= res;
+    }
+    return true;
+}
+
+static bool pwriteAll(int fd, const void* buf, size_t size, off_t off) {
+    const char* ptr = (const char*)buf;
+    while (size > 0) {
+        ssize_t res = pwrite(fd, ptr, size, off);
+        if (res < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        ptr += res;
+        off += res;
+        size -= res;
+    }
+    return true;
+}
+
+// construct a storage in a directory
+RegionStorage::RegionStorage(const String& path, int capacity) {
+    this->path = path;
+    this->capacity = capacity;
+    
+    // chunks are saved often, so favor speed over size
+    this->level = Z_BEST_SPEED;
+    this->format = WORLD_REGION;
+
+    // initialize statistics to nothing
+    stats.n_loads = stats.n_saves = 0;
+    stats.n_raw = stats.n_compressed = 0;
+    stats.n_opens = 0;
+
+    // make sure the directory exists
+    if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST) {
+        blok_error("Failed to create world directory '%s': %s", path.c_str(), strerror(errno));
+    }
+}
+
+// close all the files
+RegionStorage::~RegionStorage() {
+    L_regions.lock();
+    for (Region* region : lru) {
+        close(region);
+    }
+    lru.clear();
+    regions.clear();
+    L_regions.unlock();
+}
+
+// get the file name of a region
+String RegionStorage::getFileName(int RX, int RZ) {
+    char tmp[64];
+    snprintf(tmp, sizeof(tmp), "/r.%i.%i.blr", RX, RZ);
+    return path + tmp;
+}
+
+// close a region
+void RegionStorage::close(Region* region) {
+    unmap(region);
+
+    // 'sync()' only sees the open files, so anything written to this one must be on disk first
+    if (fsync(region->fd) != 0) {
+        blok_error("Failed to sync region file '%s': %s", getFileName(region->RX, region->RZ).c_str(), strerror(errno));
+    }
+    ::close(region->fd);
+    delete region;
+}
+
+// get an open region
+RegionStorage::Region* RegionStorage::acquire(ChunkID id, bool create) {
+    Pair<int, int> key = { floorDiv(id.X, REGION_SIZE), floorDiv(id.Z, REGION_SIZE) };
+
+    L_regions.lock();
+
+    auto it = regions.find(key);
+    if (it != regions.end()) {
+        // already open, so just move it to the front of the LRU list
+        Region* region = *it->second;
+        lru.splice(lru.begin(), lru, it->second);
+        region->users++;
+        L_regions.unlock();
+        return region;
+    }
+
+    // open it (while holding the lock, so 2 threads never open the same file)
+    String fname = getFileName(key.first, key.second);
+    int fd = open(fname.c_str(), O_RDWR | (create ? O_CREAT : 0), 0644);
+    if (fd < 0) {
+        if (create || errno != ENOENT) {
+            blok_error("Failed to open region file '%s': %s", fname.c_str(), strerror(errno));
+        }
+        L_regions.unlock();
+        return NULL;
+    }
+
+    Region* region = new Region();
+    region->RX = key.first;
+    region->RZ = key.second;
+    region->fd = fd;
+    region->map = NULL;
+    region->users = 1;
+
+    // read the header, or write a new one if the file is empty
+    struct stat st;
+    fstat(fd, &st);
+
+    char magic[4];
+    uint32_t fileFormat;
+    if (st.st_size == 0) {
+        memset(region->table, 0, sizeof(region->table));
+        char header[HEADER_SECTORS * SECTOR_SIZE];
+        memset(header, 0, sizeof(header));
+        memcpy(header, REGION_MAGIC, 4);
+        memcpy(header + 4, &format, 4);
+        if (!pwriteAll(fd, header, sizeof(header), 0)) {
+            blok_error("Failed to write header of region file '%s': %s", fname.c_str(), strerror(errno));
+        }
+    } else if (!preadAll(fd, magic, 4, 0) || memcmp(magic, REGION_MAGIC, 4) != 0 || !preadAll(fd, &fileFormat, 4, 4) || fileFormat != format || !preadAll(fd, region->table, sizeof(region->table), 8)) {
+        blok_error("Region file '%s' is corrupt or has a different format", fname.c_str());
+        ::close(fd);
+        delete region;
+        L_regions.unlock();
+        return NULL;
+    }
+
+    // mark the sectors in use, so new chunks go in the gaps
+    region->used.assign(HEADER_SECTORS, true);
+    for (int i = 0; i < REGION_CHUNKS; ++i) {
+        if (region->table[i][1] == 0) continue;
+        int end = region->table[i][0] + numSectors(region->table[i][1]);
+        if ((int)region->used.size() < end) region->used.resize(end, false);
+        for (int j = region->table[i][0]; j < end; ++j) {
+            region->used[j] = true;
+        }
+    }
+
+    stats.n_opens++;
+
+    lru.push_front(region);
+    regions[key] = lru.begin();
+
+    // close the least recently used files that nobody is using
+    auto evict = lru.end();
+    while ((int)lru.size() > capacity && evict != lru.begin()) {
+        --evict;
+        Region* old = *evict;
+        if (old->users > 0) continue;
+        regions.erase({ old->RX, old->RZ });
+        evict = lru.erase(evict);
+        close(old);
+    }
+
+    L_regions.unlock();
+    return region;
+}
+
+// stop using a region
+void RegionStorage::release(Region* region) {
+    L_regions.lock();
+    region->users--;
+    L_regions.unlock();
+}
+
+// return whether a chunk is in its region
+bool RegionStorage::hasChunk(ChunkID id) {
+    Region* region = acquire(id, false);
+    if (region == NULL) return false;
+
+    region->L_region.lock();
+    bool res = region->table[getTableIndex(id)][0] != 0;
+    region->L_region.unlock();
+
+    release(region);
+    return res;
+}
+
+// list the chunks in every region
+List<ChunkID> RegionStorage::listChunks() {
+    List<ChunkID> res;
+
+    // find the region files first
+    List<Pair<int, int>> keys;
+    DIR* dir = opendir(path.c_str());
+    if (dir == NULL) return res;
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != NULL) {
+        int RX, RZ;
+        char tmp[64];
+        if (sscanf(ent->d_name, "r.%i.%i.blr", &RX, &RZ) != 2) continue;
+        // make sure it is exactly a region file's name (and not i.e. a temporary file)
+        snprintf(tmp, sizeof(tmp), "r.%i.%i.blr", RX, RZ);
+        if (strcmp(tmp, ent->d_name) == 0) keys.push_back({ RX, RZ });
+    }
+    closedir(dir);
+
+    for (auto& key : keys) {
+        Region* region = acquire(ChunkID(REGION_SIZE * key.first, REGION_SIZE * key.second), false);
+        if (region == NULL) continue;
+
+        region->L_region.lock();
+        for (int i = 0; i < REGION_CHUNKS; ++i) {
+            if (region->table[i][0] == 0) continue;
+            res.push_back(ChunkID(REGION_SIZE * key.first + i / REGION_SIZE, REGION_SIZE * key.second + i % REGION_SIZE));
+        }
+        region->L_region.unlock();
+
+        release(region);
+    }
+
+    return res;
+}
+
+// load a chunk
+Chunk* RegionStorage::loadChunk(ChunkID id) {
+    Region* region = acquire(id, false);
+    if (region == NULL) return NULL;
+
+    // read the compressed data
+    region->L_region.lock();
+    uint32_t sector = region->table[getTableIndex(id)][0], entry = region->table[getTableIndex(id)][1];
+    uint32_t size = entry & ~ENTITY_FLAG;
+    List<uint8_t> data(size);
+    bool ok = size == 0 || preadAll(region->fd, &data[0], size, (off_t)sector * SECTOR_SIZE);
+    region->L_region.unlock();
+
+    release(region);
+
+    // it was never saved
+    if (sector == 0) return NULL;
+
+    Chunk* res = NULL;
+    if (ok) {
+        // decode straight into a new chunk
+        res = new Chunk();
+        res->XZ = id;
+        if (!decodeStored(size > 0 ? &data[0] : NULL, entry, res)) {
+            delete res;
+            res = NULL;
+        }
+    }
+
+    if (res == NULL) {
+        blok_warn("Chunk %i,%i in region file '%s' is corrupt", id.X, id.Z, getFileName(floorDiv(id.X, REGION_SIZE), floorDiv(id.Z, REGION_SIZE)).c_str());
+        return NULL;
+    }
+
+    L_regions.lock();
+    stats.n_loads++;
+    L_regions.unlock();
+
+    return res;
+}
+
+// compress a chunk
+bool RegionStorage::encode(Chunk* chunk, List<uint8_t>& out) {
+    uLong rawSize = sizeof(BlockData) * CHUNK_NUM_BLOCKS;
+    uLongf size = compressBound(rawSize);
+    out.resize(size);
+    if (compress2(&out[0], &size, (const Bytef*)chunk->blocks, rawSize, level) != Z_OK) return false;
+    out.resize(size);
+    return true;
+}
+
+// decompress a chunk
+bool RegionStorage::decode(const uint8_t* data, uint32_t size, Chunk* chunk) {
+    uLongf rawSize = sizeof(BlockData) * CHUNK_NUM_BLOCKS;
+    return uncompress((Bytef*)chunk->blocks, &rawSize, data, size) == Z_OK && rawSize == sizeof(BlockData) * CHUNK_NUM_BLOCKS;
+}
+
+// decode the blocks and entities of a stored chunk
+bool RegionStorage::decodeStored(const uint8_t* data, uint32_t size, Chunk* chunk) {
+    if (!(size & ENTITY_FLAG)) return decode(data, size, chunk);
+    size &= ~ENTITY_FLAG;
+
+    uint32_t entSize;
+    if (size < 4) return false;
+    memcpy(&entSize, data + size - 4, 4);
+    if (entSize > size - 4) return false;
+
+    uint32_t blockSize = size - 4 - entSize;
+    if (!decode(data, blockSize, chunk)) return false;
+
+    // the blocks are fine, so bad entities only lose the entities, not the whole chunk
+    if (!chunk->decodeEntities(data + blockSize, entSize)) {
+        blok_warn("Chunk %i,%i in '%s' has corrupt entities", chunk->XZ.X, chunk->XZ.Z, path.c_str());
+        chunk->clearEntities();
+    }
+    return true;
+}
+
+// save a chunk
+bool RegionStorage::saveChunk(Chunk* chunk) {
+    // encode it before touching the region
+    uLong rawSize = sizeof(BlockData) * CHUNK_NUM_BLOCKS;
+    List<uint8_t> data;
+    if (!encode(chunk, data)) {
+        blok_error("Failed to encode chunk %i,%i", chunk->XZ.X, chunk->XZ.Z);
+        return false;
+    }
+    uint32_t size = data.size(), flags = 0;
+
+    // the entities go after the blocks, followed by their size
+    if (size > 0 && chunk->entities.size() > 0) {
+        chunk->encodeEntities(data);
+        uint32_t entSize = data.size() - size;
+        if (entSize > 0) {
+            data.resize(data.size() + 4);
+            memcpy(&data[data.size() - 4], &entSize, 4);
+            size = data.size();
+            flags = ENTITY_FLAG;
+        }
+    }
+
+    if (size == 0) {
+        // nothing needs to be stored, but it is still marked as saved (so it is loaded, rather than
+        //   generated again), and any sectors it had are freed
+        Region* region = acquire(chunk->XZ, true);
+        if (region == NULL) return false;
+
+        int idx = getTableIndex(chunk->XZ);
+
+        region->L_region.lock();
+        bool ok = true;
+        if (region->table[idx][0] != EMPTY_SECTOR || region->table[idx][1] != 0) {
+            uint32_t entry[2] = { EMPTY_SECTOR, 0 };
+            ok = pwriteAll(region->fd, entry, sizeof(entry), 8 + sizeof(entry) * idx);
+            if (ok) {
+                if (region->table[idx][1] != 0) {
+                    int end = region->table[idx][0] + numSectors(region->table[idx][1]);
+                    for (int j = region->table[idx][0]; j < end; ++j) {
+                        region->used[j] = false;
+                    }
+                }
+                region->table[idx][0] = entry[0];
+                region->table[idx][1] = entry[1];
+            }
+        }
+        region->L_region.unlock();
+
+        if (!ok) {
+            blok_error("Failed to write chunk %i,%i to region file '%s': %s", chunk->XZ.X, chunk->XZ.Z, getFileName(region->RX, region->RZ).c_str(), strerror(errno));
+        }
+
+        release(region);
+
+        if (ok) {
+            L_regions.lock();
+            stats.n_saves++;
+            stats.n_raw += rawSize;
+            L_regions.unlock();
+        }
+        return ok;
+    }
+
+    Region* region = acquire(chunk->XZ, true);
+    if (region == NULL) return false;
+
+    region->L_region.lock();
+
+    int idx = getTableIndex(chunk->XZ), need = numSectors(size);
+
+    // find the first run of free sectors that is large enough (or the end of the file)
+    int sector = HEADER_SECTORS, run = 0;
+    for (int i = HEADER_SECTORS; i < (int)region->used.size() && run < need; ++i) {
+        if (region->used[i]) {
+            sector = i + 1;
+            run = 0;
+        } else {
+            run++;
+        }
+    }
+
+    // write the data first, then point the table at it, so the old copy is valid until then
+    uint32_t entry[2] = { (uint32_t)sector, size | flags };
+    bool ok = pwriteAll(region->fd, &data[0], size, (off_t)sector * SECTOR_SIZE) && pwriteAll(region->fd, entry, sizeof(entry), 8 + sizeof(entry) * idx);
+
+    if (ok) {
+        // free the old sectors, and claim the new ones
+        if (region->table[idx][1] != 0) {
+            int end = region->table[idx][0] + numSectors(region->table[idx][1]);
+            for (int j = region->table[idx][0]; j < end; ++j) {
+                region->used[j] = false;
+            }
+        }
+        if ((int)region->used.size() < sector + need) region->used.resize(sector + need, false);
+        for (int j = sector; j < sector + need; ++j) {
+            region->used[j] = true;
+        }
+        region->table[idx][0] = entry[0];
+        region->table[idx][1] = entry[1];
+    }
+
+    region->L_region.unlock();
+
+    if (!ok) {
+        blok_error("Failed to write chunk %i,%i to region file '%s': %s", chunk->XZ.X, chunk->XZ.Z, getFileName(region->RX, region->RZ).c_str(), strerror(errno));
+    }
+
+    release(region);
+
+    if (ok) {
+        L_regions.lock();
+        stats.n_saves++;
+        stats.n_raw += rawSize;
+        stats.n_compressed += size;
+        L_regions.unlock();
+    }
+
+    return ok;
+}
+
+// flush all open files
+bool RegionStorage::sync() {
+    bool ok = true;
+    L_regions.lock();
+    for (Region* region : lru) {
+        if (fsync(region->fd) != 0) {
+            blok_error("Failed to sync region file '%s': %s", getFileName(region->RX, region->RZ).c_str(), strerror(errno));
+            ok = false;
+        }
+    }
+    L_regions.unlock();
+    return ok;
+}
+
+// close all files, dropping them from the page cache
+void RegionStorage::dropCache() {
+    L_regions.lock();
+    auto it = lru.begin();
+    while (it != lru.end()) {
+        Region* region = *it;
+        if (region->users > 0) {
+            // someone is still using it
+            ++it;
+            continue;
+        }
+
+        // pages can only be dropped once they are written, and no longer mapped
+        fsync(region->fd);
+        unmap(region);
+        posix_fadvise(region->fd, 0, 0, POSIX_FADV_DONTNEED);
+
+        regions.erase({ region->RX, region->RZ });
+        it = lru.erase(it);
+        close(region);
+    }
+    L_regions.unlock();
+}
+
+};
@@ -0,0 +1,549 @@
+/* storage/Snapshot.cc - implementation of incremental, content addressed world snapshots
+ *
+ * The snapshot directory looks like:
+ *   - `blobs/XX/HASH`, where HASH is the SHA-256 (in hex) of a chunk's raw `BlockData` array (followed by its
+ *       entities, see `Entity.cc`, if it has any), and XX is its first byte. The file is that data, compressed
+ *       with zlib
+ *   - `snapshots/NAME.bls`, the table of a snapshot, which is magic "BLKS", a version (u32), the number of
+ *       entries (u32), the entries (chunk X and Z (i32), and the hash), and a CRC32 of the entries (u32)
+ *
+ * Blobs and tables are written to a temporary file, synced, and renamed into place, so a crash while taking
+ *   a snapshot never leaves a table that refers to a partially written blob
+ *
+ */
+
+#include <Blok/Storage.hh>
+
+// for compressing blobs, and checksums
+#include <zlib.h>
+
+// for file operations
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+namespace Blok::Storage {
+
+// the magic bytes at the start of every snapshot table
+static const char SNAPSHOT_MAGIC[4] = { 'B', 'L', 'K', 'S' };
+
+// the current version of the snapshot table format
+static const uint32_t SNAPSHOT_VERSION = 1;
+
+// the file extension of snapshot tables
+static const String TABLE_SUFFIX = ".bls";
+
+// Entry - a single entry of a snapshot table, as it is written to the file
+struct Entry {
+
+    // the chunk coordinates
+    int32_t X, Z;
+
+    // the hash of its blocks
+    uint8_t hash[32];
+
+};
+
+static_assert(sizeof(Entry) == 40, "Entry must be packed");
+
+
+/* SHA-256 */
+
+// the round constants
+static const uint32_t SHA_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+// process a single 64 byte block
+static void sha256Block(uint32_t state[8], const uint8_t* block) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; ++i) {
+        w[i] = ((uint32_t)block[4 * i] << 24) | ((uint32_t)block[4 * i + 1] << 16) | ((uint32_t)block[4 * i + 2] << 8) | block[4 * i + 3];
+    }
+    for (int i = 16; i < 64; ++i) {
+        uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; ++i) {
+        uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + SHA_K[i] + w[i];
+        uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+// compute the SHA-256 of some data
+static Snapshots::Hash sha256(const uint8_t* data, size_t size) {
+    uint32_t state[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        sha256Block(state, data + i);
+    }
+
+    // pad the rest with a 1 bit, zeros, and the length in bits
+    uint8_t tail[128];
+    size_t rem = size - i;
+    memcpy(tail, data + i, rem);
+    tail[rem] = 0x80;
+    size_t tailSize = rem + 9 <= 64 ? 64 : 128;
+    memset(tail + rem + 1, 0, tailSize - rem - 1);
+    uint64_t bits = (uint64_t)size * 8;
+    for (int j = 0; j < 8; ++j) {
+        tail[tailSize - 1 - j] = bits >> (8 * j);
+    }
+    for (size_t j = 0; j < tailSize; j += 64) {
+        sha256Block(state, tail + j);
+    }
+
+    Snapshots::Hash res;
+    for (int j = 0; j < 8; ++j) {
+        res[4 * j] = state[j] >> 24;
+        res[4 * j + 1] = state[j] >> 16;
+        res[4 * j + 2] = state[j] >> 8;
+        res[4 * j + 3] = state[j];
+    }
+    return res;
+}
+
+
+/* FILE UTILITIES */
+
+// write all of a buffer to a new file (through a temporary file, which is synced and renamed over it),
+//   returning whether it was successful
+static bool writeFileAtomic(const String& fname, const void* data, size_t size) {
+    String tmpname = fname + ".tmp";
+    int fd = ::open(tmpname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+
+    const char* ptr = (const char*)data;
+    bool ok = true;
+    while (size > 0) {
+        ssize_t res = ::write(fd, ptr, size);
+        if (res < 0 && errno == EINTR) continue;
+        if (res <= 0) {
+            ok = false;
+            break;
+        }
+        ptr += res;
+        size -= res;
+    }
+
+    ok = ok && fsync(fd) == 0;
+    ok = ::close(fd) == 0 && ok;
+
+    if (!ok || rename(tmpname.c_str(), fname.c_str()) != 0) {
+        unlink(tmpname.c_str());
+        return false;
+    }
+    return true;
+}
+
+// read all of a file into 'out', returning whether it was successful
+static bool readFileAll(const String& fname, List<uint8_t>& out) {
+    FILE* fp = fopen(fname.c_str(), "rb");
+    if (fp == NULL) return false;
+
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    out.resize(size > 0 ? size : 0);
+    bool ok = size >= 0 && fread(out.data(), 1, out.size(), fp) == out.size();
+    fclose(fp);
+    return ok;
+}
+
+// decompress a zlib stream of unknown size into 'out', returning whether it was successful
+static bool inflateAll(const List<uint8_t>& packed, List<uint8_t>& out) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit(&zs) != Z_OK) return false;
+
+    // nearly every blob is just blocks, so start with room for those
+    out.resize(sizeof(BlockData) * CHUNK_NUM_BLOCKS + 256);
+    zs.next_in = (Bytef*)packed.data();
+    zs.avail_in = packed.size();
+
+    int res = Z_OK;
+    while (res == Z_OK) {
+        if (zs.total_out == out.size()) out.resize(2 * out.size());
+        zs.next_out = &out[zs.total_out];
+        zs.avail_out = out.size() - zs.total_out;
+        res = inflate(&zs, Z_NO_FLUSH);
+        if (res == Z_BUF_ERROR && zs.avail_out == 0) res = Z_OK;
+    }
+
+    out.resize(zs.total_out);
+    inflateEnd(&zs);
+    return res == Z_STREAM_END;
+}
+
+// make a directory, if it doesn't exist, returning whether it exists now
+static bool makeDir(const String& path) {
+    return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+
+/* SNAPSHOTS */
+
+// construct, and read the latest table
+Snapshots::Snapshots(Storage* inner, const String& path) {
+    this->inner = inner;
+    this->path = path;
+
+    // initialize statistics to nothing
+    stats.n_snapshots = stats.n_chunks = 0;
+    stats.n_blobs = stats.n_bytes = 0;
+    stats.t_snapshots = 0.0;
+
+    // we don't know what was saved before now
+    full = true;
+
+    if (!makeDir(path) || !makeDir(path + "/blobs") || !makeDir(path + "/snapshots")) {
+        blok_error("Failed to create snapshot directory '%s': %s", path.c_str(), strerror(errno));
+    }
+
+    List<String> names = list();
+    if (names.size() > 0 && !readTable(names.back(), table)) {
+        blok_warn("Snapshot '%s' is corrupt, so the next snapshot will not build on it", names.back().c_str());
+        table.clear();
+    }
+}
+
+// free the inner storage
+Snapshots::~Snapshots() {
+    delete inner;
+}
+
+// get the file name of a blob
+String Snapshots::getBlobName(const Hash& hash) {
+    char hex[65];
+    for (int i = 0; i < 32; ++i) {
+        snprintf(hex + 2 * i, 3, "%02x", hash[i]);
+    }
+    return path + "/blobs/" + String(hex, 2) + "/" + hex;
+}
+
+// get the file name of a table
+String Snapshots::getTableName(const String& name) {
+    return path + "/snapshots/" + name + TABLE_SUFFIX;
+}
+
+// read a table
+bool Snapshots::readTable(const String& name, Map<ChunkID, Hash>& res) {
+    List<uint8_t> data;
+    if (!readFileAll(getTableName(name), data) || data.size() < 16) return false;
+
+    uint32_t version, count, crc;
+    memcpy(&version, &data[4], 4);
+    memcpy(&count, &data[8], 4);
+    if (memcmp(&data[0], SNAPSHOT_MAGIC, 4) != 0 || version != SNAPSHOT_VERSION || data.size() != 16 + sizeof(Entry) * (size_t)count) return false;
+
+    memcpy(&crc, &data[12 + sizeof(Entry) * count], 4);
+    if (crc != (uint32_t)crc32(crc32(0L, Z_NULL, 0), &data[12], sizeof(Entry) * count)) return false;
+
+    res.clear();
+    for (uint32_t i = 0; i < count; ++i) {
+        Entry entry;
+        memcpy(&entry, &data[12 + sizeof(Entry) * i], sizeof(Entry));
+        Hash hash;
+        memcpy(hash.data(), entry.hash, 32);
+        res[ChunkID(entry.X, entry.Z)] = hash;
+    }
+    return true;
+}
+
+// write a table
+bool Snapshots::writeTable(const String& name, const Map<ChunkID, Hash>& tab) {
+    uint32_t count = tab.size();
+    List<uint8_t> data(16 + sizeof(Entry) * count);
+    memcpy(&data[0], SNAPSHOT_MAGIC, 4);
+    memcpy(&data[4], &SNAPSHOT_VERSION, 4);
+    memcpy(&data[8], &count, 4);
+
+    size_t pos = 12;
+    for (auto& it : tab) {
+        Entry entry;
+        entry.X = it.first.X;
+        entry.Z = it.first.Z;
+        memcpy(entry.hash, it.second.data(), 32);
+        memcpy(&data[pos], &entry, sizeof(Entry));
+        pos += sizeof(Entry);
+    }
+
+    uint32_t crc = crc32(crc32(0L, Z_NULL, 0), &data[12], sizeof(Entry) * count);
+    memcpy(&data[pos], &crc, 4);
+
+    return writeFileAtomic(getTableName(name), data.data(), data.size());
+}
+
+// return whether a chunk is saved
+bool Snapshots::hasChunk(ChunkID id) {
+    return inner->hasChunk(id);
+}
+
+// load a chunk
+Chunk* Snapshots::loadChunk(ChunkID id) {
+    return inner->loadChunk(id);
+}
+
+// save a chunk, and remember it changed
+bool Snapshots::saveChunk(Chunk* chunk) {
+    ChunkID id = chunk->XZ;
+    if (!inner->saveChunk(chunk)) return false;
+
+    L_changed.lock();
+    changed.insert(id);
+    L_changed.unlock();
+    return true;
+}
+
+// list the chunks
+List<ChunkID> Snapshots::listChunks() {
+    return inner->listChunks();
+}
+
+// sync the inner storage
+bool Snapshots::sync() {
+    return inner->sync();
+}
+
+// list the snapshots
+List<String> Snapshots::list() {
+    List<String> res;
+    DIR* dir = opendir((path + "/snapshots").c_str());
+    if (dir == NULL) return res;
+
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != NULL) {
+        String name = ent->d_name;
+        if (name[0] == '.' || name.size() <= TABLE_SUFFIX.size() || name.compare(name.size() - TABLE_SUFFIX.size(), TABLE_SUFFIX.size(), TABLE_SUFFIX) != 0) continue;
+        res.push_back(name.substr(0, name.size() - TABLE_SUFFIX.size()));
+    }
+    closedir(dir);
+
+    // the names are times, so sorting them puts them in order
+    std::sort(res.begin(), res.end());
+    return res;
+}
+
+// take a snapshot
+String Snapshots::take() {
+    std::lock_guard<std::mutex> lock(L_take);
+    double stime = getTime();
+
+    // take the changed chunks, so anything saved from now on is in the next snapshot
+    L_changed.lock();
+    Set<ChunkID> ids;
+    ids.swap(changed);
+    bool wasFull = full;
+    full = false;
+    L_changed.unlock();
+
+    Map<ChunkID, Hash> res;
+    if (wasFull) {
+        // check everything (which also drops chunks that have been removed)
+        for (ChunkID id : inner->listChunks()) ids.insert(id);
+    } else {
+        res = table;
+    }
+
+    bool ok = true;
+    int n_chunks = 0, n_blobs = 0;
+    size_t n_bytes = 0;
+    List<uint8_t> packed, withEntities;
+    for (ChunkID id : ids) {
+        Chunk* chunk = inner->loadChunk(id);
+        n_chunks++;
+        if (chunk == NULL) {
+            // not saved any more
+            res.erase(id);
+            continue;
+        }
+
+        const uint8_t* raw = (const uint8_t*)chunk->blocks;
+        size_t rawSize = sizeof(BlockData) * CHUNK_NUM_BLOCKS;
+        if (chunk->entities.size() > 0) {
+            // the entities are part of the blob, so they are hashed along with the blocks
+            withEntities.assign(raw, raw + rawSize);
+            chunk->encodeEntities(withEntities);
+            raw = withEntities.data();
+            rawSize = withEntities.size();
+        }
+        Hash hash = sha256(raw, rawSize);
+        res[id] = hash;
+
+        // only write the blob if no chunk has had these blocks before
+        String fname = getBlobName(hash);
+        struct stat st;
+        if (stat(fname.c_str(), &st) != 0) {
+            uLongf size = compressBound(rawSize);
+            packed.resize(size);
+            if (compress2(&packed[0], &size, raw, rawSize, Z_BEST_SPEED) != Z_OK || !makeDir(fname.substr(0, fname.rfind('/'))) || !writeFileAtomic(fname, &packed[0], size)) {
+                blok_error("Failed to write blob '%s': %s", fname.c_str(), strerror(errno));
+                ok = false;
+            } else {
+                n_blobs++;
+                n_bytes += size;
+            }
+        }
+
+        delete chunk;
+        if (!ok) break;
+    }
+
+    // name it after the time, making sure it is unique
+    char name[64];
+    time_t now = time(NULL);
+    struct tm tm;
+    gmtime_r(&now, &tm);
+    strftime(name, sizeof(name), "%Y%m%d-%H%M%S", &tm);
+    String sname = name;
+    struct stat st;
+    for (int i = 2; stat(getTableName(sname).c_str(), &st) == 0; ++i) {
+        sname = String(name) + "-" + std::to_string(i);
+    }
+
+    if (ok && !writeTable(sname, res)) {
+        blok_error("Failed to write snapshot table '%s'", getTableName(sname).c_str());
+        ok = false;
+    }
+
+    if (!ok) {
+        // check them again next time
+        L_changed.lock();
+        if (wasFull) full = true;
+        else changed.insert(ids.begin(), ids.end());
+        L_changed.unlock();
+        return "";
+    }
+
+    table.swap(res);
+
+    stime = getTime() - stime;
+    stats.n_snapshots++;
+    stats.n_chunks += n_chunks;
+    stats.n_blobs += n_blobs;
+    stats.n_bytes += n_bytes;
+    stats.t_snapshots += stime;
+
+    blok_info("Took snapshot '%s' of %i chunks in %.2lfs (%i checked, %i new blobs, %.1lfkb written)", sname.c_str(), (int)table.size(), stime, n_chunks, n_blobs, n_bytes / 1024.0);
+
+    return sname;
+}
+
+// restore a snapshot into another storage
+bool Snapshots::restore(const String& name, Storage* dest, bool overwrite) {
+    std::lock_guard<std::mutex> lock(L_take);
+
+    Map<ChunkID, Hash> tab;
+    if (!readTable(name, tab)) {
+        blok_error("Snapshot '%s' does not exist, or is corrupt", name.c_str());
+        return false;
+    }
+
+    // mixing a snapshot into another world is almost never what was meant, so it must be asked for
+    if (!overwrite && dest->listChunks().size() > 0) {
+        blok_error("Not restoring snapshot '%s', since the destination already has chunks saved in it", name.c_str());
+        return false;
+    }
+
+    List<uint8_t> packed, raw;
+    Chunk* chunk = new Chunk();
+    bool ok = true;
+    for (auto& it : tab) {
+        String fname = getBlobName(it.second);
+        size_t rawSize = sizeof(BlockData) * CHUNK_NUM_BLOCKS;
+        chunk->XZ = it.first;
+        chunk->clearEntities();
+        if (!readFileAll(fname, packed) || !inflateAll(packed, raw) || raw.size() < rawSize || (raw.size() > rawSize && !chunk->decodeEntities(&raw[rawSize], raw.size() - rawSize))) {
+            blok_error("Blob '%s' (chunk %i,%i) is missing or corrupt", fname.c_str(), it.first.X, it.first.Z);
+            ok = false;
+            continue;
+        }
+        memcpy(chunk->blocks, raw.data(), rawSize);
+
+        if (!dest->saveChunk(chunk)) ok = false;
+    }
+    delete chunk;
+
+    if (!dest->sync()) ok = false;
+
+    if (ok) blok_info("Restored %i chunks from snapshot '%s'", (int)tab.size(), name.c_str());
+    return ok;
+}
+
+// remove old snapshots, and the blobs only they used
+int Snapshots::prune(int keep) {
+    std::lock_guard<std::mutex> lock(L_take);
+    if (keep < 1) keep = 1;
+
+    List<String> names = list();
+    int n_remove = (int)names.size() - keep;
+    if (n_remove <= 0) return 0;
+
+    for (int i = 0; i < n_remove; ++i) {
+        unlink(getTableName(names[i]).c_str());
+    }
+
+    // find the blobs the remaining snapshots use (if any of them can't be read, keep everything, since
+    //   there is no way to know what it needs)
+    Set<String> used;
+    for (int i = n_remove; i < (int)names.size(); ++i) {
+        Map<ChunkID, Hash> tab;
+        if (!readTable(names[i], tab)) {
+            blok_warn("Snapshot '%s' is corrupt, so no blobs were removed", names[i].c_str());
+            return 0;
+        }
+        for (auto& it : tab) used.insert(getBlobName(it.second));
+    }
+    for (auto& it : table) used.insert(getBlobName(it.second));
+
+    int res = 0;
+    String blobs = path + "/blobs";
+    DIR* dir = opendir(blobs.c_str());
+    if (dir == NULL) return 0;
+
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.') continue;
+        String sub = blobs + "/" + ent->d_name;
+        DIR* subdir = opendir(sub.c_str());
+        if (subdir == NULL) continue;
+
+        struct dirent* blob;
+        while ((blob = readdir(subdir)) != NULL) {
+            if (blob->d_name[0] == '.') continue;
+            String fname = sub + "/" + blob->d_name;
+            if (used.find(fname) == used.end() && unlink(fname.c_str()) == 0) res++;
+        }
+        closedir(subdir);
+    }
+    closedir(dir);
+
+    blok_info("Pruned %i snapshots (%i blobs)", n_remove, res);
+    return res;
+}
+
+}
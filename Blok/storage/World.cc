@@ -0,0 +1,80 @@
+/* storage/World.cc - implementation of choosing the storage for a world directory
+ *
+ * The format of a world is whatever its region files say in their headers (see `storage/Region.cc`), or
+ *   WORLD_DIR if it only has chunk files (see `storage/Dir.cc`), so nothing else needs to be kept alongside
+ *   them, and a world is always opened the way it was saved
+ *
+ */
+
+#include <Blok/Storage.hh>
+
+// for reading the directory
+#include <dirent.h>
+
+namespace Blok::Storage {
+
+// the magic bytes at the start of every region file (see `storage/Region.cc`)
+static const char REGION_MAGIC[4] = { 'B', 'L', 'K', 'R' };
+
+// return the format a world was saved in (from its first region file)
+WorldFormat getWorldFormat(const String& path) {
+    DIR* dir = opendir(path.c_str());
+    if (dir == NULL) return WORLD_NONE;
+
+    WorldFormat res = WORLD_NONE;
+    bool hasChunkFiles = false;
+    struct dirent* ent;
+    while (res == WORLD_NONE && (ent = readdir(dir)) != NULL) {
+        int RX, RZ;
+        char tmp[64];
+        if (sscanf(ent->d_name, "c.%i.%i.blk", &RX, &RZ) == 2) {
+            // only used if there are no region files, since those say their format for certain
+            snprintf(tmp, sizeof(tmp), "c.%i.%i.blk", RX, RZ);
+            if (strcmp(tmp, ent->d_name) == 0) hasChunkFiles = true;
+            continue;
+        }
+        if (sscanf(ent->d_name, "r.%i.%i.blr", &RX, &RZ) != 2) continue;
+        snprintf(tmp, sizeof(tmp), "r.%i.%i.blr", RX, RZ);
+        if (strcmp(tmp, ent->d_name) != 0) continue;
+
+        // files that haven't had their header written yet don't say anything
+        String fname = path + "/" + ent->d_name;
+        FILE* fp = fopen(fname.c_str(), "rb");
+        if (fp == NULL) continue;
+        char magic[4];
+        uint32_t format;
+        if (fread(magic, 1, 4, fp) == 4 && memcmp(magic, REGION_MAGIC, 4) == 0 && fread(&format, sizeof(format), 1, fp) == 1) {
+            if (format == WORLD_REGION || format == WORLD_MMAP || format == WORLD_DELTA) {
+                res = (WorldFormat)format;
+            } else {
+                blok_warn("Region file '%s' has an unknown format (%u)", fname.c_str(), format);
+            }
+        }
+        fclose(fp);
+    }
+    closedir(dir);
+
+    if (res == WORLD_NONE && hasChunkFiles) res = WORLD_DIR;
+    return res;
+}
+
+// open a world in the format it was saved in
+Storage* openWorld(const String& path, WG::WG* gen, WorldFormat format) {
+    WorldFormat saved = getWorldFormat(path);
+    if (saved != WORLD_NONE && saved != format) {
+        blok_warn("World '%s' was saved in format %i, so it is being used instead of %i", path.c_str(), (int)saved, (int)format);
+        format = saved;
+    }
+
+    if (format == WORLD_DIR) {
+        return new DirStorage(path);
+    } else if (format == WORLD_DELTA) {
+        return new DeltaStorage(path, gen);
+    } else if (format == WORLD_MMAP) {
+        return new MMapStorage(path);
+    } else {
+        return new RegionStorage(path);
+    }
+}
+
+};
@@ -0,0 +1,283 @@
+/* storage/WriteBehind.cc - implementation of the background chunk writer
+ *
+ * Snapshots are kept in 'queued' (one per chunk, the latest wins) until the writer thread takes them
+ *   as a batch into 'writing'. While a batch is being written, loads of those chunks are served from
+ *   'writing', so there is never a window where the chunk can't be found
+ * Snapshots that fail to be written go into 'failed' (and are still loaded from there), so they are
+ *   neither lost nor retried over and over. 'sync()' queues them again, and reports whether they made it
+ *
+ */
+
+#include <Blok/Storage.hh>
+
+namespace Blok::Storage {
+
+// make a copy of a chunk's blocks and entities
+static Chunk* snapshot(Chunk* chunk) {
+    Chunk* res = new Chunk();
+    res->XZ = chunk->XZ;
+    memcpy(res->blocks, chunk->blocks, sizeof(BlockData) * CHUNK_NUM_BLOCKS);
+
+    // the entities are copied through their saved form, since that is the only way to copy an
+    //   entity without knowing its type
+    if (chunk->entities.size() > 0) {
+        List<uint8_t> ents;
+        chunk->encodeEntities(ents);
+        if (ents.size() > 0) res->decodeEntities(&ents[0], ents.size());
+    }
+    return res;
+}
+
+// construct and start writing
+WriteBehind::WriteBehind(Storage* inner, FsyncPolicy fsyncPolicy, double fsyncInterval) {
+    this->inner = inner;
+    this->fsyncPolicy = fsyncPolicy;
+    this->fsyncInterval = fsyncInterval;
+    this->maxBatch = 64;
+
+    // initialize statistics to nothing
+    stats.n_saves = stats.n_coalesced = 0;
+    stats.n_writes = stats.n_batches = 0;
+    stats.n_syncs = 0;
+    stats.max_depth = 0;
+    stats.t_writes = 0.0;
+
+    lastSync = getTime();
+
+    running = true;
+    T_writer = std::thread(&WriteBehind::T_writer_run, this);
+}
+
+// flush & stop
+WriteBehind::~WriteBehind() {
+    std::unique_lock<std::mutex> lock(L_queue);
+    running = false;
+    C_queued.notify_all();
+    lock.unlock();
+
+    // the writer drains the queue before it exits
+    T_writer.join();
+
+    // give the failed writes one last try
+    for (auto& entry : failed) {
+        if (!inner->saveChunk(entry.second)) {
+            blok_error("Failed to write chunk %i,%i, so its changes are lost", entry.first.X, entry.first.Z);
+        }
+        delete entry.second;
+    }
+    failed.clear();
+
+    inner->sync();
+    delete inner;
+}
+
+// queue a snapshot
+void WriteBehind::enqueue(Chunk* snap) {
+    stats.n_saves++;
+
+    // a failed write is superseded by the new one
+    auto fit = failed.find(snap->XZ);
+    if (fit != failed.end()) {
+        delete fit->second;
+        failed.erase(fit);
+    }
+
+    auto it = queued.find(snap->XZ);
+    if (it != queued.end()) {
+        // replace the older snapshot, which never needs to be written
+        delete it->second;
+        it->second = snap;
+        stats.n_coalesced++;
+    } else {
+        queued[snap->XZ] = snap;
+    }
+
+    int depth = queued.size() + writing.size();
+    if (depth > stats.max_depth) stats.max_depth = depth;
+
+    C_queued.notify_one();
+}
+
+// save a snapshot of a chunk
+bool WriteBehind::saveChunk(Chunk* chunk) {
+    // copy it outside of the lock (resetting the flag first, so changes made during the copy are
+    //   not forgotten)
+    chunk->modified = false;
+    Chunk* snap = snapshot(chunk);
+
+    L_queue.lock();
+    enqueue(snap);
+    L_queue.unlock();
+
+    return true;
+}
+
+// save a chunk that is no longer needed
+void WriteBehind::saveAndFree(Chunk* chunk) {
+    chunk->modified = false;
+
+    L_queue.lock();
+    enqueue(chunk);
+    L_queue.unlock();
+}
+
+// return whether a chunk is saved
+bool WriteBehind::hasChunk(ChunkID id) {
+    L_queue.lock();
+    bool res = queued.find(id) != queued.end() || writing.find(id) != writing.end() || failed.find(id) != failed.end();
+    L_queue.unlock();
+
+    return res || inner->hasChunk(id);
+}
+
+// list the saved & queued chunks
+List<ChunkID> WriteBehind::listChunks() {
+    Set<ChunkID> res;
+
+    L_queue.lock();
+    for (auto& entry : queued) res.insert(entry.first);
+    for (auto& entry : writing) res.insert(entry.first);
+    for (auto& entry : failed) res.insert(entry.first);
+    L_queue.unlock();
+
+    for (ChunkID id : inner->listChunks()) res.insert(id);
+
+    return List<ChunkID>(res.begin(), res.end());
+}
+
+// load a chunk
+Chunk* WriteBehind::loadChunk(ChunkID id) {
+    L_queue.lock();
+
+    // the newest copy is the queued one, then the one being written, then one that failed to be written
+    Chunk* snap = NULL;
+    for (Map<ChunkID, Chunk*>* from : { &queued, &writing, &failed }) {
+        auto it = from->find(id);
+        if (it != from->end()) {
+            snap = it->second;
+            break;
+        }
+    }
+    if (snap == NULL) {
+        L_queue.unlock();
+        return inner->loadChunk(id);
+    }
+
+    Chunk* res = snapshot(snap);
+    L_queue.unlock();
+
+    return res;
+}
+
+// retry failed writes, and wait for everything queued to be written
+bool WriteBehind::sync() {
+    std::unique_lock<std::mutex> lock(L_queue);
+    if (failed.size() > 0) {
+        // NOTE: a chunk is never in both (see 'enqueue()'), so nothing newer is replaced here
+        for (auto& entry : failed) queued[entry.first] = entry.second;
+        failed.clear();
+        C_queued.notify_one();
+    }
+    C_written.wait(lock, [this]() {
+        return queued.size() == 0 && writing.size() == 0;
+    });
+    int n_failed = failed.size();
+    lock.unlock();
+
+    bool ok = inner->sync();
+
+    L_queue.lock();
+    stats.n_syncs++;
+    lastSync = getTime();
+    L_queue.unlock();
+
+    if (n_failed > 0) blok_error("Failed to write %i chunks, which will be tried again on the next sync", n_failed);
+    return n_failed == 0 && ok;
+}
+
+// wait for a single chunk to be written
+void WriteBehind::wait(ChunkID id) {
+    std::unique_lock<std::mutex> lock(L_queue);
+    C_written.wait(lock, [this, id]() {
+        return queued.find(id) == queued.end() && writing.find(id) == writing.end();
+    });
+}
+
+// return the queue depth
+int WriteBehind::getQueueDepth() {
+    L_queue.lock();
+    int res = queued.size() + writing.size();
+    L_queue.unlock();
+    return res;
+}
+
+// return the write throughput
+double WriteBehind::getWriteRate() {
+    L_queue.lock();
+    double res = stats.t_writes > 0.0 ? stats.n_writes / stats.t_writes : 0.0;
+    L_queue.unlock();
+    return res;
+}
+
+// write batches until stopped
+void WriteBehind::T_writer_run() {
+    std::unique_lock<std::mutex> lock(L_queue);
+
+    while (true) {
+        C_queued.wait(lock, [this]() {
+            return !running || queued.size() > 0;
+        });
+
+        // only stop once everything has been written
+        if (queued.size() == 0) break;
+
+        // take the batch
+        auto it = queued.begin();
+        while (it != queued.end() && (int)writing.size() < maxBatch) {
+            writing.insert(*it);
+            it = queued.erase(it);
+        }
+
+        // 'sync()' updates it from other threads, so it is read while the lock is still held
+        double prevSync = lastSync;
+        lock.unlock();
+
+        double stime = getTime();
+        List<ChunkID> bad;
+        for (auto& entry : writing) {
+            if (!inner->saveChunk(entry.second)) {
+                blok_error("Failed to write chunk %i,%i", entry.first.X, entry.first.Z);
+                bad.push_back(entry.first);
+            }
+        }
+
+        bool doSync = fsyncPolicy == FSYNC_BATCH || (fsyncPolicy == FSYNC_INTERVAL && getTime() - prevSync >= fsyncInterval);
+        if (doSync) inner->sync();
+        stime = getTime() - stime;
+
+        lock.lock();
+
+        stats.n_writes += writing.size();
+        stats.n_batches++;
+        stats.t_writes += stime;
+        if (doSync) {
+            stats.n_syncs++;
+            lastSync = getTime();
+        }
+
+        // keep the ones that failed, unless they have been saved again since
+        for (ChunkID id : bad) {
+            if (queued.find(id) != queued.end()) continue;
+            failed[id] = writing[id];
+            writing.erase(id);
+        }
+        for (auto& entry : writing) {
+            delete entry.second;
+        }
+        writing.clear();
+
+        C_written.notify_all();
+    }
+}
+
+};
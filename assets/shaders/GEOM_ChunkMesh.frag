@@ -20,6 +20,9 @@ in vec4 fWPos;
 // ambient occlusion
 in float fAO;
 
+// <u, v> the corner of the tile of the texture that 'fUV' repeats within
+in vec2 fTile;
+
 
 /* FBO Outputs */
 
@@ -51,18 +54,24 @@ uniform sampler2D texID3;
 
 void main() {
 
+    // merged faces span several blocks, so wrap the coordinates into the tile (each tile is a quarter
+    //   of the texture), using the derivatives of the unwrapped coordinates so the mip level doesn't
+    //   jump at the seams
+    vec2 uv = fTile + 0.5 * fract(fUV);
+    vec2 dx = 0.5 * dFdx(fUV), dy = 0.5 * dFdy(fUV);
+
     // sample 'col' as the given block
     vec4 col = vec4(1, 0, 0, 1);
-    //col = texture(texID3, fUV);
+    //col = texture(texID3, uv);
 
     // check various constants
     // TODO: texture atlas
     if (fBlockID < 1.1) {
-        col = texture(texID1, fUV);
+        col = textureGrad(texID1, uv, dx, dy);
     } else if (fBlockID < 2.1) {
-        col = texture(texID2, fUV);
+        col = textureGrad(texID2, uv, dx, dy);
     } else if (fBlockID < 3.1) {
-        col = texture(texID3, fUV);
+        col = textureGrad(texID3, uv, dx, dy);
     } else {
         discard;
     }
@@ -89,7 +98,7 @@ void main() {
     // mix ambient occlusion
     gColor = col * (0.3 + 0.8 * fAO);
     gPos = fPos;
-    gUV = vec4(fUV, 0.0f, 0.0f);
+    gUV = vec4(uv, 0.0f, 0.0f);
     gNormal = vec4(N, 0.0f);
     gWPos = fWPos;
     gWPos.w = (fPos.z + 1) / 2 + 1; 
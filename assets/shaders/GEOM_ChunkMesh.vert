@@ -2,25 +2,11 @@
 
 /* VAO/VBO Inputs */
 
-// local vertex position of the model
-layout (location = 0) in vec3 aPos;
-
-// UV coordinates of the vertex
-layout (location = 1) in vec2 aUV;
-
-// Tangent, Bitangent, Normal space of the vertex
-layout (location = 2) in vec3 aT;
-layout (location = 3) in vec3 aB;
-layout (location = 4) in vec3 aN;
-
-/* Instanced Inputs */
-
-// Instance values (block position in the world, and ID)
-//layout (location = 5) in vec3 gBlockPos;
-layout (location = 5) in float gBlockID;
-
-// ambient occlusion amount
-layout (location = 6) in float aAO;
+// the packed vertex (see 'ChunkMeshVertex' in Render.hh):
+//   x: the position within the chunk (bits 0-4, 5-13 and 14-18), the face (bits 19-21) and the ambient
+//      occlusion level (bits 22-23)
+//   y: the block ID
+layout (location = 0) in uvec2 aPacked;
 
 /* Fragment Shader Outputs */
 
@@ -36,30 +22,76 @@ out float fBlockID;
 out vec4 fWPos;
 // the world position
 out float fAO;
+// the texture tile
+out vec2 fTile;
 
 /* Globals */
 
 // the Projection * View matrix
 uniform mat4 gPV;
 
+// the world position of the chunk
+uniform vec3 gChunkPos;
+
+/* Constants */
+
+// the normal of each face (in the order of `ChunkMeshVertex::Face`: top, bottom, right, left, forward, back)
+const vec3 FACE_N[6] = vec3[6](
+    vec3(0, 1, 0), vec3(0, -1, 0),
+    vec3(1, 0, 0), vec3(-1, 0, 0),
+    vec3(0, 0, 1), vec3(0, 0, -1)
+);
+
+// the corner of the tile of the block texture each face uses
+const vec2 FACE_TILE[6] = vec2[6](
+    vec2(0.0, 0.0), vec2(0.5, 0.0),
+    vec2(0.0, 0.5), vec2(0.0, 0.5),
+    vec2(0.0, 0.5), vec2(0.0, 0.5)
+);
+
+// the directions the texture coordinates (u, v) go along each face, so they repeat once per block
+const vec3 FACE_U[6] = vec3[6](
+    vec3(1, 0, 0), vec3(-1, 0, 0),
+    vec3(0, 0, 1), vec3(0, 0, -1),
+    vec3(-1, 0, 0), vec3(1, 0, 0)
+);
+const vec3 FACE_V[6] = vec3[6](
+    vec3(0, 0, -1), vec3(0, 0, -1),
+    vec3(0, -1, 0), vec3(0, -1, 0),
+    vec3(0, -1, 0), vec3(0, -1, 0)
+);
+
+// how lit a corner is, for each ambient occlusion level (the number of solid blocks around it)
+const float AO_LIGHT[4] = float[4](1.0, 2.0 / 3.0, 1.0 / 3.0, 0.0);
+
 void main() {
 
+    // unpack the vertex
+    vec3 lpos = vec3(aPacked.x & 0x1Fu, (aPacked.x >> 5) & 0x1FFu, (aPacked.x >> 14) & 0x1Fu);
+    int face = int((aPacked.x >> 19) & 0x7u);
+    int aoLevel = int((aPacked.x >> 22) & 0x3u);
+
+    vec3 aPos = gChunkPos + lpos;
+
     // calculate transformed position
     fPos = gPV * vec4(aPos, 1.0);
 
     // get world position
     fWPos = vec4(aPos, fPos.z);
     
-    // just send the UV over
-    fUV = aUV;
+    // the texture coordinates (local to the chunk, to keep them small)
+    fUV = vec2(dot(FACE_U[face], lpos), dot(FACE_V[face], lpos));
+
+    fTile = FACE_TILE[face];
 
     // send the normal over (TODO: include just the model scaling here)
-    fN = aN;
+    fN = FACE_N[face];
 
     // send the block ID over
-    fBlockID = gBlockID;
+    fBlockID = float(aPacked.y & 0xFFu);
 
-    fAO = aAO;
+    // the ambient occlusion, with an effect based on height
+    fAO = AO_LIGHT[aoLevel] * (0.75 + 0.35 * aPos.y / 256.0);
 
     // update opengl vars
     gl_Position = fPos;
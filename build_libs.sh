@@ -106,9 +106,12 @@ cd $PORTAUDIO_DIR
 #PORTAUDIO_SLIB=$PWD/lib/.libs/libportaudio.a
 #strip --strip-debug $PORTAUDIO_SLIB
 
-# build libarchive
+# build libarchive (only tar is used, and Blok compresses the entries itself, so leave out the
+#   optional libraries, which would all need to be linked in)
 cd $ARCHIVE_DIR
-./configure --prefix=$PREFIX --enable-static --disable-shared && \
+./configure --prefix=$PREFIX --enable-static --disable-shared --disable-bsdtar --disable-bsdcpio --disable-bsdcat \
+    --disable-acl --disable-xattr --without-zlib --without-bz2lib --without-libb2 --without-iconv --without-lz4 \
+    --without-zstd --without-lzma --without-cng --without-openssl --without-xml2 --without-expat && \
     make -j$JOBS && \
     make install || { echo "Compiling 'archive' failed"; exit 1; }
 #ARCHIVE_SLIB=$PWD/.libs/libarchive.a